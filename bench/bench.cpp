@@ -0,0 +1,1528 @@
+// Benchmarks and the trace replayer, built as the HYPERVADMINISSUE_BENCH target. main.cpp
+// is compiled into it with HCN_NO_MAIN, so every bench drives the shipping code against the
+// stub. A command line without a bench flag runs an ordinary start, against the stub when
+// --stub is given.
+#include "../main.cpp"
+#include "../test/stub.h"
+
+#pragma region Benchmarks
+
+// Fires bursts of HcnCreateEndpoint from many workers against the latency-injecting stub,
+// once with admission control disabled and once enabled, and compares tail latency.
+int benchAdmission(int argc, char* argv[])
+{
+    size_t workers = std::stoul(xargValue(argc, argv, "--workers", "64"));
+    size_t calls = std::stoul(xargValue(argc, argv, "--calls", "8"));
+    std::chrono::microseconds base{ std::stoll(xargValue(argc, argv, "--base-us", "20000")) };
+    std::chrono::microseconds penalty{ std::stoll(xargValue(argc, argv, "--penalty-us", "5000")) };
+
+    VmmgrHypervStub::install(base, penalty);
+
+    for (bool enabled : { false, true })
+    {
+        HcnAdmission::instance().configure(HcnAdmission::Options{ .tokensPerSecond = 1000.0, .burst = 50.0 });
+        HcnAdmission::instance().setEnabled(enabled);
+
+        std::mutex samplesMutex;
+        std::vector<double> endToEnd;
+        std::vector<double> service;
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < workers; ++w)
+        {
+            threads.emplace_back([&] {
+                for (size_t c = 0; c < calls; ++c)
+                {
+                    GUID guid = xguidRandom();
+                    HCN_ENDPOINT endpoint = nullptr;
+                    HcnErrorRecord errStr;
+                    double serviceMs = 0.0;
+
+                    auto callStart = std::chrono::steady_clock::now();
+                    HcnAdmission::instance().run([&] {
+                        auto serviceStart = std::chrono::steady_clock::now();
+                        HRESULT result = VmmgrHypervApi::HcnCreateEndpoint(nullptr, guid, L"{}", &endpoint, &errStr);
+                        serviceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - serviceStart).count();
+                        return result;
+                    });
+                    double endToEndMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - callStart).count();
+
+                    std::scoped_lock lock(samplesMutex);
+                    endToEnd.push_back(endToEndMs);
+                    service.push_back(serviceMs);
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("admission {}: calls {}, calls/s {:.1f}, service p50Ms {:.2f} p99Ms {:.2f}, end-to-end p50Ms {:.2f} p99Ms {:.2f}\n",
+            enabled ? "on" : "off", service.size(), service.size() / seconds,
+            xpercentile(service, 50), xpercentile(service, 99), xpercentile(endToEnd, 50), xpercentile(endToEnd, 99));
+        if (enabled)
+            printAdmissionStats();
+    }
+    return 0;
+}
+
+// Keeps --bulk-workers threads issuing bulk calls against a fixed in-flight limit while one
+// thread makes --interactive spaced interactive calls, first with FIFO admission and then
+// with priority admission, and compares per-class end-to-end latency.
+int benchPriority(int argc, char* argv[])
+{
+    size_t bulkWorkers = std::stoul(xargValue(argc, argv, "--bulk-workers", "64"));
+    size_t interactive = std::stoul(xargValue(argc, argv, "--interactive", "50"));
+    std::chrono::microseconds base{ std::stoll(xargValue(argc, argv, "--base-us", "20000")) };
+    std::chrono::milliseconds agingStep{ std::stoll(xargValue(argc, argv, "--aging-ms", "1000")) };
+
+    VmmgrHypervStub::install(base, std::chrono::microseconds(0));
+    HcnAdmission::instance().setEnabled(true);
+
+    for (bool prioritize : { false, true })
+    {
+        HcnAdmission::instance().configure(HcnAdmission::Options{ .tokensPerSecond = 1e6, .burst = 1e6, .initialLimit = 8.0,
+            .minLimit = 8.0, .maxLimit = 8.0, .latencyTarget = std::chrono::hours(1), .prioritize = prioritize, .agingStep = agingStep });
+
+        auto call = [] {
+            GUID guid = xguidRandom();
+            HCN_ENDPOINT endpoint = nullptr;
+            HcnErrorRecord errStr;
+            auto start = std::chrono::steady_clock::now();
+            HcnAdmission::instance().run([&] { return VmmgrHypervApi::HcnCreateEndpoint(nullptr, guid, L"{}", &endpoint, &errStr); });
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        std::atomic<bool> stopping{ false };
+        std::mutex samplesMutex;
+        std::vector<double> bulk;
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < bulkWorkers; ++w)
+        {
+            threads.emplace_back([&] {
+                HcnPriorityScope priority(HcnPriority::Bulk);
+                while (!stopping)
+                {
+                    double ms = call();
+                    std::scoped_lock lock(samplesMutex);
+                    bulk.push_back(ms);
+                }
+            });
+        }
+
+        // Let the bulk backlog build up before the interactive starts arrive.
+        std::this_thread::sleep_for(base * 4);
+        std::vector<double> foreground;
+        {
+            HcnPriorityScope priority(HcnPriority::Interactive);
+            for (size_t i = 0; i < interactive; ++i)
+            {
+                foreground.push_back(call());
+                std::this_thread::sleep_for(base / 2);
+            }
+        }
+
+        stopping = true;
+        for (auto& thread : threads)
+            thread.join();
+
+        HcnAdmission::Stats stats = HcnAdmission::instance().stats();
+        const HcnAdmission::ClassStats& bulkStats = stats.classes[static_cast<size_t>(HcnPriority::Bulk)];
+        std::cout << std::format("{}: interactive p50Ms {:.2f} p99Ms {:.2f}, bulk calls {} p50Ms {:.2f} p99Ms {:.2f} maxWaitMs {:.2f} aged {}\n",
+            prioritize ? "priority" : "fifo    ", xpercentile(foreground, 50), xpercentile(foreground, 99),
+            bulk.size(), xpercentile(bulk, 50), xpercentile(bulk, 99), bulkStats.maxWaitMs, bulkStats.aged);
+    }
+    return 0;
+}
+
+// Runs --starts endpoint starts on --workers threads against a stub in which every
+// --hang-every'th call stalls for --hang-ms, first with unbounded calls and then with
+// --timeout-ms deadlines. Each start creates an endpoint and then opens it, the open standing
+// in for the steps that depend on the create; it shares the start's budget and is cancelled
+// when the create used it up.
+int benchDeadline(int argc, char* argv[])
+{
+    size_t starts = std::stoul(xargValue(argc, argv, "--starts", "200"));
+    size_t workers = std::stoul(xargValue(argc, argv, "--workers", "16"));
+    std::chrono::milliseconds timeout{ std::stoll(xargValue(argc, argv, "--timeout-ms", "250")) };
+
+    VmmgrHypervStub::install(std::chrono::milliseconds(5), std::chrono::microseconds(0));
+    VmmgrHypervStub::mHangEvery = std::stoull(xargValue(argc, argv, "--hang-every", "25"));
+    VmmgrHypervStub::mHangDuration = std::chrono::milliseconds(std::stoll(xargValue(argc, argv, "--hang-ms", "2000")));
+    HcnAdmission::instance().setEnabled(false);
+    HcnRetry::instance().setEnabled(false);
+
+    for (bool bounded : { false, true })
+    {
+        if (bounded)
+            HcnDeadline::install(timeout);
+
+        std::vector<double> latency(starts);
+        std::atomic<size_t> next{ 0 };
+        std::atomic<size_t> failed{ 0 };
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < workers; ++w)
+        {
+            threads.emplace_back([&] {
+                for (size_t i; (i = next++) < starts;)
+                {
+                    auto begin = std::chrono::steady_clock::now();
+                    HcnDeadlineScope budget(bounded ? begin + timeout : HcnDeadlineScope::time_point::max());
+
+                    GUID id = xguidRandom();
+                    unique_hcn_endpoint endpoint;
+                    HcnErrorRecord errStr;
+                    HRESULT result = hcnInvoke(HcnCall::CreateEndpoint, id, 0, errStr, [&] {
+                        return VmmgrHypervApi::HcnCreateEndpoint(nullptr, id, L"{}", endpoint.put(), &errStr);
+                    });
+
+                    unique_hcn_endpoint opened;
+                    HRESULT openResult = hcnInvoke(HcnCall::OpenEndpoint, id, 0, errStr, [&] {
+                        return VmmgrHypervApi::HcnOpenEndpoint(id, opened.put(), &errStr);
+                    });
+
+                    failed += FAILED(result) || FAILED(openResult);
+                    latency[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("{}: starts {}, failed {}, starts/s {:.1f}, p50Ms {:.2f}, p99Ms {:.2f}, maxMs {:.2f}\n",
+            bounded ? "deadline " : "unbounded", starts, failed.load(), starts / seconds,
+            xpercentile(latency, 50), xpercentile(latency, 99), *std::max_element(latency.begin(), latency.end()));
+    }
+
+    // Let the abandoned calls return so their handles are reconciled before reporting.
+    std::this_thread::sleep_for(VmmgrHypervStub::mHangDuration);
+    printDeadlineStats();
+    return 0;
+}
+
+// Creates endpoints on --workers threads against a stub that injects failures, in phases:
+// transient busy errors at --busy-pct with and without retries, a full outage that should open
+// the breaker and then recover through a half-open probe, and invalid settings that must not
+// be retried. Each phase reports how many calls succeeded and how many reached the host.
+int benchRetry(int argc, char* argv[])
+{
+    size_t calls = std::stoul(xargValue(argc, argv, "--calls", "400"));
+    size_t workers = std::stoul(xargValue(argc, argv, "--workers", "8"));
+    double busy = std::stod(xargValue(argc, argv, "--busy-pct", "30")) / 100.0;
+
+    VmmgrHypervStub::install(std::chrono::milliseconds(1), std::chrono::microseconds(0));
+    HcnAdmission::instance().setEnabled(false);
+    HcnRetry::Options options{ .baseDelay = std::chrono::milliseconds(5), .maxDelay = std::chrono::milliseconds(100),
+        .openFor = std::chrono::milliseconds(200) };
+
+    auto phase = [&](const char* name, bool retry, double rate, HRESULT injected) {
+        HcnRetry::instance().configure(options);
+        HcnRetry::instance().setEnabled(retry);
+        VmmgrHypervStub::mInjectRate = rate;
+        VmmgrHypervStub::mInjectResult = injected;
+        uint64_t hostCalls = VmmgrHypervStub::mCalls;
+
+        std::atomic<size_t> next{ 0 };
+        std::atomic<size_t> succeeded{ 0 };
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < workers; ++w)
+        {
+            threads.emplace_back([&] {
+                while (next++ < calls)
+                {
+                    GUID id = xguidRandom();
+                    unique_hcn_endpoint endpoint;
+                    HcnErrorRecord errStr;
+                    HRESULT result = hcnInvoke(HcnCall::CreateEndpoint, id, 0, errStr, [&] {
+                        return VmmgrHypervApi::HcnCreateEndpoint(nullptr, id, L"{}", endpoint.put(), &errStr);
+                    });
+                    succeeded += SUCCEEDED(result);
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("{}: succeeded {}/{}, hostCalls {}, seconds {:.2f}\n  ", name, succeeded.load(), calls,
+            VmmgrHypervStub::mCalls - hostCalls, seconds);
+        printRetryStats();
+    };
+
+    phase("busy, no retry", false, busy, HRESULT_FROM_WIN32(ERROR_BUSY));
+    phase("busy, retry   ", true, busy, HRESULT_FROM_WIN32(ERROR_BUSY));
+    phase("outage        ", true, 1.0, HRESULT_FROM_WIN32(RPC_S_SERVER_UNAVAILABLE));
+
+    // The breaker is left open by the outage; once the host is back a probe closes it.
+    VmmgrHypervStub::mInjectRate = 0.0;
+    std::this_thread::sleep_for(options.openFor);
+    GUID id = xguidRandom();
+    unique_hcn_endpoint endpoint;
+    HcnErrorRecord errStr;
+    HRESULT probe = hcnInvoke(HcnCall::CreateEndpoint, id, 0, errStr, [&] {
+        return VmmgrHypervApi::HcnCreateEndpoint(nullptr, id, L"{}", endpoint.put(), &errStr);
+    });
+    std::cout << std::format("recovery probe: result {}\n  ", probe);
+    printRetryStats();
+
+    phase("invalid json  ", true, 1.0, HCN_E_INVALID_JSON);
+    return 0;
+}
+
+// Fills the stub with --networks networks tagged with one Owner, each with --endpoints
+// endpoints, plus a network of another owner, and tears the owner's resources down with one
+// worker and with --workers workers. Then sweeps the endpoints left orphaned by a config that
+// references only the first endpoint of every network, and tears down a config that names
+// each network but only its first endpoint, which must leave the shared networks in place.
+int benchTeardown(int argc, char* argv[])
+{
+    size_t networkCount = std::stoul(xargValue(argc, argv, "--networks", "8"));
+    size_t endpointCount = std::stoul(xargValue(argc, argv, "--endpoints", "16"));
+    size_t workers = std::stoul(xargValue(argc, argv, "--workers", "8"));
+    const std::string owner = "BenchTeardown";
+
+    VmmgrHypervStub::install(std::chrono::milliseconds(5), std::chrono::microseconds(0));
+    HcnAdmission::instance().setEnabled(false);
+
+    auto populate = [&](const std::string& networkOwner, size_t networks) {
+        boost::json::array referenced;
+        std::scoped_lock lock(VmmgrHypervStub::mMutex);
+        for (size_t i = 0; i < networks; ++i)
+        {
+            std::string network = xstrGuid(xguidRandom());
+            VmmgrHypervStub::mNetworks.emplace(network, boost::json::object{ { "Owner", networkOwner }, { "Type", "NAT" } });
+            for (size_t j = 0; j < endpointCount; ++j)
+            {
+                std::string endpoint = xstrGuid(xguidRandom());
+                VmmgrHypervStub::mEndpoints.emplace(endpoint, boost::json::object{ { "VirtualNetwork", network } });
+                if (j == 0)
+                    referenced.push_back(boost::json::object{ { "ID", endpoint }, { "VirtualNetwork", network } });
+            }
+        }
+        return boost::json::value(boost::json::object{ { "HcnEndpoint", std::move(referenced) } });
+    };
+
+    populate("SomeoneElse", 1);
+    for (size_t poolSize : { size_t(1), workers })
+    {
+        populate(owner, networkCount);
+        HcnTeardown::Plan plan = HcnTeardown::fromOwner(owner, poolSize);
+        HcnTeardown::Result result = HcnTeardown::run(plan, poolSize);
+        std::cout << std::format("workers {}: ", poolSize);
+        HcnTeardown::print(plan, &result);
+    }
+
+    boost::json::value config = populate(owner, networkCount);
+    HcnTeardown::Plan plan = HcnTeardown::orphans(owner, { &config }, workers);
+    HcnTeardown::Result result = HcnTeardown::run(plan, workers);
+    std::cout << "sweep: ";
+    HcnTeardown::print(plan, &result);
+
+    config = populate(owner, networkCount);
+    boost::json::array networks;
+    for (const auto& endpoint : (config / "HcnEndpoint").as_array())
+        networks.push_back(boost::json::object{ { "ID", endpoint / "VirtualNetwork" } });
+    config.as_object()["HcnNetwork"] = std::move(networks);
+    plan = HcnTeardown::fromConfigs({ &config });
+    HcnTeardown::keepShared(plan, workers);
+    result = HcnTeardown::run(plan, workers);
+    std::cout << "shared: ";
+    HcnTeardown::print(plan, &result);
+
+    std::scoped_lock lock(VmmgrHypervStub::mMutex);
+    std::cout << std::format("left on the host: networks {}, endpoints {}\n", VmmgrHypervStub::mNetworks.size(), VmmgrHypervStub::mEndpoints.size());
+    return 0;
+}
+
+// Provisions --networks networks of --endpoints endpoints each directly in the stub and probes
+// them: a clean round, a round after one endpoint is deleted and another has its NAT policy
+// changed behind the prober's back, and rounds under a CPU budget of half the measured
+// cost. Host calls per round are compared with an open + query per resource.
+int benchHealth(int argc, char* argv[])
+{
+    size_t networkCount = std::stoul(xargValue(argc, argv, "--networks", "4"));
+    size_t endpointCount = std::stoul(xargValue(argc, argv, "--endpoints", "250"));
+    auto interval = std::chrono::milliseconds(std::stoll(xargValue(argc, argv, "--interval-ms", "200")));
+
+    VmmgrHypervStub::install(std::chrono::microseconds(200), std::chrono::microseconds(0));
+    HcnAdmission::instance().setEnabled(false);
+
+    boost::json::array networks;
+    boost::json::array endpoints;
+    for (size_t i = 0; i < networkCount; ++i)
+    {
+        std::string network = xstrGuid(xguidRandom());
+        networks.push_back(boost::json::object{ { "ID", network }, { "Owner", "BenchHealth" }, { "Type", "NAT" } });
+        for (size_t j = 0; j < endpointCount; ++j)
+        {
+            endpoints.push_back(boost::json::object{ { "ID", xstrGuid(xguidRandom()) }, { "VirtualNetwork", network },
+                { "Policies", boost::json::array{ boost::json::object{ { "Type", "NAT" }, { "Protocol", "TCP" }, { "InternalPort", 5555 },
+                    { "ExternalPort", 20000 + i * endpointCount + j } } } } });
+        }
+    }
+    boost::json::value config = boost::json::object{ { "HcnNetwork", std::move(networks) }, { "HcnEndpoint", std::move(endpoints) } };
+
+    {
+        std::scoped_lock lock(VmmgrHypervStub::mMutex);
+        for (const auto& network : (config / "HcnNetwork").as_array())
+            VmmgrHypervStub::mNetworks.emplace((network / "ID").as_string(), network);
+        for (const auto& endpoint : (config / "HcnEndpoint").as_array())
+        {
+            boost::json::object properties = endpoint.as_object();
+            properties.erase("ID");
+            VmmgrHypervStub::mEndpoints.emplace((endpoint / "ID").as_string(), std::move(properties));
+        }
+    }
+
+    size_t resources = networkCount * (endpointCount + 1);
+    auto round = [&](HcnHealthProber& prober, const char* label) {
+        uint64_t calls = VmmgrHypervStub::mCalls;
+        auto start = std::chrono::steady_clock::now();
+        std::streambuf* out = std::cout.rdbuf(nullptr);
+        prober.probeRound();
+        std::cout.rdbuf(out);
+        HcnHealthProber::Stats stats = prober.stats();
+        std::cout << std::format("{:<10} hostCalls {:>5} (open + query per resource {}), endpointDrift {}, repaired {}, cpuMsPer1000 {:.2f}, policyShare {:.2f}, roundMs {:.0f}\n",
+            label, VmmgrHypervStub::mCalls - calls, 2 * resources, stats.endpointDrift, stats.repaired, stats.cpuMsPer1000, stats.policyShare,
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    };
+
+    HcnHealthProber prober(config, HcnHealthProber::Options{ .interval = interval, .cpuBudgetMs = 0 });
+    round(prober, "first");
+    round(prober, "clean");
+
+    {
+        std::scoped_lock lock(VmmgrHypervStub::mMutex);
+        const boost::json::array& configured = (config / "HcnEndpoint").as_array();
+        VmmgrHypervStub::mEndpoints.erase(std::string((configured[0] / "ID").as_string()));
+        VmmgrHypervStub::mEndpoints.at(std::string((configured[configured.size() - 1] / "ID").as_string())).as_object()["Policies"] =
+            boost::json::array{ boost::json::object{ { "Type", "NAT" }, { "Protocol", "TCP" }, { "InternalPort", 5556 } } };
+    }
+    round(prober, "drifted");
+    round(prober, "repaired");
+    prober.print();
+
+    double budget = prober.stats().cpuMsPer1000 / 2;
+    HcnHealthProber budgeted(config, HcnHealthProber::Options{ .interval = interval, .cpuBudgetMs = budget });
+    for (int i = 0; i < 4; ++i)
+        round(budgeted, "budgeted");
+    budgeted.print();
+    return 0;
+}
+
+// Writes --configs instances of --config, each with its own network and endpoint GUIDs, and
+// provisions them through the fleet against per-worker stubs with 1, 2, 4 ... --workers
+// worker processes, then once more at full width with worker 0 killed a quarter of the way in.
+int benchFleet(int argc, char* argv[])
+{
+    size_t configCount = std::stoul(xargValue(argc, argv, "--configs", "32"));
+    size_t maxWorkers = std::stoul(xargValue(argc, argv, "--workers", "4"));
+    boost::json::value base = xjsonReadFromFile(xargValue(argc, argv, "--config", "HypervVm.json"));
+    if (!base.is_object())
+        return 1;
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / std::format("hypervadmin-fleet-{}", GetCurrentProcessId());
+    std::filesystem::create_directories(dir);
+    std::vector<std::string> configs;
+    for (size_t i = 0; i < configCount; ++i)
+    {
+        boost::json::value config = base;
+        NameGuid::inject(config, NameGuid::kNamespace, std::format("fleet{}", i));
+        std::filesystem::path path = dir / std::format("instance{}.json", i);
+        std::ofstream(path, std::ios::trunc) << boost::json::serialize(config);
+        configs.push_back(path.string());
+    }
+
+    FleetCoordinator::Options options;
+    options.workerArgs = "--stub --no-trace";
+    double baseline = 0;
+    for (size_t workers = 1; workers <= maxWorkers; workers *= 2)
+    {
+        options.workers = workers;
+        FleetCoordinator::Result result = FleetCoordinator(configs, options).run();
+        double rate = result.seconds > 0 ? result.completed / result.seconds : 0.0;
+        baseline = workers == 1 ? rate : baseline;
+        std::cout << std::format("scaling {:.2f}x  ", baseline > 0 ? rate / baseline : 0.0);
+        FleetCoordinator::print(result);
+    }
+
+    options.workers = maxWorkers;
+    options.killAfter = std::max<size_t>(configCount / 4, 1);
+    FleetCoordinator::print(FleetCoordinator(configs, options).run());
+
+    std::filesystem::remove_all(dir);
+    return 0;
+}
+
+// Looks up endpoint handles by GUID from a growing number of threads while one more thread
+// keeps closing and re-registering endpoints, through the sharded registry and through a
+// single map behind a shared_mutex, and compares lookup throughput and latency.
+int benchHandleRegistry(int argc, char* argv[])
+{
+    size_t entries = std::stoul(xargValue(argc, argv, "--entries", "20000"));
+    size_t maxThreads = std::stoul(xargValue(argc, argv, "--threads", "16"));
+    size_t lookups = std::stoul(xargValue(argc, argv, "--lookups", "200000"));
+
+    VmmgrHypervStub::install(std::chrono::milliseconds(0), std::chrono::microseconds(0));
+    using Ptr = std::shared_ptr<unique_hcn_endpoint>;
+
+    struct LockedMap
+    {
+        Ptr find(const GUID& id) const
+        {
+            std::shared_lock lock(mutex);
+            auto it = map.find(id);
+            return it != map.end() ? it->second : nullptr;
+        }
+        void insert(const GUID& id, Ptr handle)
+        {
+            std::unique_lock lock(mutex);
+            map.insert_or_assign(id, std::move(handle));
+        }
+        bool erase(const GUID& id)
+        {
+            std::unique_lock lock(mutex);
+            return map.erase(id) != 0;
+        }
+        size_t size() const
+        {
+            std::shared_lock lock(mutex);
+            return map.size();
+        }
+
+        mutable std::shared_mutex mutex;
+        std::unordered_map<GUID, Ptr, GuidHash> map;
+    };
+
+    std::vector<GUID> ids(entries);
+    for (GUID& id : ids)
+        id = xguidRandom();
+    auto handle = [](size_t i) { return std::make_shared<unique_hcn_endpoint>(reinterpret_cast<HCN_ENDPOINT>(static_cast<uintptr_t>(i + 1))); };
+
+    HcnHandleRegistry<unique_hcn_endpoint> registry;
+    LockedMap locked;
+    std::vector<double> last(2, 0.0);
+
+    auto run = [&](auto& table, const char* name, size_t slot) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < entries; ++i)
+            table.insert(ids[i], handle(i));
+        double insertSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("{}: insertsPerSec {:.0f}, entries {}\n", name, entries / insertSeconds, table.size());
+
+        for (size_t threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            std::atomic<bool> stop{ false };
+            std::atomic<size_t> hits{ 0 }, churned{ 0 };
+            std::vector<std::vector<double>> samples(threads);
+            std::latch ready(static_cast<ptrdiff_t>(threads + 1));
+
+            std::thread writer([&] {
+                ready.arrive_and_wait();
+                for (size_t i = 0; !stop.load(std::memory_order_relaxed); i = (i + 1) % entries)
+                {
+                    table.erase(ids[i]);
+                    table.insert(ids[i], handle(i));
+                    churned++;
+                }
+            });
+
+            std::vector<std::thread> readers;
+            auto begin = std::chrono::steady_clock::now();
+            for (size_t t = 0; t < threads; ++t)
+            {
+                readers.emplace_back([&, t] {
+                    std::mt19937_64 rng(t + 1);
+                    size_t found = 0;
+                    samples[t].reserve(lookups / 64 + 1);
+                    ready.arrive_and_wait();
+                    for (size_t i = 0; i < lookups; ++i)
+                    {
+                        const GUID& id = ids[rng() % entries];
+                        if (i % 64 == 0)
+                        {
+                            auto t0 = std::chrono::steady_clock::now();
+                            found += table.find(id) != nullptr;
+                            samples[t].push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count());
+                        }
+                        else
+                        {
+                            found += table.find(id) != nullptr;
+                        }
+                    }
+                    hits += found;
+                });
+            }
+            for (std::thread& reader : readers)
+                reader.join();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            stop = true;
+            writer.join();
+
+            std::vector<double> all;
+            for (const std::vector<double>& s : samples)
+                all.insert(all.end(), s.begin(), s.end());
+            std::sort(all.begin(), all.end());
+            double rate = threads * lookups / seconds;
+            last[slot] = rate;
+            std::cout << std::format("{}: threads {:2}, lookupsPerSec {:.0f}, p50Ns {:.0f}, p99Ns {:.0f}, hitRate {:.4f}, churnPerSec {:.0f}\n",
+                name, threads, rate, all[all.size() / 2], all[all.size() * 99 / 100],
+                static_cast<double>(hits) / (threads * lookups), churned / seconds);
+        }
+    };
+
+    run(registry, "registry", 0);
+    run(locked, "sharedMutex", 1);
+
+    std::cout << std::format("speedup at {} threads: {:.2f}x\n", std::bit_floor(maxThreads), last[1] > 0 ? last[0] / last[1] : 0.0);
+
+    bool complete = registry.size() == entries;
+    std::vector<std::pair<GUID, Ptr>> drained = registry.drain();
+    complete = complete && drained.size() == entries && registry.size() == 0;
+    std::cout << std::format("drained {}, complete {}\n", drained.size(), complete);
+    return complete ? 0 : 1;
+}
+
+// Opens a network that exists and one that does not, and compares the error handling of each
+// call when the record is converted to UTF-8 right away, as every call site used to, with
+// keeping the raw record and decoding it only after a failure: heap allocations, bytes and
+// time per call, with the errors of the failing calls kept around as metrics would. Then
+// checks that a generic failure whose record names a transient cause is retried.
+int benchErrorRecord(int argc, char* argv[])
+{
+    size_t calls = std::stoul(xargValue(argc, argv, "--calls", "20000"));
+
+    VmmgrHypervStub::install(std::chrono::milliseconds(0), std::chrono::microseconds(0));
+    GUID present = xguidRandom();
+    GUID absent = xguidRandom();
+    {
+        unique_hcn_network network;
+        HcnErrorRecord errStr;
+        VmmgrHypervApi::HcnCreateNetwork(present, xstrUtf16(boost::json::value(boost::json::object{ { "Type", "NAT" } })).data(), network.put(), &errStr);
+    }
+
+    AllocProfile::mEnabled = true;
+    bool lazySuccessFree = false;
+    for (bool failing : { false, true })
+    {
+        for (bool lazy : { false, true })
+        {
+            const char* name = failing ? (lazy ? "errorLazyFailure" : "errorEagerFailure") : (lazy ? "errorLazySuccess" : "errorEagerSuccess");
+            const AllocPhaseStats& stats = AllocProfile::mPhases[AllocProfile::registerPhase(name)];
+            std::vector<std::string> eagerKept;
+            std::vector<HcnError> lazyKept;
+            eagerKept.reserve(calls);
+            lazyKept.reserve(calls);
+
+            std::chrono::steady_clock::duration spent{};
+            for (size_t i = 0; i < calls; ++i)
+            {
+                unique_hcn_network network;
+                HcnErrorRecord errStr;
+                HRESULT result = VmmgrHypervApi::HcnOpenNetwork(failing ? absent : present, network.put(), &errStr);
+
+                auto start = std::chrono::steady_clock::now();
+                {
+                    AllocPhase phase(name);
+                    if (!lazy)
+                    {
+                        std::string text = xstrUtf8(errStr.get());
+                        if (FAILED(result))
+                            eagerKept.push_back(std::move(text));
+                    }
+                    else if (FAILED(result))
+                    {
+                        lazyKept.push_back(errStr.decode(result));
+                    }
+                }
+                spent += std::chrono::steady_clock::now() - start;
+            }
+
+            double allocations = static_cast<double>(stats.allocations.load()) / calls;
+            std::cout << std::format("{}: allocsPerCall {:.2f}, bytesPerCall {:.1f}, nsPerCall {:.0f}, kept {}\n", name, allocations,
+                static_cast<double>(stats.bytes.load()) / calls, std::chrono::duration<double, std::nano>(spent).count() / calls,
+                eagerKept.size() + lazyKept.size());
+            if (!failing && lazy)
+                lazySuccessFree = stats.allocations.load() == 0;
+        }
+    }
+    AllocProfile::mEnabled = false;
+
+    HcnErrorRecord errStr;
+    unique_hcn_network network;
+    HRESULT result = VmmgrHypervApi::HcnOpenNetwork(absent, network.put(), &errStr);
+    std::cout << std::format("decoded: {}\n", errStr.describe(result));
+
+    size_t attempts = 0;
+    HRESULT retried = hcnInvoke(HcnCall::OpenNetwork, present, 0, errStr, [&] {
+        if (attempts++ == 0)
+        {
+            VmmgrHypervStub::fail(HRESULT_FROM_WIN32(RPC_S_SERVER_UNAVAILABLE), &errStr);
+            return E_FAIL;
+        }
+        return VmmgrHypervApi::HcnOpenNetwork(present, network.put(), &errStr);
+    });
+    std::cout << std::format("E_FAIL with record ErrorCode RPC_S_SERVER_UNAVAILABLE: attempts {}, result {}\n", attempts, retried);
+    printErrorRecordStats();
+    return lazySuccessFree && errStr.decode(result).code == HCN_E_NETWORK_NOT_FOUND && attempts == 2 && SUCCEEDED(retried) ? 0 : 1;
+}
+
+// Generates configs whose collections hold 10, 100, ... --max-entries entries, then ones nested
+// --depth levels deep and ones with long strings, and times each stage of a start on them:
+// loading the file, looking up every emulator and adapter by key, collecting boot artifacts
+// and provisioning every adapter's endpoint against the stub.
+int benchConfigScale(int argc, char* argv[])
+{
+    size_t maxEntries = std::stoul(xargValue(argc, argv, "--max-entries", "10000"));
+    uint64_t seed = std::stoull(xargValue(argc, argv, "--seed", "1"));
+    size_t workers = std::stoul(xargValue(argc, argv, "--workers", "4"));
+    boost::json::value base = xjsonReadFromFile(xargValue(argc, argv, "--config", "HypervVm.json"));
+    if (!base.is_object())
+        return 1;
+
+    VmmgrHypervStub::install(std::chrono::milliseconds(0), std::chrono::microseconds(0));
+    HcnAdmission::instance().setEnabled(false);
+    ConfigGenerator generator(std::move(base), seed);
+    std::filesystem::path file = std::filesystem::temp_directory_path() / std::format("hypervadmin-scale-{}.json", GetCurrentProcessId());
+
+    auto elapsedMs = [](auto&& fn) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    size_t index = 0;
+    bool ok = true;
+    auto measure = [&](const std::string& label, const ConfigGenerator::Shape& shape) {
+        std::string text = boost::json::serialize(generator.generate(shape, index++));
+        std::ofstream(file, std::ios::trunc | std::ios::binary) << text;
+
+        boost::json::value config;
+        double loadMs = elapsedMs([&] { config = xjsonReadFromFile(file); });
+        if (!config.is_object())
+        {
+            std::cout << std::format("{}: bytes {}, rejected by the loader\n", label, text.size());
+            return;
+        }
+
+        size_t lookups = 0, found = 0;
+        double lookupMs = elapsedMs([&] {
+            const boost::json::value& devices = config / "HcsSystem" / "VirtualMachine" / "Devices";
+            for (const auto& [id, emulator] : (devices / "FlexibleIov").as_object())
+            {
+                found += (devices / "FlexibleIov" / id / "EmulatorId").as_string() == id;
+                lookups++;
+            }
+            for (const auto& [name, adapter] : (devices / "NetworkAdapters").as_object())
+            {
+                found += (devices / "NetworkAdapters" / name / "EndpointId").is_string();
+                lookups++;
+            }
+        });
+
+
+        size_t artifacts = 0;
+        double artifactMs = elapsedMs([&] { artifacts = collectBootArtifacts(config).size(); });
+
+        HRESULT result = S_OK;
+        std::streambuf* out = std::cout.rdbuf(nullptr);
+        double provisionMs = elapsedMs([&] {
+            if (HcnGraph::applies(config))
+            {
+                HcnGraph graph(config);
+                graph.run(workers);
+                result = graph.result();
+            }
+            else
+            {
+                mAndroidJson = config;
+                configureHcnNetwork();
+                result = configureHcnEndpoint();
+            }
+        });
+        std::cout.rdbuf(out);
+
+        ok = ok && found == lookups && SUCCEEDED(result);
+        std::cout << std::format("{}: bytes {}, loadMs {:.2f}, lookups {}, lookupNs {:.0f}, artifacts {}, artifactMs {:.2f}, endpoints {}, provisionMs {:.1f}, result {}\n",
+            label, text.size(), loadMs, lookups, lookups ? lookupMs * 1e6 / lookups : 0.0, artifacts, artifactMs,
+            std::max<size_t>(shape.adapters, 1), provisionMs, result);
+    };
+
+    for (size_t entries = 10; entries <= maxEntries; entries *= 10)
+    {
+        ConfigGenerator::Shape shape;
+        shape.shares = shape.attachments = shape.emulators = shape.adapters = entries;
+        shape.networks = 1 + entries / 256;
+        measure(std::format("entries {:5}", entries), shape);
+    }
+    for (size_t depth : { 8, 16, 24, 64 })
+    {
+        ConfigGenerator::Shape shape;
+        shape.depth = depth;
+        measure(std::format("depth {:7}", depth), shape);
+    }
+    for (size_t stringBytes : { 1024, 65536, 1048576 })
+    {
+        ConfigGenerator::Shape shape;
+        shape.stringBytes = stringBytes;
+        measure(std::format("strings {:7}", stringBytes), shape);
+    }
+
+    std::filesystem::remove(file);
+    return ok ? 0 : 1;
+}
+
+// Starts many workers that all configure the same network GUID at once, with and without
+// singleflight coalescing, and compares the number of host calls each approach issues.
+int benchSingleFlight(int argc, char* argv[])
+{
+    size_t workers = std::stoul(xargValue(argc, argv, "--workers", "32"));
+    VmmgrHypervStub::install(std::chrono::milliseconds(20), std::chrono::microseconds(0));
+    HcnAdmission::instance().setEnabled(false);
+
+    for (bool coalesce : { false, true })
+    {
+        {
+            std::scoped_lock lock(VmmgrHypervStub::mMutex);
+            VmmgrHypervStub::mNetworks.clear();
+        }
+        VmmgrHypervStub::mCalls = 0;
+
+        GUID guid = xguidRandom();
+        boost::json::value settings = boost::json::object{ { "Type", "NAT" } };
+        HcnSingleFlight<HcnNetworkResult> flight;
+        std::atomic<size_t> failures{ 0 };
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < workers; ++w)
+        {
+            threads.emplace_back([&] {
+                HcnNetworkResult network = coalesce
+                    ? flight.run(xstrGuid(guid), [&] { return openOrCreateHcnNetwork(guid, settings); })
+                    : openOrCreateHcnNetwork(guid, settings);
+                if (FAILED(network.result))
+                    failures++;
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        auto stats = flight.stats();
+        std::cout << std::format("singleflight {}: workers {}, hostCalls {}, failures {}, collapsed {}, elapsedMs {:.1f}\n",
+            coalesce ? "on" : "off", workers, VmmgrHypervStub::mCalls.load(), failures.load(), stats.collapsed, ms);
+    }
+    return 0;
+}
+
+// Repeatedly changes the NAT InternalPort of an existing endpoint and reprovisions it, once
+// through the in-place HcnModifyEndpoint path and once through delete + recreate, and
+// compares host calls and latency per change.
+int benchEndpointModify(int argc, char* argv[])
+{
+    size_t rounds = std::stoul(xargValue(argc, argv, "--rounds", "50"));
+    VmmgrHypervStub::install(std::chrono::milliseconds(20), std::chrono::microseconds(0));
+    HcnAdmission::instance().setEnabled(false);
+
+    GUID guidNetwork = xguidRandom();
+    mAndroidJson = boost::json::object{
+        { "HcnNetwork", boost::json::object{ { "ID", xstrGuid(guidNetwork) }, { "Type", "NAT" } } },
+        { "HcnEndpoint", boost::json::object{ { "VirtualNetwork", xstrGuid(guidNetwork) }, { "Policies", boost::json::array{
+            boost::json::object{ { "Type", "NAT" }, { "Protocol", "TCP" }, { "InternalPort", 5555 } } } } } },
+        { "HcsSystem", boost::json::object{ { "VirtualMachine", boost::json::object{ { "Devices", boost::json::object{
+            { "NetworkAdapters", boost::json::object{ { "default", boost::json::object{ { "EndpointId", xstrGuid(xguidRandom()) } } } } } } } } } } }
+    };
+    configureHcnNetwork();
+    configureHcnEndpoint();
+
+    for (bool inPlace : { true, false })
+    {
+        auto savedModify = VmmgrHypervApi::HcnModifyEndpoint;
+        if (!inPlace)
+            VmmgrHypervApi::HcnModifyEndpoint = nullptr;
+
+        uint64_t calls = VmmgrHypervStub::mCalls;
+        std::vector<double> samples;
+        for (size_t i = 0; i < rounds; ++i)
+        {
+            auto& policy = (mAndroidJson / "HcnEndpoint" / "Policies" / 0).as_object();
+            policy.insert_or_assign("ExternalPort", static_cast<int64_t>(50000 + i));
+
+            auto start = std::chrono::steady_clock::now();
+            configureHcnEndpoint();
+            samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        VmmgrHypervApi::HcnModifyEndpoint = savedModify;
+        std::cout << std::format("endpoint {}: rounds {}, hostCallsPerChange {:.1f}, p50Ms {:.2f}, p99Ms {:.2f}\n",
+            inPlace ? "modify" : "recreate", rounds, static_cast<double>(VmmgrHypervStub::mCalls - calls) / rounds,
+            xpercentile(samples, 50), xpercentile(samples, 99));
+    }
+
+    // The service reports the endpoint with fields it filled in and a normalized network GUID;
+    // reprovisioning the unchanged config must not issue a modify.
+    {
+        std::string network = xstrGuid(guidNetwork);
+        std::ranges::transform(network, network.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+        std::scoped_lock lock(VmmgrHypervStub::mMutex);
+        for (auto& [id, endpoint] : VmmgrHypervStub::mEndpoints)
+        {
+            auto& object = endpoint.as_object();
+            object.insert_or_assign("State", 1);
+            object.insert_or_assign("VirtualNetwork", network);
+            for (auto& policy : object["Policies"].as_array())
+                policy.as_object().insert_or_assign("Settings", boost::json::object{ { "Flags", 0 } });
+        }
+    }
+
+    uint64_t modified = mHcnEndpointModifyStats.modified;
+    uint64_t recreated = mHcnEndpointModifyStats.recreated;
+    configureHcnEndpoint();
+    std::cout << std::format("endpoint hostFilled: modified {}, recreated {}\n",
+        mHcnEndpointModifyStats.modified - modified, mHcnEndpointModifyStats.recreated - recreated);
+
+    printEndpointModifyStats();
+    return 0;
+}
+
+// Answers "does this network exist?" for a fleet of instances, half of whose networks exist
+// on the host, once with one HcnOpenNetwork per instance and once from the inventory. Then
+// provisions an endpoint that appeared on the host after the snapshot was taken.
+int benchInventory(int argc, char* argv[])
+{
+    size_t instances = std::stoul(xargValue(argc, argv, "--instances", "1000"));
+    VmmgrHypervStub::install(std::chrono::milliseconds(2), std::chrono::microseconds(0));
+    HcnAdmission::instance().setEnabled(false);
+
+    std::vector<GUID> networks(instances);
+    {
+        std::scoped_lock lock(VmmgrHypervStub::mMutex);
+        for (size_t i = 0; i < instances; ++i)
+        {
+            networks[i] = xguidRandom();
+            if (i % 2 == 0)
+                VmmgrHypervStub::mNetworks.emplace(xstrGuid(networks[i]), boost::json::object{});
+        }
+    }
+
+    for (bool cached : { false, true })
+    {
+        mHcnInventory = cached ? std::make_unique<HcnInventory>(std::chrono::seconds(30)) : nullptr;
+        uint64_t calls = VmmgrHypervStub::mCalls;
+        size_t present = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        for (const GUID& guid : networks)
+        {
+            if (cached)
+            {
+                present += mHcnInventory->network(guid) == HcnInventory::Presence::Present;
+            }
+            else
+            {
+                unique_hcn_network network;
+                HcnErrorRecord errStr;
+                present += SUCCEEDED(VmmgrHypervApi::HcnOpenNetwork(guid, network.put(), &errStr));
+            }
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("inventory {}: instances {}, present {}, hostCalls {}, elapsedMs {:.1f}\n",
+            cached ? "on" : "off", instances, present, VmmgrHypervStub::mCalls - calls, ms);
+    }
+
+    GUID stale = xguidRandom();
+    mHcnInventory->endpoint(stale);
+    {
+        std::scoped_lock lock(VmmgrHypervStub::mMutex);
+        VmmgrHypervStub::mEndpoints.emplace(xstrGuid(stale), boost::json::object{});
+    }
+    uint64_t calls = VmmgrHypervStub::mCalls;
+    unique_hcn_endpoint endpoint;
+    auto* buffer = std::cout.rdbuf(nullptr);
+    HRESULT result = provisionHcnEndpoint(stale, boost::json::object{}, nullptr, endpoint);
+    std::cout.rdbuf(buffer);
+    std::cout << std::format("stale snapshot: endpoint created outside it, provision result {}, hostCalls {}\n",
+        result, VmmgrHypervStub::mCalls - calls);
+
+    printInventoryStats();
+    mHcnInventory.reset();
+    return 0;
+}
+
+// Replays a recorded trace open-loop, one recorded run at a time: every call is issued at its
+// recorded offset from the first call of its run (divided by --speed) by one of --workers
+// threads, and goes through hcnInvoke to a stub that holds it for the recorded duration and
+// returns the recorded result. The next run starts when the previous one has drained, so the
+// time between runs is not replayed. Admission control stays enabled, so its effect on a real
+// workload can be evaluated offline.
+int replayTrace(int argc, char* argv[])
+{
+    std::filesystem::path path = xargValue(argc, argv, "--replay", "hcn.trace");
+    size_t workers = std::stoul(xargValue(argc, argv, "--workers", "8"));
+    double speed = std::stod(xargValue(argc, argv, "--speed", "1"));
+
+    std::vector<HcnTraceRecord> records = HcnTrace::read(path);
+    if (records.empty())
+    {
+        std::cout << std::format("replay: no records in {}\n", path.string());
+        return 1;
+    }
+
+    VmmgrHypervStub::install(std::chrono::microseconds(0), std::chrono::microseconds(0));
+    HcnRetry::instance().setEnabled(false);
+
+    std::vector<double> latency(records.size());
+    std::atomic<size_t> mismatches{ 0 };
+    uint64_t recordedNs = 0;
+    size_t runs = 0;
+    auto replayBegin = std::chrono::steady_clock::now();
+
+    // Records are in sequence order, so each run is a contiguous range.
+    for (size_t first = 0, last = 0; first < records.size(); first = last)
+    {
+        while (last < records.size() && records[last].run == records[first].run)
+            last++;
+        runs++;
+
+        uint64_t origin = UINT64_MAX;
+        uint64_t recordedEnd = 0;
+        for (size_t i = first; i < last; ++i)
+        {
+            origin = std::min(origin, records[i].startNs);
+            recordedEnd = std::max(recordedEnd, records[i].startNs + records[i].durationNs);
+        }
+        recordedNs += recordedEnd - origin;
+
+        std::atomic<size_t> next{ first };
+        auto begin = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < workers; ++t)
+        {
+            threads.emplace_back([&] {
+                for (size_t i = next++; i < last; i = next++)
+                {
+                    const HcnTraceRecord& record = records[i];
+                    auto scheduled = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::nanoseconds(record.startNs - origin) / speed);
+                    std::this_thread::sleep_until(scheduled);
+
+                    HRESULT result = hcnInvoke(static_cast<HcnCall>(record.call), record.id, record.settingsHash, [&] {
+                        return VmmgrHypervStub::replay(std::chrono::nanoseconds(record.durationNs), record.result);
+                    });
+                    mismatches += result != record.result;
+                    latency[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scheduled).count();
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    double replayMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - replayBegin).count();
+    std::cout << std::format("replay: records {}, runs {}, workers {}, speed {}, recordedMs {:.1f}, replayMs {:.1f}, resultMismatches {}\n",
+        records.size(), runs, workers, speed, recordedNs / 1e6, replayMs, mismatches.load());
+
+    for (size_t c = 0; c < static_cast<size_t>(HcnCall::Count); ++c)
+    {
+        std::vector<double> recorded, replayed;
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            if (records[i].call != c)
+                continue;
+            recorded.push_back(records[i].durationNs / 1e6);
+            replayed.push_back(latency[i]);
+        }
+        if (recorded.empty())
+            continue;
+
+        std::cout << std::format("  {:<28} calls {:>6}, recorded p50Ms {:.3f} p99Ms {:.3f}, replay p50Ms {:.3f} p99Ms {:.3f}\n",
+            hcnCallName(static_cast<HcnCall>(c)), recorded.size(), xpercentile(recorded, 50), xpercentile(recorded, 99),
+            xpercentile(replayed, 50), xpercentile(replayed, 99));
+    }
+
+    printAdmissionStats();
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Provisions endpoints for many instances from concurrent workers while journaling, with a
+// share of them "crashing" after the host call but before the completion record, then times
+// startup recovery of the resulting journal. Runs once with a flush per record and once with
+// group commit.
+int benchJournal(int argc, char* argv[])
+{
+    size_t instances = std::stoul(xargValue(argc, argv, "--instances", "2000"));
+    size_t workers = std::stoul(xargValue(argc, argv, "--workers", "16"));
+    double crashPct = std::stod(xargValue(argc, argv, "--crash-pct", "10"));
+
+    VmmgrHypervStub::install(std::chrono::microseconds(250), std::chrono::microseconds(0));
+    HcnAdmission::instance().setEnabled(false);
+    std::filesystem::path path = xargValue(argc, argv, "--journal", (std::filesystem::temp_directory_path() / "hcn-bench.journal").string());
+
+    for (bool groupCommit : { false, true })
+    {
+        std::vector<GUID> ids(instances);
+        std::vector<bool> crashed(instances);
+        std::mt19937 rng(1);
+        std::bernoulli_distribution crash(crashPct / 100);
+        for (size_t i = 0; i < instances; ++i)
+        {
+            ids[i] = xguidRandom();
+            crashed[i] = crash(rng);
+        }
+
+        mHcnJournal = std::make_unique<HcnJournal>(path, groupCommit);
+        std::atomic<size_t> next{ 0 };
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < workers; ++t)
+        {
+            threads.emplace_back([&] {
+                for (size_t i = next++; i < instances; i = next++)
+                {
+                    unique_hcn_endpoint endpoint;
+                    HcnErrorRecord errStr;
+                    if (crashed[i])
+                    {
+                        mHcnJournal->begin(HcnCall::CreateEndpoint, ids[i], 0);
+                        VmmgrHypervApi::HcnCreateEndpoint(nullptr, ids[i], L"{}", endpoint.put(), &errStr);
+                        continue;
+                    }
+
+                    hcnInvoke(HcnCall::CreateEndpoint, ids[i], 0, errStr, [&] {
+                        return VmmgrHypervApi::HcnCreateEndpoint(nullptr, ids[i], L"{}", endpoint.put(), &errStr);
+                    });
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        auto stats = mHcnJournal->stats();
+        mHcnJournal.reset();
+
+        size_t before = VmmgrHypervStub::mEndpoints.size();
+        HcnJournalRecovery recovery = recoverHcnJournal(path, workers);
+        size_t after = VmmgrHypervStub::mEndpoints.size();
+
+        std::cout << std::format("journal {}: instances {}, opsPerSec {:.0f}, flushes {}, maxBatch {}\n",
+            groupCommit ? "group commit" : "flush per record", instances, instances / seconds, stats.flushes, stats.maxBatch);
+        std::cout << std::format("  recovery: inFlight {}, rolledBack {}, endpoints {} -> {}, scanMs {:.2f}, resolveMs {:.2f}\n",
+            recovery.inFlight, recovery.rolledBack, before, after, recovery.scanMs, recovery.resolveMs);
+
+        std::scoped_lock lock(VmmgrHypervStub::mMutex);
+        VmmgrHypervStub::mEndpoints.clear();
+    }
+
+    std::filesystem::remove(path);
+    return 0;
+}
+
+// Builds a config with several networks and adapters, spreading the adapters' endpoints over
+// the networks, and provisions it through the dependency graph with one worker and with
+// --workers workers.
+int benchGraph(int argc, char* argv[])
+{
+    size_t networkCount = std::stoul(xargValue(argc, argv, "--networks", "4"));
+    size_t adapterCount = std::stoul(xargValue(argc, argv, "--adapters", "16"));
+    size_t workers = std::stoul(xargValue(argc, argv, "--workers", "8"));
+
+    VmmgrHypervStub::install(std::chrono::milliseconds(5), std::chrono::microseconds(0));
+    HcnAdmission::instance().setEnabled(false);
+
+    for (size_t poolSize : { size_t(1), workers })
+    {
+        boost::json::array networks;
+        boost::json::array endpoints;
+        boost::json::object adapters;
+        for (size_t i = 0; i < networkCount; ++i)
+            networks.push_back(boost::json::object{ { "ID", xstrGuid(xguidRandom()) }, { "Type", "NAT" } });
+        for (size_t i = 0; i < adapterCount; ++i)
+        {
+            std::string id = xstrGuid(xguidRandom());
+            endpoints.push_back(boost::json::object{ { "ID", id }, { "VirtualNetwork", networks[i % networkCount] / "ID" } });
+            adapters.insert_or_assign(std::format("adapter{}", i), boost::json::object{ { "EndpointId", id } });
+        }
+
+        boost::json::value config = boost::json::object{
+            { "HcnNetwork", std::move(networks) },
+            { "HcnEndpoint", std::move(endpoints) },
+            { "HcsSystem", boost::json::object{ { "VirtualMachine", boost::json::object{ { "Devices", boost::json::object{
+                { "NetworkAdapters", std::move(adapters) } } } } } } }
+        };
+
+        std::streambuf* out = std::cout.rdbuf(nullptr);
+        HcnGraph graph(config);
+        graph.run(poolSize);
+        std::cout.rdbuf(out);
+        graph.print(false);
+    }
+    return 0;
+}
+
+// Writes --files temporary files of --size-mb each, the first one standing in for the
+// read-only boot disk, and warms them with one worker and with --workers workers.
+int benchPrefetch(int argc, char* argv[])
+{
+    size_t files = std::stoul(xargValue(argc, argv, "--files", "4"));
+    uint64_t size = std::stoull(xargValue(argc, argv, "--size-mb", "256")) << 20;
+    size_t workers = std::stoul(xargValue(argc, argv, "--workers", "4"));
+
+    std::vector<BootArtifact> artifacts;
+    std::vector<char> block(1 << 20, 'x');
+    for (size_t i = 0; i < files; ++i)
+    {
+        std::filesystem::path path = std::filesystem::temp_directory_path() / std::format("hcn-bench-prefetch{}.vhdx", i);
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        for (uint64_t written = 0; written < size; written += block.size())
+            ofs.write(block.data(), static_cast<std::streamsize>(block.size()));
+        artifacts.push_back(BootArtifact{ std::format("bench/{}", i), path, i == 0 });
+    }
+
+    for (size_t poolSize : { size_t(1), workers })
+    {
+        BootPrefetcher prefetcher(artifacts, BootPrefetcher::Options{ poolSize, 0 });
+        auto stats = prefetcher.wait();
+        std::cout << std::format("prefetch workers {}: bytesWarmed {}, validateMs {:.2f}, warmMs {:.1f}, GBps {:.2f}\n",
+            poolSize, stats.bytesWarmed, stats.validateMs, stats.warmMs, stats.bytesWarmed / (stats.warmMs / 1e3) / 1e9);
+    }
+
+    for (const BootArtifact& artifact : artifacts)
+        std::filesystem::remove(artifact.path);
+    return 0;
+}
+
+// Hashes a temporary file serially with xhash64 and in parallel chunks with xhash64Wide,
+// then times a cached re-check and checks that a one-byte change is reported as altered.
+int benchDiskHash(int argc, char* argv[])
+{
+    uint64_t size = std::stoull(xargValue(argc, argv, "--size-mb", "1024")) << 20;
+    size_t workers = std::stoul(xargValue(argc, argv, "--workers", "4"));
+
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "hcn-bench-disk.vhdx";
+    std::filesystem::path cachePath = std::filesystem::temp_directory_path() / "hcn-bench-disk-integrity.json";
+    std::filesystem::remove(cachePath);
+    {
+        std::mt19937_64 rng(1);
+        std::vector<uint64_t> block((1 << 20) / sizeof(uint64_t));
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        for (uint64_t written = 0; written < size; written += block.size() * sizeof(uint64_t))
+        {
+            std::generate(block.begin(), block.end(), rng);
+            ofs.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(block.size() * sizeof(uint64_t)));
+        }
+    }
+
+    {
+        std::vector<uint8_t> contents(static_cast<size_t>(size));
+        std::ifstream(path, std::ios::binary).read(reinterpret_cast<char*>(contents.data()), static_cast<std::streamsize>(size));
+        auto start = std::chrono::steady_clock::now();
+        uint64_t digest = xhash64(contents.data(), contents.size());
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("xhash64 in memory, serial: digest {:016x}, GBps {:.2f}\n", digest, size / seconds / 1e9);
+
+        start = std::chrono::steady_clock::now();
+        digest = xhash64Wide(contents.data(), contents.size());
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("xhash64Wide in memory, serial: digest {:016x}, GBps {:.2f}\n", digest, size / seconds / 1e9);
+    }
+
+    for (size_t poolSize : { size_t(1), workers })
+    {
+        DiskIntegrity integrity(cachePath, DiskIntegrity::Options{ poolSize });
+        auto start = std::chrono::steady_clock::now();
+        auto digest = integrity.hash(path, size);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!digest)
+        {
+            std::cout << std::format("file, {} workers: read failed\n", poolSize);
+            return 1;
+        }
+        std::cout << std::format("file, {} workers: digest {:016x}, GBps {:.2f}\n", poolSize, *digest, size / seconds / 1e9);
+    }
+
+    DiskIntegrity integrity(cachePath, DiskIntegrity::Options{ workers });
+    auto first = integrity.verify(path);
+    auto again = integrity.verify(path);
+    {
+        std::fstream fs(path, std::ios::binary | std::ios::in | std::ios::out);
+        fs.seekp(static_cast<std::streamoff>(size / 2));
+        fs.put('\x5a');
+    }
+    auto changed = integrity.verify(path);
+
+    std::cout << std::format("verify: first {} ({:.1f} ms), again {} ({:.3f} ms), after one-byte change {} ({:.1f} ms)\n",
+        DiskIntegrity::verdictName(first.verdict), first.ms, DiskIntegrity::verdictName(again.verdict), again.ms,
+        DiskIntegrity::verdictName(changed.verdict), changed.ms);
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(cachePath);
+    return changed.verdict == DiskIntegrity::Verdict::Altered ? 0 : 1;
+}
+
+// Applies a patch and its inverse to the config --iterations times, precompiled and compiled
+// per application, and compares with re-reading the config file, which is how changes were
+// picked up before. Also checks that a patch whose last test fails leaves the config intact.
+int benchJsonPatch(int argc, char* argv[])
+{
+    size_t iterations = std::stoul(xargValue(argc, argv, "--iterations", "10000"));
+    std::string path = xargValue(argc, argv, "--config", "HypervVm.json");
+    boost::json::value document = xjsonReadFromFile(path);
+
+    std::string owner = (document / "HcsSystem" / "Owner").as_string().c_str();
+    size_t policies = (document / "HcnEndpoint" / "Policies").as_array().size();
+    boost::json::value forward = boost::json::parse(std::format(R"([
+        {{ "op": "test", "path": "/HcnNetwork/Type", "value": "NAT" }},
+        {{ "op": "replace", "path": "/HcsSystem/Owner", "value": "patched" }},
+        {{ "op": "add", "path": "/HcnEndpoint/Policies/-", "value": {{ "Type": "NAT", "Protocol": "TCP", "InternalPort": 8080, "ExternalPort": 18080 }} }},
+        {{ "op": "copy", "from": "/HcnNetwork/Name", "path": "/HcnEndpoint/Name" }},
+        {{ "op": "move", "from": "/HcnEndpoint/Name", "path": "/HcnEndpoint/Label" }}
+    ])"));
+    boost::json::value inverse = boost::json::parse(std::format(R"([
+        {{ "op": "test", "path": "/HcnEndpoint/Policies/{}/InternalPort", "value": 8080 }},
+        {{ "op": "remove", "path": "/HcnEndpoint/Policies/{}" }},
+        {{ "op": "remove", "path": "/HcnEndpoint/Label" }},
+        {{ "op": "replace", "path": "/HcsSystem/Owner", "value": "{}" }}
+    ])", policies, policies, owner));
+    size_t operations = iterations * (forward.as_array().size() + inverse.as_array().size());
+    uint64_t original = JsonHash::digest(document);
+
+    auto report = [&](const char* name, auto&& fn) {
+        auto start = std::chrono::steady_clock::now();
+        bool ok = true;
+        for (size_t i = 0; i < iterations; ++i)
+            ok &= fn();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("{:<22} ok {}, opsPerSec {:.0f}, usPerUpdate {:.2f}\n", name, ok && JsonHash::digest(document) == original,
+            operations / seconds, seconds * 1e6 / (iterations * 2));
+    };
+
+    JsonPatch compiledForward = JsonPatch::compile(forward);
+    JsonPatch compiledInverse = JsonPatch::compile(inverse);
+    report("precompiled", [&] { return compiledForward.apply(document).ok && compiledInverse.apply(document).ok; });
+    report("compiled per apply", [&] { return JsonPatch::compile(forward).apply(document).ok && JsonPatch::compile(inverse).apply(document).ok; });
+    report("re-read config", [&] { document = xjsonReadFromFile(path); document = xjsonReadFromFile(path); return true; });
+
+    boost::json::value failing = forward;
+    failing.as_array().push_back(boost::json::parse(R"({ "op": "test", "path": "/HcnNetwork/Type", "value": "ICS" })"));
+    JsonPatch::Result rejected = JsonPatch::compile(failing).apply(document);
+    JsonPatch::Result touched = compiledForward.apply(document);
+    compiledInverse.apply(document);
+
+    std::cout << std::format("failing patch: ok {}, failedOperation {}, rolledBack {}; touched by forward patch: {}\n",
+        rejected.ok, rejected.failedOperation, JsonHash::digest(document) == original, JsonPatch::sectionNames(touched.touched));
+    return !rejected.ok && JsonHash::digest(document) == original ? 0 : 1;
+}
+
+// Derives network and endpoint IDs for --instances names one at a time and with the batch
+// API, checks that both agree and are unique, and checks the RFC 4122 reference vector.
+int benchNameGuid(int argc, char* argv[])
+{
+    size_t instances = std::stoul(xargValue(argc, argv, "--instances", "100000"));
+    std::vector<std::string> names;
+    names.reserve(instances * 2);
+    for (size_t i = 0; i < instances; ++i)
+    {
+        names.push_back(std::format("instance{}/HcnNetwork", i));
+        names.push_back(std::format("instance{}/HcnEndpoint", i));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<GUID> scalar;
+    scalar.reserve(names.size());
+    for (const std::string& name : names)
+        scalar.push_back(NameGuid::derive(NameGuid::kNamespace, name));
+    double scalarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    std::vector<GUID> batch = NameGuid::derive(NameGuid::kNamespace, names);
+    double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool match = std::equal(scalar.begin(), scalar.end(), batch.begin());
+    std::unordered_set<GUID, GuidHash> unique(batch.begin(), batch.end());
+
+    GUID dns;
+    UuidFromStringA((RPC_CSTR)"6BA7B810-9DAD-11D1-80B4-00C04FD430C8", &dns);
+    std::string reference = xstrGuid(NameGuid::derive(dns, "python.org"));
+
+    std::cout << std::format("scalar: idsPerSec {:.0f}\n", names.size() / scalarSeconds);
+    std::cout << std::format("batch:  idsPerSec {:.0f}, speedup {:.2f}x\n", names.size() / batchSeconds, scalarSeconds / batchSeconds);
+    std::cout << std::format("match {}, unique {}/{}, uuid5(dns, python.org) {}\n", match, unique.size(), names.size(), reference);
+    return match && unique.size() == names.size() && reference == "886313E1-3B8A-5372-9B90-0C9AEE199E5D" ? 0 : 1;
+}
+
+// Simulates a sequence of VM starts, each separated by a short idle gap, with and without a
+// warm endpoint pool, and compares the latency of the endpoint step of each start.
+int benchEndpointPool(int argc, char* argv[])
+{
+    size_t starts = std::stoul(xargValue(argc, argv, "--starts", "50"));
+    size_t poolSize = std::stoul(xargValue(argc, argv, "--pool", "4"));
+    std::chrono::milliseconds gap{ std::stoll(xargValue(argc, argv, "--gap-ms", "100")) };
+
+    VmmgrHypervStub::install(std::chrono::milliseconds(20), std::chrono::microseconds(0));
+    HcnAdmission::instance().setEnabled(false);
+
+    GUID guidNetwork = xguidRandom();
+    mAndroidJson = boost::json::object{
+        { "HcnNetwork", boost::json::object{ { "ID", xstrGuid(guidNetwork) }, { "Type", "NAT" } } },
+        { "HcnEndpoint", boost::json::object{ { "VirtualNetwork", xstrGuid(guidNetwork) } } },
+        { "HcsSystem", boost::json::object{ { "VirtualMachine", boost::json::object{ { "Devices", boost::json::object{
+            { "NetworkAdapters", boost::json::object{ { "default", boost::json::object{ { "EndpointId", xstrGuid(xguidRandom()) } } } } } } } } } } }
+    };
+    std::shared_ptr<unique_hcn_network> network = configureHcnNetwork();
+
+    for (bool pooled : { false, true })
+    {
+        if (pooled)
+        {
+            mHcnEndpointPool = std::make_unique<HcnEndpointPool>(network, mAndroidJson / "HcnEndpoint", poolSize);
+            std::this_thread::sleep_for(gap * static_cast<int64_t>(poolSize));
+        }
+
+        std::vector<double> samples;
+        for (size_t i = 0; i < starts; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            configureHcnEndpoint();
+            samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            std::this_thread::sleep_for(gap);
+        }
+
+        std::cout << std::format("endpoint pool {}: starts {}, p50Ms {:.3f}, p99Ms {:.3f}\n",
+            pooled ? "on" : "off", starts, xpercentile(samples, 50), xpercentile(samples, 99));
+    }
+
+    printEndpointPoolStats();
+    mHcnEndpointPool.reset();
+    return 0;
+}
+
+// Builds a large document from copies of the given config and compares canonical hashing
+// against the xstrUtf8 serialization the tool otherwise relies on, then checks that a copy
+// with every object's keys reversed yields identical digests.
+int benchJsonHash(int argc, char* argv[])
+{
+    size_t copies = std::stoul(xargValue(argc, argv, "--copies", "1000"));
+    size_t iterations = std::stoul(xargValue(argc, argv, "--iterations", "20"));
+    boost::json::value base = xjsonReadFromFile(xargValue(argc, argv, "--config", "HypervVm.json"));
+
+    boost::json::object large;
+    for (size_t i = 0; i < copies; ++i)
+        large.insert_or_assign(std::format("instance{}", i), base);
+    boost::json::value jv = std::move(large);
+
+    auto reversed = [](auto& self, const boost::json::value& v) -> boost::json::value {
+        if (v.is_object())
+        {
+            boost::json::object out;
+            const boost::json::object& in = v.get_object();
+            for (auto it = in.end(); it != in.begin();)
+            {
+                --it;
+                out.insert_or_assign(it->key(), self(self, it->value()));
+            }
+            return out;
+        }
+        if (v.is_array())
+        {
+            boost::json::array out;
+            for (const auto& element : v.get_array())
+                out.push_back(self(self, element));
+            return out;
+        }
+        return v;
+    };
+    boost::json::value shuffled = reversed(reversed, jv);
+
+    size_t bytes = xstrUtf8(jv).size();
+    auto time = [&](auto&& fn) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+            fn();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+    };
+
+    uint64_t sink = 0;
+    double serializeSeconds = time([&] { sink += std::hash<std::string>{}(xstrUtf8(jv)); });
+    double hashSeconds = time([&] { sink += JsonHash::digest(jv); });
+
+    JsonHash hash;
+    double subtreeSeconds = time([&] { sink += hash.digests(jv, 3).size(); });
+    std::vector<JsonHash::Digest> original = hash.digests(jv, 3);
+    std::vector<JsonHash::Digest> other = hash.digests(shuffled, 3);
+    auto byPointer = [](const auto& a, const auto& b) { return a.pointer < b.pointer; };
+    std::sort(original.begin(), original.end(), byPointer);
+    std::sort(other.begin(), other.end(), byPointer);
+    bool stable = std::equal(original.begin(), original.end(), other.begin(), other.end(),
+        [](const auto& a, const auto& b) { return a.pointer == b.pointer && a.digest == b.digest; });
+
+    std::cout << std::format("json hash: copies {}, bytes {}, subtrees {}, orderIndependent {}, sink {:x}\n", copies, bytes, original.size(), stable, sink);
+    std::cout << std::format("xstrUtf8 + std::hash: {:.2f} ms ({:.1f} MB/s)\n", serializeSeconds * 1e3, bytes / serializeSeconds / 1e6);
+    std::cout << std::format("JsonHash::digest:     {:.2f} ms ({:.1f} MB/s)\n", hashSeconds * 1e3, bytes / hashSeconds / 1e6);
+    std::cout << std::format("JsonHash::digests(3): {:.2f} ms ({:.1f} MB/s)\n", subtreeSeconds * 1e3, bytes / subtreeSeconds / 1e6);
+    return stable ? 0 : 1;
+}
+
+#pragma endregion
+
+int main(int argc, char* argv[])
+{
+    if (xargFlag(argc, argv, "--bench-admission"))
+        return benchAdmission(argc, argv);
+    if (xargFlag(argc, argv, "--bench-singleflight"))
+        return benchSingleFlight(argc, argv);
+    if (xargFlag(argc, argv, "--bench-endpoint-pool"))
+        return benchEndpointPool(argc, argv);
+    if (xargFlag(argc, argv, "--bench-json-hash"))
+        return benchJsonHash(argc, argv);
+    if (xargFlag(argc, argv, "--bench-endpoint-modify"))
+        return benchEndpointModify(argc, argv);
+    if (xargFlag(argc, argv, "--bench-inventory"))
+        return benchInventory(argc, argv);
+    if (xargFlag(argc, argv, "--bench-journal"))
+        return benchJournal(argc, argv);
+    if (xargFlag(argc, argv, "--bench-graph"))
+        return benchGraph(argc, argv);
+    if (xargFlag(argc, argv, "--bench-prefetch"))
+        return benchPrefetch(argc, argv);
+    if (xargFlag(argc, argv, "--bench-disk-hash"))
+        return benchDiskHash(argc, argv);
+    if (xargFlag(argc, argv, "--bench-json-patch"))
+        return benchJsonPatch(argc, argv);
+    if (xargFlag(argc, argv, "--bench-name-guid"))
+        return benchNameGuid(argc, argv);
+    if (xargFlag(argc, argv, "--bench-priority"))
+        return benchPriority(argc, argv);
+    if (xargFlag(argc, argv, "--bench-deadline"))
+        return benchDeadline(argc, argv);
+    if (xargFlag(argc, argv, "--bench-retry"))
+        return benchRetry(argc, argv);
+    if (xargFlag(argc, argv, "--bench-teardown"))
+        return benchTeardown(argc, argv);
+    if (xargFlag(argc, argv, "--bench-health"))
+        return benchHealth(argc, argv);
+    if (xargFlag(argc, argv, "--bench-fleet"))
+        return benchFleet(argc, argv);
+    if (xargFlag(argc, argv, "--bench-handle-registry"))
+        return benchHandleRegistry(argc, argv);
+    if (xargFlag(argc, argv, "--bench-error-record"))
+        return benchErrorRecord(argc, argv);
+    if (xargFlag(argc, argv, "--bench-config-scale"))
+        return benchConfigScale(argc, argv);
+    if (xargFlag(argc, argv, "--replay"))
+        return replayTrace(argc, argv);
+
+    if (xargFlag(argc, argv, "--stub"))
+        VmmgrHypervStub::install(std::chrono::milliseconds(20), std::chrono::milliseconds(2));
+    return runHypervAdmin(argc, argv);
+}
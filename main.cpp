@@ -2,17 +2,290 @@
 #include <format>
 #include <filesystem>
 #include <fstream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <future>
+#include <memory>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <optional>
+#include <deque>
+#include <array>
+#include <list>
+#include <new>
+#include <cstring>
+#include <malloc.h>
+#include <cmath>
+#include <bit>
+#include <functional>
+#include <latch>
 
 #include <boost/json.hpp>
 
 #include <Windows.h>
+#include <intrin.h>
 #include <wil/resource.h>
 #include <ComputeNetwork.h>
 
+#pragma region AllocProfile
+
+// Heap allocation profiler enabled with --alloc-profile in builds configured with
+// HCN_ALLOC_PROFILE. Such builds replace the global operator new/delete below to report
+// every block to AllocProfile, which attributes it to the phase marked by the innermost
+// AllocPhase scope on the calling thread. Every block then carries a 16-byte AllocHeader
+// naming that phase, so a free is charged to the phase that allocated it, from whichever
+// thread, and blocks allocated while profiling was off are never counted; that header and
+// a relaxed atomic load per allocation are paid whether or not --alloc-profile is given.
+// Other builds keep the CRT allocator and only the AllocPhase scopes remain.
+struct AllocPhaseStats
+{
+    std::atomic<const char*> name{ nullptr };
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+    std::atomic<uint64_t> frees{ 0 };
+    std::atomic<int64_t> live{ 0 };
+    std::atomic<int64_t> peakLive{ 0 };
+};
+
+struct alignas(16) AllocHeader
+{
+    static constexpr uint32_t kUntagged = UINT32_MAX;
+
+    uint32_t phase;
+    size_t bytes;
+};
+
+struct AllocProfile
+{
+    static constexpr size_t kMaxPhases = 64;
+#ifdef HCN_ALLOC_PROFILE
+    static constexpr bool kCompiled = true;
+#else
+    static constexpr bool kCompiled = false;
+#endif
+
+    static inline std::atomic<bool> mEnabled{ false };
+    static inline std::atomic<int64_t> mLive{ 0 };
+    static inline AllocPhaseStats mPhases[kMaxPhases];
+    static inline std::atomic<size_t> mPhaseCount{ 1 };
+    static inline std::mutex mRegisterMutex;
+    static inline thread_local size_t mCurrent = 0;
+
+    static size_t registerPhase(const char* name);
+    static void onAllocate(AllocHeader& header, size_t bytes);
+    static void onFree(const AllocHeader& header);
+    static void print();
+};
+
+// Attributes allocations made on this thread to the named phase until the scope ends.
+class AllocPhase
+{
+public:
+    explicit AllocPhase(const char* name) : mPrevious(AllocProfile::mCurrent)
+    {
+        if (AllocProfile::mEnabled.load(std::memory_order_relaxed))
+            AllocProfile::mCurrent = AllocProfile::registerPhase(name);
+    }
+
+    // Carries a phase captured on another thread, for work handed off to a worker.
+    explicit AllocPhase(size_t phase) : mPrevious(AllocProfile::mCurrent) { AllocProfile::mCurrent = phase; }
+
+    ~AllocPhase() { AllocProfile::mCurrent = mPrevious; }
+
+    AllocPhase(const AllocPhase&) = delete;
+    AllocPhase& operator=(const AllocPhase&) = delete;
+
+private:
+    size_t mPrevious;
+};
+
+size_t AllocProfile::registerPhase(const char* name)
+{
+    auto find = [name](size_t count) -> size_t {
+        for (size_t i = 1; i < count; ++i)
+        {
+            const char* phaseName = mPhases[i].name.load(std::memory_order_relaxed);
+            if (phaseName == name || strcmp(phaseName, name) == 0)
+                return i;
+        }
+        return 0;
+    };
+
+    if (size_t index = find(mPhaseCount.load(std::memory_order_acquire)))
+        return index;
+
+    std::scoped_lock lock(mRegisterMutex);
+    size_t count = mPhaseCount.load(std::memory_order_relaxed);
+    if (size_t index = find(count))
+        return index;
+    if (count == kMaxPhases)
+        return 0;
+
+    mPhases[count].name = name;
+    mPhaseCount.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+// Tags the block with the current phase. The phase peak is the high-water mark of its own live
+// bytes, not of the whole heap.
+void AllocProfile::onAllocate(AllocHeader& header, size_t bytes)
+{
+    header.phase = static_cast<uint32_t>(mCurrent);
+    header.bytes = bytes;
+
+    AllocPhaseStats& phase = mPhases[mCurrent];
+    phase.allocations.fetch_add(1, std::memory_order_relaxed);
+    phase.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    mLive.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+
+    int64_t live = phase.live.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) + static_cast<int64_t>(bytes);
+    int64_t peak = phase.peakLive.load(std::memory_order_relaxed);
+    while (live > peak && !phase.peakLive.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+}
+
+void AllocProfile::onFree(const AllocHeader& header)
+{
+    if (header.phase == AllocHeader::kUntagged)
+        return;
+
+    AllocPhaseStats& phase = mPhases[header.phase];
+    phase.frees.fetch_add(1, std::memory_order_relaxed);
+    phase.live.fetch_sub(static_cast<int64_t>(header.bytes), std::memory_order_relaxed);
+    mLive.fetch_sub(static_cast<int64_t>(header.bytes), std::memory_order_relaxed);
+}
+
+void AllocProfile::print()
+{
+    mEnabled = false;
+
+    std::cout << std::format("{:<24} {:>12} {:>14} {:>12} {:>14}\n", "phase", "allocations", "bytes", "frees", "peakLiveBytes");
+    for (size_t i = 0; i < mPhaseCount.load(); ++i)
+    {
+        const AllocPhaseStats& phase = mPhases[i];
+        const char* name = phase.name.load();
+        std::cout << std::format("{:<24} {:>12} {:>14} {:>12} {:>14}\n", name ? name : "(unscoped)",
+            phase.allocations.load(), phase.bytes.load(), phase.frees.load(), phase.peakLive.load());
+    }
+}
+
+#ifdef HCN_ALLOC_PROFILE
+
+// The header sits directly in front of the block; aligned blocks reserve a whole alignment
+// unit for it so the block itself stays aligned.
+size_t allocHeaderOffset(std::align_val_t alignment)
+{
+    return std::max(static_cast<size_t>(alignment), sizeof(AllocHeader));
+}
+
+void* allocTag(void* raw, size_t offset, size_t size)
+{
+    void* block = static_cast<char*>(raw) + offset;
+    AllocHeader* header = static_cast<AllocHeader*>(block) - 1;
+    header->phase = AllocHeader::kUntagged;
+    if (AllocProfile::mEnabled.load(std::memory_order_relaxed))
+        AllocProfile::onAllocate(*header, size);
+    return block;
+}
+
+void allocUntag(void* block)
+{
+    if (AllocProfile::mEnabled.load(std::memory_order_relaxed))
+        AllocProfile::onFree(*(static_cast<AllocHeader*>(block) - 1));
+}
+
+void* operator new(size_t size)
+{
+    void* raw = malloc(sizeof(AllocHeader) + size);
+    if (raw == nullptr)
+        throw std::bad_alloc();
+    return allocTag(raw, sizeof(AllocHeader), size);
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* raw = _aligned_malloc(allocHeaderOffset(alignment) + size, static_cast<size_t>(alignment));
+    if (raw == nullptr)
+        throw std::bad_alloc();
+    return allocTag(raw, allocHeaderOffset(alignment), size);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void* block) noexcept
+{
+    if (block == nullptr)
+        return;
+
+    allocUntag(block);
+    free(static_cast<char*>(block) - sizeof(AllocHeader));
+}
+
+void operator delete[](void* block) noexcept
+{
+    operator delete(block);
+}
+
+void operator delete(void* block, size_t) noexcept
+{
+    operator delete(block);
+}
+
+void operator delete[](void* block, size_t) noexcept
+{
+    operator delete(block);
+}
+
+void operator delete(void* block, std::align_val_t alignment) noexcept
+{
+    if (block == nullptr)
+        return;
+
+    allocUntag(block);
+    _aligned_free(static_cast<char*>(block) - allocHeaderOffset(alignment));
+}
+
+void operator delete[](void* block, std::align_val_t alignment) noexcept
+{
+    operator delete(block, alignment);
+}
+
+void operator delete(void* block, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(block, alignment);
+}
+
+void operator delete[](void* block, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(block, alignment);
+}
+
+#endif
+
+#pragma endregion
+
 #pragma region Utils
 
 boost::json::value xjsonReadFromFile(std::filesystem::path filePath)
 {
+    AllocPhase phase("load");
     std::ifstream ifs;
     try
     {
@@ -29,6 +302,8 @@ boost::json::value xjsonReadFromFile(std::filesystem::path filePath)
     {
         std::stringstream ss;
         ss << ifs.rdbuf();
+
+        AllocPhase parsePhase("parse");
         boost::json::value jv = boost::json::parse(ss.str());
         return jv;
     }
@@ -82,146 +357,6612 @@ std::wstring xstrUtf16(const std::string& str)
 
 std::string xstrUtf8(const boost::json::value& jv)
 {
+    AllocPhase phase("serialize");
     return (std::stringstream() << jv).str();
 }
 
 std::wstring xstrUtf16(const boost::json::value& jv)
 {
+    AllocPhase phase("serialize");
     return xstrUtf16(xstrUtf8(jv));
 }
 
-#pragma endregion
+std::string xstrGuid(const GUID& guid)
+{
+    return std::format("{:08X}-{:04X}-{:04X}-{:02X}{:02X}-{:02X}{:02X}{:02X}{:02X}{:02X}{:02X}",
+        guid.Data1, guid.Data2, guid.Data3, guid.Data4[0], guid.Data4[1], guid.Data4[2],
+        guid.Data4[3], guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7]);
+}
 
-struct VmmgrHypervApi
+GUID xguidRandom(std::mt19937_64& engine)
 {
-    static void init();
-    static inline decltype(&::HcnOpenNetwork) HcnOpenNetwork{ nullptr };
-    static inline decltype(&::HcnCloseNetwork) HcnCloseNetwork{ nullptr };
-    static inline decltype(&::HcnCreateNetwork) HcnCreateNetwork{ nullptr };
+    uint64_t high = engine();
+    uint64_t low = engine();
 
-    static inline decltype(&::HcnCloseEndpoint) HcnCloseEndpoint{ nullptr };
-    static inline decltype(&::HcnCreateEndpoint) HcnCreateEndpoint{ nullptr };
-    static inline decltype(&::HcnDeleteEndpoint) HcnDeleteEndpoint{ nullptr };
-};
+    GUID guid;
+    guid.Data1 = static_cast<unsigned long>(high >> 32);
+    guid.Data2 = static_cast<unsigned short>(high >> 16);
+    guid.Data3 = static_cast<unsigned short>((high & 0x0FFF) | 0x4000);
+    for (int i = 0; i < 8; ++i)
+        guid.Data4[i] = static_cast<unsigned char>(low >> (i * 8));
+    guid.Data4[0] = (guid.Data4[0] & 0x3F) | 0x80;
+    return guid;
+}
 
-void VmmgrHypervApi::init()
+GUID xguidRandom()
 {
-    HMODULE mComputeNetworkHandle = LoadLibrary(L"ComputeNetwork.dll");
-    if (mComputeNetworkHandle != nullptr)
+    thread_local std::mt19937_64 engine{ std::random_device{}() };
+    return xguidRandom(engine);
+}
+
+// Parses a bare 8-4-4-4-12 GUID in either case, the form config keys use.
+bool xguidParse(std::string_view text, GUID& guid)
+{
+    if (text.size() != 36 || text[8] != '-' || text[13] != '-' || text[18] != '-' || text[23] != '-')
+        return false;
+
+    static constexpr auto kNibbles = [] {
+        std::array<uint8_t, 256> nibbles{};
+        nibbles.fill(0xFF);
+        for (int c = 0; c < 10; ++c)
+            nibbles['0' + c] = static_cast<uint8_t>(c);
+        for (int c = 0; c < 6; ++c)
+            nibbles['A' + c] = nibbles['a' + c] = static_cast<uint8_t>(10 + c);
+        return nibbles;
+    }();
+    static constexpr uint8_t kOffsets[16] = { 0, 2, 4, 6, 9, 11, 14, 16, 19, 21, 24, 26, 28, 30, 32, 34 };
+
+    uint8_t bytes[16];
+    uint8_t invalid = 0;
+    for (size_t i = 0; i < 16; ++i)
     {
-        void* symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnOpenNetwork");
-        if (symbolAddress != nullptr)
-            HcnOpenNetwork = (decltype(&::HcnOpenNetwork))symbolAddress;
+        uint8_t high = kNibbles[static_cast<uint8_t>(text[kOffsets[i]])];
+        uint8_t low = kNibbles[static_cast<uint8_t>(text[kOffsets[i] + 1])];
+        invalid |= high | low;
+        bytes[i] = static_cast<uint8_t>(high << 4 | low);
+    }
+    if (invalid & 0xF0)
+        return false;
 
-        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnCloseNetwork");
-        if (symbolAddress != nullptr)
-            HcnCloseNetwork = (decltype(&::HcnCloseNetwork))symbolAddress;
+    guid.Data1 = static_cast<unsigned long>(bytes[0]) << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+    guid.Data2 = static_cast<unsigned short>(bytes[4] << 8 | bytes[5]);
+    guid.Data3 = static_cast<unsigned short>(bytes[6] << 8 | bytes[7]);
+    memcpy(guid.Data4, bytes + 8, 8);
+    return true;
+}
 
-        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnCreateNetwork");
-        if (symbolAddress != nullptr)
-            HcnCreateNetwork = (decltype(&::HcnCreateNetwork))symbolAddress;
+bool xargFlag(int argc, char* argv[], std::string_view name)
+{
+    return std::find(argv + 1, argv + argc, name) != argv + argc;
+}
 
+std::string xargValue(int argc, char* argv[], std::string_view name, std::string_view defaultValue)
+{
+    auto it = std::find(argv + 1, argv + argc, name);
+    return (it != argv + argc && it + 1 != argv + argc) ? *(it + 1) : std::string(defaultValue);
+}
 
-        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnCloseEndpoint");
-        if (symbolAddress != nullptr)
-            HcnCloseEndpoint = (decltype(&::HcnCloseEndpoint))symbolAddress;
+double xpercentile(std::vector<double> samples, double percentile)
+{
+    if (samples.empty())
+        return 0.0;
 
-        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnCreateEndpoint");
-        if (symbolAddress != nullptr)
-            HcnCreateEndpoint = (decltype(&::HcnCreateEndpoint))symbolAddress;
+    size_t index = static_cast<size_t>(percentile / 100.0 * (samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
 
-        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnDeleteEndpoint");
-        if (symbolAddress != nullptr)
-            HcnDeleteEndpoint = (decltype(&::HcnDeleteEndpoint))symbolAddress;
-    }
+// Fast non-cryptographic 64-bit hash in the wyhash/xxh3 family: input is consumed in
+// 16-byte blocks folded through a 64x64->128 bit multiply.
+inline uint64_t xhashMix(uint64_t a, uint64_t b)
+{
+    uint64_t high;
+    uint64_t low = _umul128(a, b, &high);
+    return low ^ high;
 }
 
-boost::json::value mAndroidJson;
-wil::unique_any < HCN_NETWORK, decltype(&::HcnCloseNetwork), [](HCN_NETWORK h) { return VmmgrHypervApi::HcnCloseNetwork(h); } > mHcnNetwork;
-wil::unique_any < HCN_ENDPOINT, decltype(&::HcnCloseEndpoint), [](HCN_ENDPOINT h) { return VmmgrHypervApi::HcnCloseEndpoint(h); } > mHcnEndpoint;
+inline uint64_t xhashRead64(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
 
-void configureHcnNetwork()
+uint64_t xhash64(const void* data, size_t size, uint64_t seed = 0)
 {
-    std::string networkGuid = (mAndroidJson / "HcnNetwork" / "ID").as_string().data();
-    GUID guidNetwork;
+    constexpr uint64_t kSecret0 = 0xa0761d6478bd642full;
+    constexpr uint64_t kSecret1 = 0xe7037ed1a0b428dbull;
+    constexpr uint64_t kSecret2 = 0x8ebc6af09c88c6e3ull;
 
-    if (UuidFromStringA((RPC_CSTR)networkGuid.data(), &guidNetwork) != RPC_S_OK)
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint64_t h = seed ^ xhashMix(seed ^ kSecret0, size ^ kSecret1);
+
+    size_t remaining = size;
+    for (; remaining >= 16; remaining -= 16, p += 16)
+        h = xhashMix(xhashRead64(p) ^ kSecret1, xhashRead64(p + 8) ^ h);
+
+    uint64_t a = 0;
+    uint64_t b = 0;
+    if (remaining >= 8)
     {
-        std::cout << std::format("{} - Failed to parse Network guid: {}\n", __func__, networkGuid) << "\n";
+        a = xhashRead64(p);
+        memcpy(&b, p + 8, remaining - 8);
+    }
+    else
+    {
+        memcpy(&a, p, remaining);
     }
+    return xhashMix(kSecret2 ^ size, xhashMix(a ^ kSecret1, b ^ h));
+}
+
+inline uint64_t xhashCombine(uint64_t h, uint64_t v)
+{
+    return xhashMix(h ^ 0x4f1bbcdcbfa53e0bull, v ^ 0x9e3779b97f4a7c15ull);
+}
 
-    wil::unique_cotaskmem_string errStr;
-    HRESULT result = VmmgrHypervApi::HcnOpenNetwork(guidNetwork, &mHcnNetwork, &errStr);
+// Bulk variant of xhash64 for large buffers, in the style of xxh3's accumulate loop: eight
+// independent 64-bit lanes per 64-byte stripe, each updated with a 32x32->64 bit multiply,
+// so the loop has no serial dependency and vectorizes. Not interchangeable with xhash64.
+uint64_t xhash64Wide(const void* data, size_t size, uint64_t seed = 0)
+{
+    static constexpr uint64_t kSecret[8] = {
+        0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+        0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+    };
 
-    std::cout << std::format("{} - HcnOpenNetwork:\nresult {}\nerrStr {}\n", __func__, result, xstrUtf8(errStr.get())) << "\n";
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint64_t acc[8];
+    for (size_t i = 0; i < 8; ++i)
+        acc[i] = kSecret[i] ^ seed;
 
-    if (result == HCN_E_NETWORK_NOT_FOUND)
+    size_t stripes = size / 64;
+    for (size_t s = 0; s < stripes; ++s, p += 64)
     {
-        result = VmmgrHypervApi::HcnCreateNetwork(
-            guidNetwork,                                    // Id
-            xstrUtf16(mAndroidJson / "HcnNetwork").data(),  // Settings
-            &mHcnNetwork,                                   // Network
-            &errStr                                         // ErrorRecord
-        );
+        for (size_t i = 0; i < 8; ++i)
+        {
+            uint64_t v = xhashRead64(p + i * 8);
+            uint64_t k = v ^ kSecret[i];
+            acc[i ^ 1] += v;
+            acc[i] += (k & 0xffffffffull) * (k >> 32);
+        }
+    }
 
-        std::cout << std::format("{} - HcnCreateNetwork\nresult {}\nerrStr {}\n", __func__, result, xstrUtf8(errStr.get())) << "\n";
+    uint64_t h = xhash64(p, size % 64, seed ^ size);
+    for (size_t i = 0; i < 8; ++i)
+        h = xhashCombine(h, acc[i]);
+    return h;
+}
+
+struct GuidHash
+{
+    size_t operator()(const GUID& guid) const noexcept
+    {
+        return static_cast<size_t>(xhash64(&guid, sizeof(guid)));
     }
+};
+
+#pragma endregion
+
+#pragma region JsonHash
+
+// Canonical hash of a boost::json::value that does not depend on object key order or on how
+// a number was spelled: keys are visited sorted, integral doubles hash like integers and -0.0
+// hashes like 0. Each subtree digest is computed once from its children's digests, so a
+// single walk can also report the digest of every subtree down to a given depth, keyed by
+// JSON pointer.
+class JsonHash
+{
+public:
+    struct Digest
+    {
+        std::string pointer;
+        uint64_t digest = 0;
+    };
+
+    static uint64_t digest(const boost::json::value& jv);
+    std::vector<Digest> digests(const boost::json::value& jv, size_t maxDepth);
+
+private:
+    enum Tag : uint64_t { Null = 1, False, True, Integer, Unsigned, Double, String, Array, Object };
+
+    uint64_t walk(const boost::json::value& jv, size_t depth);
+    void record(uint64_t digest);
+
+    size_t mMaxDepth = 0;
+    std::vector<Digest>* mOut = nullptr;
+    std::string mPointer;
+    std::deque<std::vector<const boost::json::key_value_pair*>> mScratch;
+};
+
+uint64_t JsonHash::digest(const boost::json::value& jv)
+{
+    JsonHash hash;
+    return hash.walk(jv, 0);
 }
 
-void configureHcnEndpoint()
+std::vector<JsonHash::Digest> JsonHash::digests(const boost::json::value& jv, size_t maxDepth)
 {
-    std::string endpointGuid = (mAndroidJson / "HcsSystem" / "VirtualMachine" / "Devices" /
-        "NetworkAdapters" / "default" / "EndpointId").as_string().data();
+    std::vector<Digest> out;
+    mMaxDepth = maxDepth;
+    mOut = &out;
+    mPointer.clear();
+    walk(jv, 0);
+    mOut = nullptr;
+    return out;
+}
 
-    GUID guidEndpoint;
-    if (UuidFromStringA((RPC_CSTR)endpointGuid.data(), &guidEndpoint) != RPC_S_OK)
+void JsonHash::record(uint64_t digest)
+{
+    mOut->push_back(Digest{ mPointer, digest });
+}
+
+uint64_t JsonHash::walk(const boost::json::value& jv, size_t depth)
+{
+    uint64_t h = 0;
+    switch (jv.kind())
     {
-        std::cout << std::format("{} - Failed to parse Endpoint guid: {}\n", __func__, endpointGuid);
+    case boost::json::kind::null:
+        h = xhashCombine(Null, 0);
+        break;
+
+    case boost::json::kind::bool_:
+        h = xhashCombine(jv.get_bool() ? True : False, 0);
+        break;
+
+    case boost::json::kind::int64:
+        h = xhashCombine(Integer, static_cast<uint64_t>(jv.get_int64()));
+        break;
+
+    case boost::json::kind::uint64:
+        if (jv.get_uint64() <= static_cast<uint64_t>(INT64_MAX))
+            h = xhashCombine(Integer, jv.get_uint64());
+        else
+            h = xhashCombine(Unsigned, jv.get_uint64());
+        break;
+
+    case boost::json::kind::double_:
+    {
+        double d = jv.get_double();
+        if (std::trunc(d) == d && std::abs(d) < 9.2e18)
+            h = xhashCombine(Integer, static_cast<uint64_t>(static_cast<int64_t>(d)));
+        else
+            h = xhashCombine(Double, std::bit_cast<uint64_t>(d));
+        break;
+    }
+
+    case boost::json::kind::string:
+    {
+        const boost::json::string& str = jv.get_string();
+        h = xhashCombine(String, xhash64(str.data(), str.size()));
+        break;
+    }
+
+    case boost::json::kind::array:
+    {
+        const boost::json::array& array = jv.get_array();
+        bool recordChildren = mOut != nullptr && depth < mMaxDepth;
+        size_t pointerSize = mPointer.size();
+
+        h = xhashCombine(Array, array.size());
+        for (size_t i = 0; i < array.size(); ++i)
+        {
+            if (recordChildren)
+                mPointer.append("/").append(std::to_string(i));
+            h = xhashCombine(h, walk(array[i], depth + 1));
+            mPointer.resize(pointerSize);
+        }
+        break;
     }
 
-    wil::unique_cotaskmem_string errStr;
-    HRESULT result = VmmgrHypervApi::HcnDeleteEndpoint(guidEndpoint, &errStr);
-    std::cout << std::format("{} - HcnDeleteEndpoint:\nresult {}\nerrStr {}\n", __func__, result, xstrUtf8(errStr.get())) << "\n";
+    case boost::json::kind::object:
+    {
+        const boost::json::object& object = jv.get_object();
+        bool recordChildren = mOut != nullptr && depth < mMaxDepth;
+        size_t pointerSize = mPointer.size();
+
+        if (mScratch.size() <= depth)
+            mScratch.resize(depth + 1);
 
-    result = VmmgrHypervApi::HcnCreateEndpoint(
-        mHcnNetwork.get(),                                  // Network
-        guidEndpoint,                                       // Id
-        xstrUtf16(mAndroidJson / "HcnEndpoint").data(),     // Settings
-        &mHcnEndpoint,                                      // Endpoint
-        &errStr);                                           // ErrorRecord
+        std::vector<const boost::json::key_value_pair*>& keys = mScratch[depth];
+        keys.clear();
+        for (const auto& kv : object)
+            keys.push_back(&kv);
+        std::sort(keys.begin(), keys.end(), [](auto* a, auto* b) { return a->key() < b->key(); });
 
-    std::cout << std::format("{} - HcnCreateEndpoint\nresult {}\nerrStr {}\n", __func__, result, xstrUtf8(errStr.get())) << "\n";
+        h = xhashCombine(Object, object.size());
+        for (const auto* kv : keys)
+        {
+            if (recordChildren)
+            {
+                mPointer.push_back('/');
+                for (char c : kv->key())
+                {
+                    if (c == '~')
+                        mPointer.append("~0");
+                    else if (c == '/')
+                        mPointer.append("~1");
+                    else
+                        mPointer.push_back(c);
+                }
+            }
+            h = xhashCombine(h, xhash64(kv->key().data(), kv->key().size()));
+            h = xhashCombine(h, walk(kv->value(), depth + 1));
+            mPointer.resize(pointerSize);
+        }
+        break;
+    }
+    }
+
+    if (mOut != nullptr && depth <= mMaxDepth && jv.is_structured())
+        record(h);
+    return h;
 }
 
-int main()
+// Identity of an endpoint policy for in-place updates: two policies with the same Type,
+// Protocol and InternalPort describe the same mapping, whatever their other fields.
+uint64_t hcnPolicyIdentity(const boost::json::value& policy)
 {
-    std::string userName = getenv("USERNAME");
-    std::string groupName = "Hyper-V Administrators";
+    uint64_t h = 0;
+    if (const boost::json::object* object = policy.if_object())
+    {
+        for (const char* key : { "Type", "Protocol", "InternalPort" })
+        {
+            const boost::json::value* field = object->if_contains(key);
+            h = xhashCombine(h, field ? JsonHash::digest(*field) : 0);
+        }
+    }
+    return h;
+}
 
-    std::string command = std::format("net localgroup \"{}\" /add \"{}\"", groupName, userName);
-    system(command.c_str());
+#pragma endregion
 
-    std::string path;
-    std::cout << "Enter the path of hypervm.json (without quotes): ";
-    std::getline(std::cin, path);
+#pragma region JsonPatch
 
-    if (std::filesystem::exists(std::filesystem::path(path)))
+// JSON Pointer (RFC 6901) parsed once: tokens are unescaped and array indexes converted up
+// front so that applying a patch does no string parsing.
+struct JsonPointer
+{
+    struct Token
     {
-        std::cout << "----Execution started----\n";
+        std::string key;
+        size_t index = SIZE_MAX;    // SIZE_MAX when the token is not a valid array index
+        bool append = false;        // "-", one past the end of an array
+    };
 
-        mAndroidJson = xjsonReadFromFile(std::filesystem::path(path));
-        VmmgrHypervApi::init();
+    std::string text;
+    std::vector<Token> tokens;
 
-        configureHcnNetwork();
-        configureHcnEndpoint();
+    static JsonPointer parse(std::string_view text);
+};
 
-        std::cout << "----Execution finished----\n";
+JsonPointer JsonPointer::parse(std::string_view text)
+{
+    JsonPointer pointer;
+    pointer.text = text;
+    if (text.empty())
+        return pointer;
+    if (text.front() != '/')
+        throw std::invalid_argument(std::format("JSON pointer must start with '/': {}", text));
+
+    size_t start = 1;
+    for (;;)
+    {
+        size_t end = text.find('/', start);
+        std::string_view raw = text.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+
+        Token token;
+        for (size_t i = 0; i < raw.size(); ++i)
+        {
+            if (raw[i] == '~' && i + 1 < raw.size() && (raw[i + 1] == '0' || raw[i + 1] == '1'))
+                token.key += raw[++i] == '0' ? '~' : '/';
+            else
+                token.key += raw[i];
+        }
+
+        token.append = token.key == "-";
+        bool digits = !token.key.empty() && std::all_of(token.key.begin(), token.key.end(), [](char c) { return c >= '0' && c <= '9'; });
+        if (digits && (token.key.size() == 1 || token.key[0] != '0'))
+            token.index = std::stoull(token.key);
+
+        pointer.tokens.push_back(std::move(token));
+        if (end == std::string_view::npos)
+            break;
+        start = end + 1;
     }
-    else
+    return pointer;
+}
+
+// RFC 6902 JSON Patch compiled from a patch document and applied in place. Application is
+// atomic: every change is recorded in an undo log and rolled back if a later operation fails
+// or a test does not match. The result names the top-level sections that were changed so
+// the caller only re-provisions those.
+class JsonPatch
+{
+public:
+    enum Section : uint32_t
     {
-        std::cout << "----No such file exists----\n";
+        HcsSystem = 1 << 0,
+        HcnNetwork = 1 << 1,
+        HcnEndpoint = 1 << 2,
+        NetworkAdapters = 1 << 3,   // HcsSystem/VirtualMachine/Devices/NetworkAdapters
+        OtherSection = 1 << 4,
+    };
+
+    struct Result
+    {
+        bool ok = true;
+        uint32_t touched = 0;
+        size_t failedOperation = 0;
+        std::string error;
+    };
+
+    static JsonPatch compile(const boost::json::value& patch);
+
+    Result apply(boost::json::value& document) const;
+    size_t size() const { return mOperations.size(); }
+
+    static std::string sectionNames(uint32_t sections);
+
+private:
+    enum class Op
+    {
+        Add,
+        Remove,
+        Replace,
+        Move,
+        Copy,
+        Test,
+    };
+
+    struct Operation
+    {
+        Op op;
+        JsonPointer path;
+        JsonPointer from;
+        boost::json::value value;
+        uint32_t touched = 0;
+    };
+
+    // Reverses one change. The slot is addressed by pointer rather than by address, since a
+    // later insert may reallocate the containers above it.
+    struct Undo
+    {
+        enum Kind
+        {
+            Erase,      // the change inserted a slot
+            Insert,     // the change removed a slot holding previous
+            Assign,     // the change overwrote previous
+        };
+
+        Kind kind;
+        const JsonPointer* pointer;
+        size_t index;
+        boost::json::value previous;
+    };
+
+    static uint32_t section(const JsonPointer& pointer);
+    static boost::json::value& parent(boost::json::value& document, const JsonPointer& pointer);
+    static boost::json::value& resolve(boost::json::value& document, const JsonPointer& pointer);
+    static void add(boost::json::value& document, const JsonPointer& pointer, boost::json::value value, std::vector<Undo>& undo);
+    static boost::json::value remove(boost::json::value& document, const JsonPointer& pointer, std::vector<Undo>& undo);
+    static void replace(boost::json::value& document, const JsonPointer& pointer, boost::json::value value, std::vector<Undo>& undo);
+    static void rollback(boost::json::value& document, std::vector<Undo>& undo);
+
+    std::vector<Operation> mOperations;
+};
+
+JsonPatch JsonPatch::compile(const boost::json::value& patch)
+{
+    static const std::unordered_map<std::string_view, Op> kOps = {
+        { "add", Op::Add }, { "remove", Op::Remove }, { "replace", Op::Replace },
+        { "move", Op::Move }, { "copy", Op::Copy }, { "test", Op::Test },
+    };
+
+    JsonPatch compiled;
+    for (const auto& entry : patch.as_array())
+    {
+        const boost::json::object& object = entry.as_object();
+        auto op = kOps.find(std::string_view(object.at("op").as_string()));
+        if (op == kOps.end())
+            throw std::invalid_argument(std::format("unknown JSON patch op: {}", std::string_view(object.at("op").as_string())));
+
+        Operation operation{ op->second, JsonPointer::parse(object.at("path").as_string()) };
+        if (operation.op == Op::Move || operation.op == Op::Copy)
+            operation.from = JsonPointer::parse(object.at("from").as_string());
+        if (operation.op == Op::Add || operation.op == Op::Replace || operation.op == Op::Test)
+            operation.value = object.at("value");
+
+        if (operation.op != Op::Test)
+            operation.touched = section(operation.path) | (operation.op == Op::Move ? section(operation.from) : 0);
+        compiled.mOperations.push_back(std::move(operation));
     }
+    return compiled;
+}
 
-    std::cin.get();
-    return 0;
+uint32_t JsonPatch::section(const JsonPointer& pointer)
+{
+    if (pointer.tokens.empty())
+        return HcsSystem | HcnNetwork | HcnEndpoint | NetworkAdapters | OtherSection;
+
+    const std::string& top = pointer.tokens[0].key;
+    if (top == "HcnNetwork")
+        return HcnNetwork;
+    if (top == "HcnEndpoint")
+        return HcnEndpoint;
+    if (top != "HcsSystem")
+        return OtherSection;
+
+    static constexpr std::string_view kAdapters[] = { "HcsSystem", "VirtualMachine", "Devices", "NetworkAdapters" };
+    size_t common = 0;
+    while (common < std::size(kAdapters) && common < pointer.tokens.size() && pointer.tokens[common].key == kAdapters[common])
+        common++;
+    return common == pointer.tokens.size() || common == std::size(kAdapters) ? HcsSystem | NetworkAdapters : HcsSystem;
+}
+
+std::string JsonPatch::sectionNames(uint32_t sections)
+{
+    std::string names;
+    for (auto [bit, name] : { std::pair{ HcsSystem, "HcsSystem" }, std::pair{ HcnNetwork, "HcnNetwork" }, std::pair{ HcnEndpoint, "HcnEndpoint" },
+        std::pair{ NetworkAdapters, "NetworkAdapters" }, std::pair{ OtherSection, "other" } })
+    {
+        if (sections & bit)
+            names += (names.empty() ? "" : ",") + std::string(name);
+    }
+    return names.empty() ? "none" : names;
+}
+
+boost::json::value& JsonPatch::resolve(boost::json::value& document, const JsonPointer& pointer)
+{
+    boost::json::value* current = &document;
+    for (const JsonPointer::Token& token : pointer.tokens)
+    {
+        if (boost::json::object* object = current->if_object())
+            current = object->if_contains(token.key);
+        else if (boost::json::array* array = current->if_array())
+            current = token.index < array->size() ? &(*array)[token.index] : nullptr;
+        else
+            current = nullptr;
+
+        if (current == nullptr)
+            throw std::out_of_range(std::format("path not found: {}", pointer.text));
+    }
+    return *current;
+}
+
+boost::json::value& JsonPatch::parent(boost::json::value& document, const JsonPointer& pointer)
+{
+    boost::json::value* current = &document;
+    for (size_t i = 0; i + 1 < pointer.tokens.size(); ++i)
+    {
+        const JsonPointer::Token& token = pointer.tokens[i];
+        if (boost::json::object* object = current->if_object())
+            current = object->if_contains(token.key);
+        else if (boost::json::array* array = current->if_array())
+            current = token.index < array->size() ? &(*array)[token.index] : nullptr;
+        else
+            current = nullptr;
+
+        if (current == nullptr)
+            throw std::out_of_range(std::format("path not found: {}", pointer.text));
+    }
+    return *current;
+}
+
+void JsonPatch::add(boost::json::value& document, const JsonPointer& pointer, boost::json::value value, std::vector<Undo>& undo)
+{
+    if (pointer.tokens.empty())
+    {
+        replace(document, pointer, std::move(value), undo);
+        return;
+    }
+
+    boost::json::value& target = parent(document, pointer);
+    const JsonPointer::Token& token = pointer.tokens.back();
+    if (boost::json::object* object = target.if_object())
+    {
+        if (boost::json::value* existing = object->if_contains(token.key))
+        {
+            undo.push_back(Undo{ Undo::Assign, &pointer, SIZE_MAX, std::move(*existing) });
+            *existing = std::move(value);
+        }
+        else
+        {
+            undo.push_back(Undo{ Undo::Erase, &pointer, SIZE_MAX });
+            object->insert_or_assign(token.key, std::move(value));
+        }
+    }
+    else if (boost::json::array* array = target.if_array())
+    {
+        size_t index = token.append ? array->size() : token.index;
+        if (index > array->size())
+            throw std::out_of_range(std::format("array index out of range: {}", pointer.text));
+        undo.push_back(Undo{ Undo::Erase, &pointer, index });
+        array->insert(array->begin() + index, std::move(value));
+    }
+    else
+    {
+        throw std::out_of_range(std::format("parent is not a container: {}", pointer.text));
+    }
+}
+
+boost::json::value JsonPatch::remove(boost::json::value& document, const JsonPointer& pointer, std::vector<Undo>& undo)
+{
+    if (pointer.tokens.empty())
+        throw std::invalid_argument("cannot remove the document root");
+
+    boost::json::value& target = parent(document, pointer);
+    const JsonPointer::Token& token = pointer.tokens.back();
+    boost::json::value removed;
+    if (boost::json::object* object = target.if_object())
+    {
+        boost::json::value* existing = object->if_contains(token.key);
+        if (existing == nullptr)
+            throw std::out_of_range(std::format("path not found: {}", pointer.text));
+        removed = std::move(*existing);
+        object->erase(token.key);
+        undo.push_back(Undo{ Undo::Insert, &pointer, SIZE_MAX, removed });
+    }
+    else if (boost::json::array* array = target.if_array(); array && token.index < array->size())
+    {
+        removed = std::move((*array)[token.index]);
+        array->erase(array->begin() + token.index);
+        undo.push_back(Undo{ Undo::Insert, &pointer, token.index, removed });
+    }
+    else
+    {
+        throw std::out_of_range(std::format("path not found: {}", pointer.text));
+    }
+    return removed;
+}
+
+void JsonPatch::replace(boost::json::value& document, const JsonPointer& pointer, boost::json::value value, std::vector<Undo>& undo)
+{
+    boost::json::value& target = resolve(document, pointer);
+    const JsonPointer::Token* token = pointer.tokens.empty() ? nullptr : &pointer.tokens.back();
+    undo.push_back(Undo{ Undo::Assign, &pointer, token ? token->index : SIZE_MAX, std::move(target) });
+    target = std::move(value);
+}
+
+// Entries are replayed newest-first, so each one finds the document exactly as its change
+// left it and its pointer resolves to the same slot.
+void JsonPatch::rollback(boost::json::value& document, std::vector<Undo>& undo)
+{
+    for (auto it = undo.rbegin(); it != undo.rend(); ++it)
+    {
+        if (it->pointer->tokens.empty())
+        {
+            document = std::move(it->previous);
+            continue;
+        }
+
+        boost::json::value& target = parent(document, *it->pointer);
+        const std::string& key = it->pointer->tokens.back().key;
+        if (boost::json::object* object = target.if_object())
+        {
+            if (it->kind == Undo::Erase)
+                object->erase(key);
+            else
+                object->insert_or_assign(key, std::move(it->previous));
+        }
+        else if (boost::json::array* array = target.if_array())
+        {
+            if (it->kind == Undo::Erase)
+                array->erase(array->begin() + it->index);
+            else if (it->kind == Undo::Insert)
+                array->insert(array->begin() + it->index, std::move(it->previous));
+            else
+                (*array)[it->index] = std::move(it->previous);
+        }
+    }
+    undo.clear();
+}
+
+JsonPatch::Result JsonPatch::apply(boost::json::value& document) const
+{
+    Result result;
+    std::vector<Undo> undo;
+    for (size_t i = 0; i < mOperations.size(); ++i)
+    {
+        const Operation& operation = mOperations[i];
+        try
+        {
+            switch (operation.op)
+            {
+            case Op::Add:
+                add(document, operation.path, operation.value, undo);
+                break;
+            case Op::Remove:
+                remove(document, operation.path, undo);
+                break;
+            case Op::Replace:
+                replace(document, operation.path, operation.value, undo);
+                break;
+            case Op::Move:
+                if (operation.path.text.starts_with(operation.from.text + "/"))
+                    throw std::invalid_argument(std::format("cannot move {} into itself", operation.from.text));
+                add(document, operation.path, remove(document, operation.from, undo), undo);
+                break;
+            case Op::Copy:
+                add(document, operation.path, resolve(document, operation.from), undo);
+                break;
+            case Op::Test:
+                if (resolve(document, operation.path) != operation.value)
+                    throw std::runtime_error(std::format("test failed: {}", operation.path.text));
+                break;
+            }
+        }
+        catch (std::exception& exc)
+        {
+            rollback(document, undo);
+            return Result{ false, 0, i, exc.what() };
+        }
+        result.touched |= operation.touched;
+    }
+    return result;
+}
+
+#pragma endregion
+
+#pragma region NameGuid
+
+// RFC 4122 version 5 GUIDs: SHA-1 of a namespace GUID followed by a name, truncated to 128
+// bits with the version and variant bits set. The same instance name always yields the same
+// network and endpoint IDs, so a restarted instance finds its own resources without a table.
+// SHA-1 is used here only as the RFC's derivation function, not for integrity.
+class NameGuid
+{
+public:
+    // Namespace for IDs derived by this tool when --guid-namespace is not given.
+    static inline const GUID kNamespace = { 0x3B6F0D92, 0x71C4, 0x5E8A, { 0x9D, 0x15, 0x4A, 0xC7, 0x28, 0xE3, 0x60, 0xBF } };
+
+    static GUID derive(const GUID& space, std::string_view name);
+
+    // Derives one GUID per name. Names are hashed four at a time in lock-step, one SHA-1
+    // state per lane, so the round loops run over independent lanes and vectorize; a group
+    // whose names pad to different block counts falls back to one lane.
+    static std::vector<GUID> derive(const GUID& space, const std::vector<std::string>& names);
+
+    // Rewrites HcnNetwork.ID, HcnEndpoint.VirtualNetwork and the default adapter's EndpointId
+    // with IDs derived from the instance name. Returns false for configs it cannot rewrite.
+    static bool inject(boost::json::value& config, const GUID& space, std::string_view instance);
+
+private:
+    static constexpr size_t kLanes = 4;
+
+    static void pad(const GUID& space, std::string_view name, std::vector<uint8_t>& message);
+
+    template<size_t Lanes>
+    static void hash(const uint8_t* const (&messages)[Lanes], size_t blocks, GUID (&out)[Lanes]);
+};
+
+void NameGuid::pad(const GUID& space, std::string_view name, std::vector<uint8_t>& message)
+{
+    size_t size = sizeof(GUID) + name.size();
+    message.assign((size + 8) / 64 * 64 + 64, 0);
+
+    // The namespace is hashed in network byte order.
+    uint8_t* p = message.data();
+    for (int shift = 24; shift >= 0; shift -= 8)
+        *p++ = static_cast<uint8_t>(space.Data1 >> shift);
+    *p++ = static_cast<uint8_t>(space.Data2 >> 8);
+    *p++ = static_cast<uint8_t>(space.Data2);
+    *p++ = static_cast<uint8_t>(space.Data3 >> 8);
+    *p++ = static_cast<uint8_t>(space.Data3);
+    memcpy(p, space.Data4, sizeof(space.Data4));
+    memcpy(p + sizeof(space.Data4), name.data(), name.size());
+
+    message[size] = 0x80;
+    uint64_t bits = static_cast<uint64_t>(size) * 8;
+    for (size_t i = 0; i < 8; ++i)
+        message[message.size() - 1 - i] = static_cast<uint8_t>(bits >> (i * 8));
+}
+
+template<size_t Lanes>
+void NameGuid::hash(const uint8_t* const (&messages)[Lanes], size_t blocks, GUID (&out)[Lanes])
+{
+    uint32_t state[5][Lanes];
+    for (size_t l = 0; l < Lanes; ++l)
+    {
+        state[0][l] = 0x67452301;
+        state[1][l] = 0xEFCDAB89;
+        state[2][l] = 0x98BADCFE;
+        state[3][l] = 0x10325476;
+        state[4][l] = 0xC3D2E1F0;
+    }
+
+    uint32_t w[80][Lanes];
+    for (size_t block = 0; block < blocks; ++block)
+    {
+        for (size_t t = 0; t < 16; ++t)
+        {
+            for (size_t l = 0; l < Lanes; ++l)
+            {
+                const uint8_t* p = messages[l] + block * 64 + t * 4;
+                w[t][l] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+            }
+        }
+        for (size_t t = 16; t < 80; ++t)
+        {
+            for (size_t l = 0; l < Lanes; ++l)
+                w[t][l] = std::rotl(w[t - 3][l] ^ w[t - 8][l] ^ w[t - 14][l] ^ w[t - 16][l], 1);
+        }
+
+        uint32_t a[Lanes], b[Lanes], c[Lanes], d[Lanes], e[Lanes];
+        for (size_t l = 0; l < Lanes; ++l)
+        {
+            a[l] = state[0][l];
+            b[l] = state[1][l];
+            c[l] = state[2][l];
+            d[l] = state[3][l];
+            e[l] = state[4][l];
+        }
+
+        for (size_t t = 0; t < 80; ++t)
+        {
+            for (size_t l = 0; l < Lanes; ++l)
+            {
+                uint32_t f, k;
+                if (t < 20)
+                    f = (b[l] & c[l]) | (~b[l] & d[l]), k = 0x5A827999;
+                else if (t < 40)
+                    f = b[l] ^ c[l] ^ d[l], k = 0x6ED9EBA1;
+                else if (t < 60)
+                    f = (b[l] & c[l]) | (b[l] & d[l]) | (c[l] & d[l]), k = 0x8F1BBCDC;
+                else
+                    f = b[l] ^ c[l] ^ d[l], k = 0xCA62C1D6;
+
+                uint32_t temp = std::rotl(a[l], 5) + f + e[l] + k + w[t][l];
+                e[l] = d[l];
+                d[l] = c[l];
+                c[l] = std::rotl(b[l], 30);
+                b[l] = a[l];
+                a[l] = temp;
+            }
+        }
+
+        for (size_t l = 0; l < Lanes; ++l)
+        {
+            state[0][l] += a[l];
+            state[1][l] += b[l];
+            state[2][l] += c[l];
+            state[3][l] += d[l];
+            state[4][l] += e[l];
+        }
+    }
+
+    // The first 128 bits of the digest, read back in network byte order.
+    for (size_t l = 0; l < Lanes; ++l)
+    {
+        GUID& guid = out[l];
+        guid.Data1 = state[0][l];
+        guid.Data2 = static_cast<unsigned short>(state[1][l] >> 16);
+        guid.Data3 = static_cast<unsigned short>((state[1][l] & 0x0FFF) | 0x5000);
+        for (size_t i = 0; i < 8; ++i)
+            guid.Data4[i] = static_cast<unsigned char>(state[2 + i / 4][l] >> (24 - (i % 4) * 8));
+        guid.Data4[0] = (guid.Data4[0] & 0x3F) | 0x80;
+    }
+}
+
+GUID NameGuid::derive(const GUID& space, std::string_view name)
+{
+    std::vector<uint8_t> message;
+    pad(space, name, message);
+    const uint8_t* const messages[1] = { message.data() };
+    GUID out[1];
+    hash<1>(messages, message.size() / 64, out);
+    return out[0];
+}
+
+std::vector<GUID> NameGuid::derive(const GUID& space, const std::vector<std::string>& names)
+{
+    std::vector<GUID> guids(names.size());
+    std::vector<uint8_t> padded[kLanes];
+    size_t i = 0;
+    for (; i + kLanes <= names.size(); i += kLanes)
+    {
+        const uint8_t* messages[kLanes];
+        bool uniform = true;
+        for (size_t l = 0; l < kLanes; ++l)
+        {
+            pad(space, names[i + l], padded[l]);
+            messages[l] = padded[l].data();
+            uniform &= padded[l].size() == padded[0].size();
+        }
+
+        if (uniform)
+        {
+            GUID out[kLanes];
+            hash<kLanes>(messages, padded[0].size() / 64, out);
+            std::copy(std::begin(out), std::end(out), guids.begin() + i);
+            continue;
+        }
+        for (size_t l = 0; l < kLanes; ++l)
+        {
+            const uint8_t* const message[1] = { messages[l] };
+            GUID out[1];
+            hash<1>(message, padded[l].size() / 64, out);
+            guids[i + l] = out[0];
+        }
+    }
+    for (; i < names.size(); ++i)
+        guids[i] = derive(space, names[i]);
+    return guids;
+}
+
+bool NameGuid::inject(boost::json::value& config, const GUID& space, std::string_view instance)
+{
+    boost::json::object* root = config.if_object();
+    boost::json::value* network = root ? root->if_contains("HcnNetwork") : nullptr;
+    boost::json::value* endpoint = root ? root->if_contains("HcnEndpoint") : nullptr;
+    boost::json::value* adapters = root ? root->if_contains("HcsSystem") : nullptr;
+    for (std::string_view key : { "VirtualMachine", "Devices", "NetworkAdapters" })
+        adapters = adapters && adapters->is_object() ? adapters->as_object().if_contains(key) : nullptr;
+
+    if (!network || !network->is_object() || !endpoint || !endpoint->is_object() || !adapters || !adapters->is_object())
+        return false;
+
+    std::vector<GUID> ids = derive(space, { std::format("{}/HcnNetwork", instance), std::format("{}/HcnEndpoint", instance) });
+    network->as_object().insert_or_assign("ID", xstrGuid(ids[0]));
+    endpoint->as_object().insert_or_assign("VirtualNetwork", xstrGuid(ids[0]));
+    boost::json::value& adapter = adapters->as_object()["default"];
+    if (!adapter.is_object())
+        adapter = boost::json::object{};
+    adapter.as_object().insert_or_assign("EndpointId", xstrGuid(ids[1]));
+    return true;
+}
+
+#pragma endregion
+
+struct VmmgrHypervApi
+{
+    // Loads the entry points from ComputeNetwork.dll, unless installed() already.
+    static void init();
+    static bool installed() { return HcnOpenNetwork != nullptr; }
+
+    static inline decltype(&::HcnOpenNetwork) HcnOpenNetwork{ nullptr };
+    static inline decltype(&::HcnCloseNetwork) HcnCloseNetwork{ nullptr };
+    static inline decltype(&::HcnCreateNetwork) HcnCreateNetwork{ nullptr };
+    static inline decltype(&::HcnDeleteNetwork) HcnDeleteNetwork{ nullptr };
+
+    static inline decltype(&::HcnCloseEndpoint) HcnCloseEndpoint{ nullptr };
+    static inline decltype(&::HcnCreateEndpoint) HcnCreateEndpoint{ nullptr };
+    static inline decltype(&::HcnDeleteEndpoint) HcnDeleteEndpoint{ nullptr };
+    static inline decltype(&::HcnOpenEndpoint) HcnOpenEndpoint{ nullptr };
+    static inline decltype(&::HcnModifyEndpoint) HcnModifyEndpoint{ nullptr };
+    static inline decltype(&::HcnQueryEndpointProperties) HcnQueryEndpointProperties{ nullptr };
+
+    static inline decltype(&::HcnEnumerateNetworks) HcnEnumerateNetworks{ nullptr };
+    static inline decltype(&::HcnEnumerateEndpoints) HcnEnumerateEndpoints{ nullptr };
+};
+
+void VmmgrHypervApi::init()
+{
+    if (installed())
+        return;
+
+    HMODULE mComputeNetworkHandle = LoadLibrary(L"ComputeNetwork.dll");
+    if (mComputeNetworkHandle != nullptr)
+    {
+        void* symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnOpenNetwork");
+        if (symbolAddress != nullptr)
+            HcnOpenNetwork = (decltype(&::HcnOpenNetwork))symbolAddress;
+
+        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnCloseNetwork");
+        if (symbolAddress != nullptr)
+            HcnCloseNetwork = (decltype(&::HcnCloseNetwork))symbolAddress;
+
+        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnCreateNetwork");
+        if (symbolAddress != nullptr)
+            HcnCreateNetwork = (decltype(&::HcnCreateNetwork))symbolAddress;
+
+        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnDeleteNetwork");
+        if (symbolAddress != nullptr)
+            HcnDeleteNetwork = (decltype(&::HcnDeleteNetwork))symbolAddress;
+
+
+        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnCloseEndpoint");
+        if (symbolAddress != nullptr)
+            HcnCloseEndpoint = (decltype(&::HcnCloseEndpoint))symbolAddress;
+
+        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnCreateEndpoint");
+        if (symbolAddress != nullptr)
+            HcnCreateEndpoint = (decltype(&::HcnCreateEndpoint))symbolAddress;
+
+        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnDeleteEndpoint");
+        if (symbolAddress != nullptr)
+            HcnDeleteEndpoint = (decltype(&::HcnDeleteEndpoint))symbolAddress;
+
+        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnOpenEndpoint");
+        if (symbolAddress != nullptr)
+            HcnOpenEndpoint = (decltype(&::HcnOpenEndpoint))symbolAddress;
+
+        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnModifyEndpoint");
+        if (symbolAddress != nullptr)
+            HcnModifyEndpoint = (decltype(&::HcnModifyEndpoint))symbolAddress;
+
+        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnQueryEndpointProperties");
+        if (symbolAddress != nullptr)
+            HcnQueryEndpointProperties = (decltype(&::HcnQueryEndpointProperties))symbolAddress;
+
+
+        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnEnumerateNetworks");
+        if (symbolAddress != nullptr)
+            HcnEnumerateNetworks = (decltype(&::HcnEnumerateNetworks))symbolAddress;
+
+        symbolAddress = GetProcAddress((HMODULE)mComputeNetworkHandle, "HcnEnumerateEndpoints");
+        if (symbolAddress != nullptr)
+            HcnEnumerateEndpoints = (decltype(&::HcnEnumerateEndpoints))symbolAddress;
+    }
+}
+
+#pragma region Admission
+
+// Scheduling class of the HCN calls made on a thread, set with HcnPriorityScope. A start the
+// user is waiting on runs as Interactive; pool refills and bulk reprovisioning run as Bulk.
+enum class HcnPriority : uint8_t
+{
+    Interactive,
+    Normal,
+    Bulk,
+    Count,
+};
+
+const char* hcnPriorityName(HcnPriority priority)
+{
+    static constexpr const char* kNames[] = { "interactive", "normal", "bulk" };
+    static_assert(std::size(kNames) == static_cast<size_t>(HcnPriority::Count));
+    return kNames[static_cast<size_t>(priority)];
+}
+
+// Runs the HCN calls made on this thread in the given class until the scope ends.
+class HcnPriorityScope
+{
+public:
+    explicit HcnPriorityScope(HcnPriority priority) : mPrevious(mCurrent) { mCurrent = priority; }
+    ~HcnPriorityScope() { mCurrent = mPrevious; }
+
+    HcnPriorityScope(const HcnPriorityScope&) = delete;
+    HcnPriorityScope& operator=(const HcnPriorityScope&) = delete;
+
+    static HcnPriority current() { return mCurrent; }
+
+private:
+    static inline thread_local HcnPriority mCurrent = HcnPriority::Normal;
+    HcnPriority mPrevious;
+};
+
+// Gate in front of every VmmgrHypervApi call. A token bucket bounds the call rate and an
+// in-flight limit bounds concurrency; the limit is adapted AIMD-style from observed latency:
+// it grows by 1/limit per fast call and is halved (at most once per target interval) when a
+// call exceeds the latency target.
+//
+// Queued calls wait in one FIFO per class and are admitted in priority order. A waiter is
+// promoted one class per agingStep it has waited, so a steady stream of interactive calls
+// delays bulk work by a bounded amount instead of starving it. Only the queue heads are
+// ranked, and only the waiter whose turn it is gets woken, so a release costs O(classes)
+// however many calls are queued.
+class HcnAdmission
+{
+public:
+    struct Options
+    {
+        double tokensPerSecond = 50.0;
+        double burst = 10.0;
+        double initialLimit = 8.0;
+        double minLimit = 1.0;
+        double maxLimit = 64.0;
+        std::chrono::milliseconds latencyTarget{ 200 };
+        bool prioritize = true;
+        std::chrono::milliseconds agingStep{ 1000 };
+    };
+
+    struct ClassStats
+    {
+        uint64_t admitted = 0;
+        uint64_t aged = 0;      // admitted ahead of their class after being promoted
+        double totalWaitMs = 0.0;
+        double maxWaitMs = 0.0;
+        double p99WaitMs = 0.0;
+        double totalLatencyMs = 0.0;
+    };
+
+    struct Stats
+    {
+        uint64_t admitted = 0;
+        size_t queueDepth = 0;
+        size_t maxQueueDepth = 0;
+        size_t inFlight = 0;
+        double inFlightLimit = 0.0;
+        double totalWaitMs = 0.0;
+        double maxWaitMs = 0.0;
+        uint64_t decreases = 0;
+        ClassStats classes[static_cast<size_t>(HcnPriority::Count)];
+    };
+
+    static HcnAdmission& instance();
+
+    void configure(const Options& options);
+    void setEnabled(bool enabled) { mEnabled = enabled; }
+    Stats stats();
+
+    template<typename Fn>
+    HRESULT run(Fn&& fn)
+    {
+        if (!mEnabled)
+            return fn();
+
+        HcnPriority priority = HcnPriorityScope::current();
+        acquire(priority);
+        auto start = std::chrono::steady_clock::now();
+        HRESULT result = fn();
+        release(priority, std::chrono::steady_clock::now() - start);
+        return result;
+    }
+
+private:
+    static constexpr size_t kWaitSamples = 4096;
+
+    struct Waiter
+    {
+        HcnPriority priority;
+        std::chrono::steady_clock::time_point enqueued;
+        uint64_t sequence;
+        std::condition_variable wake;
+    };
+
+    HcnAdmission() { configure(Options{}); }
+
+    void acquire(HcnPriority priority);
+    void release(HcnPriority priority, std::chrono::steady_clock::duration latency);
+    void refill(std::chrono::steady_clock::time_point now);
+    int rank(const Waiter& waiter, std::chrono::steady_clock::time_point now) const;
+    Waiter* head(std::chrono::steady_clock::time_point now) const;
+    void wakeHead(std::chrono::steady_clock::time_point now);
+
+    std::atomic<bool> mEnabled{ true };
+    std::mutex mMutex;
+    Options mOptions;
+    Stats mStats;
+    std::deque<Waiter*> mQueues[static_cast<size_t>(HcnPriority::Count)];
+    uint64_t mSequence = 0;
+    std::vector<double> mWaitSamples[static_cast<size_t>(HcnPriority::Count)];
+    double mTokens = 0.0;
+    std::chrono::steady_clock::time_point mLastRefill = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point mLastDecrease{};
+};
+
+HcnAdmission& HcnAdmission::instance()
+{
+    static HcnAdmission admission;
+    return admission;
+}
+
+void HcnAdmission::configure(const Options& options)
+{
+    std::scoped_lock lock(mMutex);
+    mOptions = options;
+    mTokens = options.burst;
+    mStats = Stats{ .queueDepth = mStats.queueDepth, .inFlight = mStats.inFlight, .inFlightLimit = options.initialLimit };
+    for (std::vector<double>& samples : mWaitSamples)
+        samples.clear();
+    mLastRefill = std::chrono::steady_clock::now();
+}
+
+HcnAdmission::Stats HcnAdmission::stats()
+{
+    std::scoped_lock lock(mMutex);
+    Stats stats = mStats;
+    for (size_t i = 0; i < std::size(stats.classes); ++i)
+        stats.classes[i].p99WaitMs = xpercentile(mWaitSamples[i], 99);
+    return stats;
+}
+
+// Lower is admitted first. Each agingStep spent waiting promotes the waiter by one class.
+int HcnAdmission::rank(const Waiter& waiter, std::chrono::steady_clock::time_point now) const
+{
+    if (!mOptions.prioritize)
+        return 0;
+
+    auto promotions = (now - waiter.enqueued) / mOptions.agingStep;
+    return std::max(0, static_cast<int>(waiter.priority) - static_cast<int>(promotions));
+}
+
+// The waiter whose turn it is: the best-ranked queue head, oldest first among equal ranks.
+// Aging never reorders a class, so no waiter behind a head can outrank it.
+HcnAdmission::Waiter* HcnAdmission::head(std::chrono::steady_clock::time_point now) const
+{
+    Waiter* best = nullptr;
+    int bestRank = 0;
+    for (const std::deque<Waiter*>& queue : mQueues)
+    {
+        if (queue.empty())
+            continue;
+
+        int theirs = rank(*queue.front(), now);
+        if (best == nullptr || theirs < bestRank || (theirs == bestRank && queue.front()->sequence < best->sequence))
+        {
+            best = queue.front();
+            bestRank = theirs;
+        }
+    }
+    return best;
+}
+
+// Called with mMutex held, so the waiter cannot leave its queue before it is notified.
+void HcnAdmission::wakeHead(std::chrono::steady_clock::time_point now)
+{
+    if (Waiter* next = head(now))
+        next->wake.notify_one();
+}
+
+void HcnAdmission::refill(std::chrono::steady_clock::time_point now)
+{
+    double elapsed = std::chrono::duration<double>(now - mLastRefill).count();
+    mTokens = std::min(mOptions.burst, mTokens + elapsed * mOptions.tokensPerSecond);
+    mLastRefill = now;
+}
+
+void HcnAdmission::acquire(HcnPriority priority)
+{
+    std::unique_lock lock(mMutex);
+    auto enqueued = std::chrono::steady_clock::now();
+    Waiter waiter{ priority, enqueued, mSequence++ };
+    std::deque<Waiter*>& queue = mQueues[mOptions.prioritize ? static_cast<size_t>(priority) : 0];
+    queue.push_back(&waiter);
+    mStats.maxQueueDepth = std::max(mStats.maxQueueDepth, ++mStats.queueDepth);
+
+    std::chrono::steady_clock::time_point now;
+    for (;;)
+    {
+        now = std::chrono::steady_clock::now();
+        refill(now);
+
+        // Only the head waits for capacity or a token. Everyone else sleeps until a release,
+        // an admission or a token wait hands them the turn; a waiter that wakes to find the
+        // turn has moved on (aging can reorder heads) passes the wakeup along.
+        bool slotFree = mStats.inFlight < static_cast<size_t>(mStats.inFlightLimit);
+        Waiter* next = head(now);
+        if (next == &waiter && slotFree && mTokens >= 1.0)
+            break;
+
+        if (next != &waiter)
+        {
+            if (slotFree)
+                next->wake.notify_one();
+            waiter.wake.wait(lock);
+        }
+        else if (slotFree)
+        {
+            auto untilToken = std::chrono::duration<double>((1.0 - mTokens) / mOptions.tokensPerSecond);
+            waiter.wake.wait_until(lock, now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(untilToken));
+        }
+        else
+        {
+            waiter.wake.wait(lock);
+        }
+    }
+
+    ClassStats& stats = mStats.classes[static_cast<size_t>(priority)];
+    if (mOptions.prioritize && rank(waiter, now) < static_cast<int>(priority))
+        stats.aged++;
+    queue.pop_front();
+
+    mTokens -= 1.0;
+    mStats.inFlight++;
+    mStats.queueDepth--;
+    mStats.admitted++;
+
+    double waitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - enqueued).count();
+    mStats.totalWaitMs += waitMs;
+    mStats.maxWaitMs = std::max(mStats.maxWaitMs, waitMs);
+
+    std::vector<double>& samples = mWaitSamples[static_cast<size_t>(priority)];
+    if (samples.size() < kWaitSamples)
+        samples.push_back(waitMs);
+    else
+        samples[stats.admitted % kWaitSamples] = waitMs;
+    stats.admitted++;
+    stats.totalWaitMs += waitMs;
+    stats.maxWaitMs = std::max(stats.maxWaitMs, waitMs);
+
+    // The next waiter in line may fit in the capacity that is still free.
+    if (mStats.inFlight < static_cast<size_t>(mStats.inFlightLimit))
+        wakeHead(now);
+}
+
+void HcnAdmission::release(HcnPriority priority, std::chrono::steady_clock::duration latency)
+{
+    {
+        std::scoped_lock lock(mMutex);
+        mStats.inFlight--;
+        mStats.classes[static_cast<size_t>(priority)].totalLatencyMs += std::chrono::duration<double, std::milli>(latency).count();
+
+        auto now = std::chrono::steady_clock::now();
+        if (latency > mOptions.latencyTarget)
+        {
+            if (now - mLastDecrease > mOptions.latencyTarget)
+            {
+                mStats.inFlightLimit = std::max(mOptions.minLimit, mStats.inFlightLimit / 2.0);
+                mStats.decreases++;
+                mLastDecrease = now;
+            }
+        }
+        else
+        {
+            mStats.inFlightLimit = std::min(mOptions.maxLimit, mStats.inFlightLimit + 1.0 / mStats.inFlightLimit);
+        }
+        wakeHead(now);
+    }
+}
+
+void printAdmissionStats()
+{
+    HcnAdmission::Stats stats = HcnAdmission::instance().stats();
+    std::cout << std::format("Admission: admitted {}, queueDepth {}, maxQueueDepth {}, inFlightLimit {:.2f}, avgWaitMs {:.2f}, maxWaitMs {:.2f}, decreases {}\n",
+        stats.admitted, stats.queueDepth, stats.maxQueueDepth, stats.inFlightLimit,
+        stats.admitted ? stats.totalWaitMs / stats.admitted : 0.0, stats.maxWaitMs, stats.decreases);
+
+    for (size_t i = 0; i < std::size(stats.classes); ++i)
+    {
+        const HcnAdmission::ClassStats& priority = stats.classes[i];
+        if (priority.admitted == 0 || priority.admitted == stats.admitted)
+            continue;
+        std::cout << std::format("Admission[{}]: admitted {}, aged {}, avgWaitMs {:.2f}, p99WaitMs {:.2f}, maxWaitMs {:.2f}, avgLatencyMs {:.2f}\n",
+            hcnPriorityName(static_cast<HcnPriority>(i)), priority.admitted, priority.aged, priority.totalWaitMs / priority.admitted,
+            priority.p99WaitMs, priority.maxWaitMs, priority.totalLatencyMs / priority.admitted);
+    }
+}
+
+#pragma endregion
+
+#pragma region Trace
+
+enum class HcnCall : uint16_t
+{
+    OpenNetwork,
+    CreateNetwork,
+    OpenEndpoint,
+    CreateEndpoint,
+    DeleteEndpoint,
+    ModifyEndpoint,
+    QueryEndpointProperties,
+    EnumerateNetworks,
+    EnumerateEndpoints,
+    DeleteNetwork,
+    Count,
+};
+
+const char* hcnCallName(HcnCall call)
+{
+    static constexpr const char* kNames[] = {
+        "HcnOpenNetwork",
+        "HcnCreateNetwork",
+        "HcnOpenEndpoint",
+        "HcnCreateEndpoint",
+        "HcnDeleteEndpoint",
+        "HcnModifyEndpoint",
+        "HcnQueryEndpointProperties",
+        "HcnEnumerateNetworks",
+        "HcnEnumerateEndpoints",
+        "HcnDeleteNetwork",
+    };
+    static_assert(std::size(kNames) == static_cast<size_t>(HcnCall::Count));
+
+    size_t index = static_cast<size_t>(call);
+    return index < std::size(kNames) ? kNames[index] : "(unknown)";
+}
+
+struct HcnTraceHeader
+{
+    static constexpr uint64_t kMagic = 0x3130454341525448ull; // "HTRACE01"
+    static constexpr uint32_t kVersion = 2;
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t capacity;
+    uint64_t next;
+    uint64_t runs;          // processes that have opened the file
+    uint8_t reserved[24];
+};
+static_assert(sizeof(HcnTraceHeader) == 64);
+
+struct HcnTraceRecord
+{
+    uint64_t sequence;      // 1-based; 0 marks an empty or partially written slot
+    uint64_t startNs;       // system clock, ns since the Unix epoch
+    uint64_t durationNs;
+    uint64_t settingsHash;  // JsonHash digest of the settings document, 0 when there is none
+    GUID id;
+    int32_t result;
+    uint16_t call;
+    uint16_t run;           // low bits of the header's runs when the record was written
+    uint16_t reserved[4];
+};
+static_assert(sizeof(HcnTraceRecord) == 64);
+
+// Always-on binary trace of host calls, kept in a memory-mapped ring buffer so that writing
+// a record is a slot reservation plus a 64-byte store, and the trace survives a crash. The
+// file is reused across runs and shared by concurrent ones, which reserve slots from the same
+// atomic cursor; a valid file keeps its capacity even when a different one is asked for, so a
+// second start never wipes a ring the first is writing. Every record carries the run that
+// wrote it, so the idle time between runs can be told apart from gaps within one.
+class HcnTrace
+{
+public:
+    static HcnTrace& instance();
+
+    bool open(const std::filesystem::path& path, uint64_t capacity);
+    void record(HcnCall call, const GUID& id, uint64_t settingsHash, HRESULT result,
+        std::chrono::system_clock::time_point start, std::chrono::nanoseconds duration);
+
+    static std::vector<HcnTraceRecord> read(const std::filesystem::path& path);
+
+private:
+    wil::unique_hfile mFile;
+    wil::unique_handle mMapping;
+    wil::unique_mapview_ptr<void> mView;
+    HcnTraceHeader* mHeader = nullptr;
+    HcnTraceRecord* mRecords = nullptr;
+    uint16_t mRun = 0;
+};
+
+HcnTrace& HcnTrace::instance()
+{
+    static HcnTrace trace;
+    return trace;
+}
+
+bool HcnTrace::open(const std::filesystem::path& path, uint64_t capacity)
+{
+    if (capacity == 0)
+    {
+        std::cout << std::format("{}: trace capacity must be at least 1 record: filePath {}\n", __func__, path.string());
+        return false;
+    }
+
+    mFile.reset(CreateFileW(path.wstring().c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!mFile)
+    {
+        std::cout << std::format("{}: failed to open trace file: filePath {}, error {}\n", __func__, path.string(), GetLastError());
+        return false;
+    }
+
+    HcnTraceHeader existing{};
+    DWORD read = 0;
+    bool valid = ReadFile(mFile.get(), &existing, sizeof(existing), &read, nullptr) && read == sizeof(existing) &&
+        existing.magic == HcnTraceHeader::kMagic && existing.version == HcnTraceHeader::kVersion &&
+        existing.recordSize == sizeof(HcnTraceRecord) && existing.capacity != 0;
+    if (valid && existing.capacity != capacity)
+    {
+        std::cout << std::format("{}: keeping the existing trace capacity {} instead of {}; delete the file to resize it: filePath {}\n",
+            __func__, existing.capacity, capacity, path.string());
+        capacity = existing.capacity;
+    }
+    uint64_t bytes = sizeof(HcnTraceHeader) + capacity * sizeof(HcnTraceRecord);
+
+    mMapping.reset(CreateFileMappingW(mFile.get(), nullptr, PAGE_READWRITE, static_cast<DWORD>(bytes >> 32), static_cast<DWORD>(bytes), nullptr));
+    if (mMapping)
+        mView.reset(MapViewOfFile(mMapping.get(), FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(bytes)));
+    if (!mView)
+    {
+        std::cout << std::format("{}: failed to map trace file: filePath {}, error {}\n", __func__, path.string(), GetLastError());
+        mMapping.reset();
+        mFile.reset();
+        return false;
+    }
+
+    auto header = static_cast<HcnTraceHeader*>(mView.get());
+    if (!valid)
+    {
+        memset(mView.get(), 0, static_cast<size_t>(bytes));
+        header->magic = HcnTraceHeader::kMagic;
+        header->version = HcnTraceHeader::kVersion;
+        header->recordSize = sizeof(HcnTraceRecord);
+        header->capacity = capacity;
+    }
+
+    mRun = static_cast<uint16_t>(std::atomic_ref(header->runs).fetch_add(1, std::memory_order_relaxed) + 1);
+    mRecords = reinterpret_cast<HcnTraceRecord*>(header + 1);
+    mHeader = header;
+    return true;
+}
+
+void HcnTrace::record(HcnCall call, const GUID& id, uint64_t settingsHash, HRESULT result,
+    std::chrono::system_clock::time_point start, std::chrono::nanoseconds duration)
+{
+    if (mHeader == nullptr)
+        return;
+
+    uint64_t index = std::atomic_ref(mHeader->next).fetch_add(1, std::memory_order_relaxed);
+    HcnTraceRecord& slot = mRecords[index % mHeader->capacity];
+
+    std::atomic_ref(slot.sequence).store(0, std::memory_order_relaxed);
+    slot.startNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count());
+    slot.durationNs = static_cast<uint64_t>(duration.count());
+    slot.settingsHash = settingsHash;
+    slot.id = id;
+    slot.result = result;
+    slot.call = static_cast<uint16_t>(call);
+    slot.run = mRun;
+    std::atomic_ref(slot.sequence).store(index + 1, std::memory_order_release);
+}
+
+std::vector<HcnTraceRecord> HcnTrace::read(const std::filesystem::path& path)
+{
+    std::vector<HcnTraceRecord> records;
+    std::ifstream ifs(path, std::ios::binary);
+
+    HcnTraceHeader header{};
+    if (!ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != HcnTraceHeader::kMagic || header.recordSize != sizeof(HcnTraceRecord))
+    {
+        std::cout << std::format("{}: not a trace file: filePath {}\n", __func__, path.string());
+        return records;
+    }
+
+    records.resize(static_cast<size_t>(header.capacity));
+    ifs.read(reinterpret_cast<char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(HcnTraceRecord)));
+    records.resize(static_cast<size_t>(ifs.gcount()) / sizeof(HcnTraceRecord));
+
+    std::erase_if(records, [](const HcnTraceRecord& record) { return record.sequence == 0; });
+    std::sort(records.begin(), records.end(), [](const auto& a, const auto& b) { return a.sequence < b.sequence; });
+    return records;
+}
+
+#pragma endregion
+
+#pragma region Journal
+
+struct HcnJournalRecord
+{
+    enum Kind : uint8_t
+    {
+        Intent,
+        Complete,
+    };
+
+    uint64_t txn;
+    uint64_t settingsHash;
+    GUID id;
+    int32_t result;
+    uint16_t call;
+    uint8_t kind;
+    uint8_t reserved;
+    uint64_t checksum;      // xhash64 of the preceding fields; a mismatch marks a torn tail
+
+    uint64_t computeChecksum() const { return xhash64(this, offsetof(HcnJournalRecord, checksum)); }
+};
+static_assert(sizeof(HcnJournalRecord) == 48);
+
+// Append-only log of the HCN mutations this process intends to make and has made. An intent
+// record is durable before its call is issued and a completion record before the call's
+// result is returned; otherwise a crash right after a successful create would leave the
+// intent open and recovery would delete a live endpoint. Concurrent writers share flushes
+// (group commit): whoever finds no flush running writes and flushes everything pending,
+// intents and completions alike, and the others wait for it. On startup the journal is
+// scanned once, in-flight intents are resolved, and the file is truncated.
+class HcnJournal
+{
+public:
+    struct Stats
+    {
+        uint64_t records = 0;
+        uint64_t flushes = 0;
+        uint64_t maxBatch = 0;
+        uint64_t writeFailures = 0;
+    };
+
+    struct Scan
+    {
+        size_t records = 0;
+        bool torn = false;
+        std::vector<HcnJournalRecord> inFlight;
+    };
+
+    static bool mutates(HcnCall call);
+    static Scan scan(const std::filesystem::path& path);
+
+    explicit HcnJournal(const std::filesystem::path& path, bool groupCommit = true);
+    ~HcnJournal();
+
+    uint64_t begin(HcnCall call, const GUID& id, uint64_t settingsHash);
+    void complete(uint64_t txn, HRESULT result);
+    Stats stats();
+
+private:
+    void append(HcnJournalRecord record);
+    bool write(const std::vector<HcnJournalRecord>& batch);
+    void recordFlush(size_t records, bool ok);
+
+    wil::unique_hfile mFile;
+    bool mGroupCommit;
+    std::atomic<uint64_t> mNextTxn{ 1 };
+
+    std::mutex mMutex;
+    std::condition_variable mFlushed;
+    std::vector<HcnJournalRecord> mPending;
+    uint64_t mAppended = 0;
+    uint64_t mDurable = 0;
+    bool mFlushing = false;
+    Stats mStats;
+};
+
+bool HcnJournal::mutates(HcnCall call)
+{
+    return call == HcnCall::CreateNetwork || call == HcnCall::CreateEndpoint ||
+        call == HcnCall::DeleteEndpoint || call == HcnCall::ModifyEndpoint || call == HcnCall::DeleteNetwork;
+}
+
+HcnJournal::Scan HcnJournal::scan(const std::filesystem::path& path)
+{
+    Scan scan;
+    std::ifstream ifs(path, std::ios::binary);
+    std::unordered_map<uint64_t, HcnJournalRecord> open;
+
+    HcnJournalRecord record;
+    while (ifs.read(reinterpret_cast<char*>(&record), sizeof(record)))
+    {
+        if (record.checksum != record.computeChecksum())
+        {
+            scan.torn = true;
+            break;
+        }
+
+        scan.records++;
+        if (record.kind == HcnJournalRecord::Intent)
+            open.emplace(record.txn, record);
+        else
+            open.erase(record.txn);
+    }
+    scan.torn |= ifs.gcount() != 0;
+
+    scan.inFlight.reserve(open.size());
+    for (auto& [txn, intent] : open)
+        scan.inFlight.push_back(intent);
+    std::sort(scan.inFlight.begin(), scan.inFlight.end(), [](const auto& a, const auto& b) { return a.txn < b.txn; });
+    return scan;
+}
+
+HcnJournal::HcnJournal(const std::filesystem::path& path, bool groupCommit)
+    : mGroupCommit(groupCommit)
+{
+    mFile.reset(CreateFileW(path.wstring().c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!mFile)
+        std::cout << std::format("{}: failed to create journal: filePath {}, error {}\n", __func__, path.string(), GetLastError());
+}
+
+HcnJournal::~HcnJournal()
+{
+    std::scoped_lock lock(mMutex);
+    if (!mPending.empty())
+        recordFlush(mPending.size(), write(mPending));
+}
+
+uint64_t HcnJournal::begin(HcnCall call, const GUID& id, uint64_t settingsHash)
+{
+    HcnJournalRecord record{};
+    record.txn = mNextTxn++;
+    record.settingsHash = settingsHash;
+    record.id = id;
+    record.call = static_cast<uint16_t>(call);
+    record.kind = HcnJournalRecord::Intent;
+    append(record);
+    return record.txn;
+}
+
+void HcnJournal::complete(uint64_t txn, HRESULT result)
+{
+    HcnJournalRecord record{};
+    record.txn = txn;
+    record.result = result;
+    record.kind = HcnJournalRecord::Complete;
+    append(record);
+}
+
+HcnJournal::Stats HcnJournal::stats()
+{
+    std::scoped_lock lock(mMutex);
+    return mStats;
+}
+
+void HcnJournal::append(HcnJournalRecord record)
+{
+    record.checksum = record.computeChecksum();
+
+    std::unique_lock lock(mMutex);
+    mPending.push_back(record);
+    uint64_t ticket = ++mAppended;
+
+    if (!mGroupCommit)
+    {
+        recordFlush(mPending.size(), write(mPending));
+        mPending.clear();
+        mDurable = ticket;
+        return;
+    }
+
+    while (mDurable < ticket)
+    {
+        if (mFlushing)
+        {
+            mFlushed.wait(lock);
+            continue;
+        }
+
+        std::vector<HcnJournalRecord> batch;
+        batch.swap(mPending);
+        uint64_t upTo = mAppended;
+        mFlushing = true;
+
+        lock.unlock();
+        bool ok = write(batch);
+        lock.lock();
+
+        recordFlush(batch.size(), ok);
+        mFlushing = false;
+        mDurable = upTo;
+        mFlushed.notify_all();
+    }
+}
+
+bool HcnJournal::write(const std::vector<HcnJournalRecord>& batch)
+{
+    if (!mFile)
+        return false;
+
+    DWORD written = 0;
+    DWORD bytes = static_cast<DWORD>(batch.size() * sizeof(HcnJournalRecord));
+    return WriteFile(mFile.get(), batch.data(), bytes, &written, nullptr) && written == bytes && FlushFileBuffers(mFile.get());
+}
+
+// Called with mMutex held.
+void HcnJournal::recordFlush(size_t records, bool ok)
+{
+    mStats.records += records;
+    mStats.flushes++;
+    mStats.maxBatch = std::max<uint64_t>(mStats.maxBatch, records);
+    mStats.writeFailures += !ok;
+}
+
+#pragma endregion
+
+std::unique_ptr<HcnJournal> mHcnJournal;
+
+// Returned by HcnDeadline for a call that did not return within its deadline, and for a call
+// not attempted because the start it belongs to had already run out of time.
+const HRESULT kHcnDeadlineExceeded = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+const HRESULT kHcnCancelled = HRESULT_FROM_WIN32(ERROR_CANCELLED);
+
+// Bounds the calling thread's HCN calls by an absolute time, typically the budget for one
+// start. A call made once the budget is spent fails with kHcnCancelled without reaching the
+// host, so the steps that depend on a timed-out call give up immediately.
+class HcnDeadlineScope
+{
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    explicit HcnDeadlineScope(time_point deadline) : mPrevious(mCurrent) { mCurrent = std::min(mPrevious, deadline); }
+    ~HcnDeadlineScope() { mCurrent = mPrevious; }
+
+    HcnDeadlineScope(const HcnDeadlineScope&) = delete;
+    HcnDeadlineScope& operator=(const HcnDeadlineScope&) = delete;
+
+    static time_point current() { return mCurrent; }
+
+private:
+    static inline thread_local time_point mCurrent = time_point::max();
+    time_point mPrevious;
+};
+
+#pragma region Retry
+
+// What a retry can do about a failed HCN call. Busy and Unavailable come from the host
+// service itself and usually clear on their own, and in both the call was not carried out;
+// Timeout is a call whose outcome is unknown, because it missed its deadline or its RPC
+// failed after it may have reached the service; Fatal covers everything the caller has to
+// change (settings, IDs, access) and is never retried.
+enum class HcnFailure : uint8_t
+{
+    None,
+    Busy,
+    Unavailable,
+    Timeout,
+    Fatal,
+    Count,
+};
+
+const char* hcnFailureName(HcnFailure failure)
+{
+    static constexpr const char* kNames[] = { "none", "busy", "unavailable", "timeout", "fatal" };
+    static_assert(std::size(kNames) == static_cast<size_t>(HcnFailure::Count));
+    return kNames[static_cast<size_t>(failure)];
+}
+
+// Returned without calling the host while a circuit breaker is open.
+const HRESULT kHcnCircuitOpen = HRESULT_FROM_WIN32(ERROR_REQUEST_REFUSED);
+
+// Retries transient HCN failures with decorrelated jitter (each delay drawn uniformly from
+// [base, 3 * previous delay], capped) and stops calling the host at all while the recent
+// failure rate of a transient class is too high.
+//
+// Every attempt's class goes into one window of recent outcomes, and each transient class has
+// its own breaker over that window: it opens when its class makes up tripRate of a window of
+// at least minCalls, rejects calls with kHcnCircuitOpen for openFor, then lets a single probe
+// through (half-open). The probe's outcome closes or reopens it. Fatal failures never trip a
+// breaker, since they say nothing about the health of the service.
+class HcnRetry
+{
+public:
+    struct Options
+    {
+        size_t maxAttempts = 4;
+        std::chrono::milliseconds baseDelay{ 50 };
+        std::chrono::milliseconds maxDelay{ 2000 };
+        size_t window = 50;
+        size_t minCalls = 20;
+        double tripRate = 0.8;
+        std::chrono::milliseconds openFor{ 5000 };
+    };
+
+    enum class BreakerState : uint8_t
+    {
+        Closed,
+        Open,
+        HalfOpen,
+    };
+
+    struct BreakerStats
+    {
+        BreakerState state = BreakerState::Closed;
+        uint64_t opens = 0;
+        double failureRate = 0.0;
+    };
+
+    struct Stats
+    {
+        uint64_t calls = 0;
+        uint64_t attempts = 0;
+        uint64_t retries = 0;
+        uint64_t recovered = 0;     // succeeded after at least one retry
+        uint64_t exhausted = 0;     // still failing transiently when retries ran out
+        uint64_t fatal = 0;
+        uint64_t rejected = 0;      // refused by an open breaker
+        BreakerStats breakers[static_cast<size_t>(HcnFailure::Count)];
+    };
+
+    static HcnRetry& instance();
+    static HcnFailure classify(HRESULT result);
+    static bool retryable(HcnCall call, HcnFailure failure);
+    static const char* stateName(BreakerState state);
+
+    void configure(const Options& options);
+    void setEnabled(bool enabled) { mEnabled = enabled; }
+    Stats stats();
+
+    // classifier maps each attempt's result to its failure class; hcnInvoke reads the call's
+    // error record there, whose ErrorCode can be more specific than the returned HRESULT.
+    template<typename Fn, typename Classifier>
+    HRESULT run(HcnCall call, Fn&& fn, Classifier&& classifier)
+    {
+        if (!mEnabled)
+        {
+            HRESULT result = fn();
+            classifier(result);
+            return result;
+        }
+        if (!admit())
+            return kHcnCircuitOpen;
+
+        std::chrono::milliseconds delay = mOptions.baseDelay;
+        for (size_t attempt = 1;; ++attempt)
+        {
+            HRESULT result = fn();
+            HcnFailure failure = classifier(result);
+            record(failure, attempt);
+            if (failure == HcnFailure::None || !retryable(call, failure) || attempt == mOptions.maxAttempts)
+                return result;
+
+            // No retry that would outlive the start's budget or go through an open breaker.
+            delay = nextDelay(delay);
+            if (std::chrono::steady_clock::now() + delay >= HcnDeadlineScope::current() || !admit())
+                return result;
+            std::this_thread::sleep_for(delay);
+        }
+    }
+
+private:
+    struct Breaker
+    {
+        BreakerState state = BreakerState::Closed;
+        std::chrono::steady_clock::time_point openedAt;
+        uint64_t opens = 0;
+    };
+
+    static constexpr size_t kClasses = static_cast<size_t>(HcnFailure::Count);
+
+    HcnRetry() { configure(Options{}); }
+
+    bool admit();
+    void record(HcnFailure failure, size_t attempt);
+    std::chrono::milliseconds nextDelay(std::chrono::milliseconds previous);
+    static bool transient(size_t failure) { return failure != 0 && failure != static_cast<size_t>(HcnFailure::Fatal); }
+
+    std::atomic<bool> mEnabled{ true };
+    std::mutex mMutex;
+    Options mOptions;
+    Stats mStats;
+    Breaker mBreakers[kClasses];
+    std::vector<HcnFailure> mWindow;
+    size_t mWindowNext = 0;
+    size_t mWindowCounts[kClasses] = {};
+};
+
+HcnRetry& HcnRetry::instance()
+{
+    static HcnRetry retry;
+    return retry;
+}
+
+HcnFailure HcnRetry::classify(HRESULT result)
+{
+    if (SUCCEEDED(result))
+        return HcnFailure::None;
+    if (result == HRESULT_FROM_WIN32(ERROR_BUSY) || result == HRESULT_FROM_WIN32(ERROR_RETRY) ||
+        result == HRESULT_FROM_WIN32(RPC_S_SERVER_TOO_BUSY) || result == RPC_E_SERVERCALL_RETRYLATER || result == E_PENDING)
+        return HcnFailure::Busy;
+    if (result == HRESULT_FROM_WIN32(RPC_S_SERVER_UNAVAILABLE) || result == HRESULT_FROM_WIN32(RPC_S_CALL_FAILED_DNE) ||
+        result == HRESULT_FROM_WIN32(ERROR_SERVICE_NOT_ACTIVE))
+        return HcnFailure::Unavailable;
+    if (result == kHcnDeadlineExceeded || result == HRESULT_FROM_WIN32(WAIT_TIMEOUT) || result == HRESULT_FROM_WIN32(RPC_S_CALL_FAILED))
+        return HcnFailure::Timeout;
+    return HcnFailure::Fatal;
+}
+
+// A mutation that timed out or whose RPC failed midway may still be applied by the host, so
+// repeating it could apply it twice; only reads are retried after a timeout.
+bool HcnRetry::retryable(HcnCall call, HcnFailure failure)
+{
+    switch (failure)
+    {
+    case HcnFailure::Busy:
+    case HcnFailure::Unavailable:
+        return true;
+    case HcnFailure::Timeout:
+        return !HcnJournal::mutates(call);
+    default:
+        return false;
+    }
+}
+
+const char* HcnRetry::stateName(BreakerState state)
+{
+    switch (state)
+    {
+    case BreakerState::Closed: return "closed";
+    case BreakerState::Open: return "open";
+    default: return "half-open";
+    }
+}
+
+void HcnRetry::configure(const Options& options)
+{
+    std::scoped_lock lock(mMutex);
+    mOptions = options;
+    mStats = Stats{};
+    std::fill(std::begin(mBreakers), std::end(mBreakers), Breaker{});
+    mWindow.clear();
+    mWindowNext = 0;
+    std::fill(std::begin(mWindowCounts), std::end(mWindowCounts), 0);
+}
+
+HcnRetry::Stats HcnRetry::stats()
+{
+    std::scoped_lock lock(mMutex);
+    Stats stats = mStats;
+    for (size_t i = 0; i < kClasses; ++i)
+    {
+        stats.breakers[i].state = mBreakers[i].state;
+        stats.breakers[i].opens = mBreakers[i].opens;
+        stats.breakers[i].failureRate = mWindow.empty() ? 0.0 : static_cast<double>(mWindowCounts[i]) / mWindow.size();
+    }
+    return stats;
+}
+
+bool HcnRetry::admit()
+{
+    std::scoped_lock lock(mMutex);
+    auto now = std::chrono::steady_clock::now();
+    bool allowed = true;
+    for (size_t i = 0; i < kClasses; ++i)
+    {
+        Breaker& breaker = mBreakers[i];
+        if (breaker.state == BreakerState::Open && now - breaker.openedAt >= mOptions.openFor && allowed)
+        {
+            breaker.state = BreakerState::HalfOpen;     // this caller is the probe
+            continue;
+        }
+        if (breaker.state != BreakerState::Closed)
+            allowed = false;
+    }
+
+    mStats.rejected += !allowed;
+    return allowed;
+}
+
+void HcnRetry::record(HcnFailure failure, size_t attempt)
+{
+    std::scoped_lock lock(mMutex);
+    size_t index = static_cast<size_t>(failure);
+    mStats.calls += attempt == 1;
+    mStats.attempts++;
+    mStats.retries += attempt > 1;
+    mStats.recovered += failure == HcnFailure::None && attempt > 1;
+    mStats.exhausted += transient(index) && attempt == mOptions.maxAttempts;
+    mStats.fatal += failure == HcnFailure::Fatal;
+
+    if (mWindow.size() < mOptions.window)
+    {
+        mWindow.push_back(failure);
+    }
+    else
+    {
+        mWindowCounts[static_cast<size_t>(mWindow[mWindowNext])]--;
+        mWindow[mWindowNext] = failure;
+        mWindowNext = (mWindowNext + 1) % mOptions.window;
+    }
+    mWindowCounts[index]++;
+
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kClasses; ++i)
+    {
+        Breaker& breaker = mBreakers[i];
+        if (breaker.state == BreakerState::HalfOpen)
+        {
+            // The probe decides: the same class again reopens, anything else closes and
+            // starts a fresh window so the outage does not immediately trip it again.
+            if (index == i)
+            {
+                breaker.state = BreakerState::Open;
+                breaker.openedAt = now;
+                breaker.opens++;
+            }
+            else
+            {
+                breaker.state = BreakerState::Closed;
+                mWindow.clear();
+                mWindowNext = 0;
+                std::fill(std::begin(mWindowCounts), std::end(mWindowCounts), 0);
+            }
+        }
+        else if (breaker.state == BreakerState::Closed && transient(i) && mWindow.size() >= mOptions.minCalls &&
+            mWindowCounts[i] >= mOptions.tripRate * mWindow.size())
+        {
+            breaker.state = BreakerState::Open;
+            breaker.openedAt = now;
+            breaker.opens++;
+        }
+    }
+}
+
+std::chrono::milliseconds HcnRetry::nextDelay(std::chrono::milliseconds previous)
+{
+    thread_local std::mt19937_64 engine{ std::random_device{}() };
+    int64_t low = mOptions.baseDelay.count();
+    int64_t high = std::max(low, previous.count() * 3);
+    return std::min(mOptions.maxDelay, std::chrono::milliseconds(std::uniform_int_distribution<int64_t>(low, high)(engine)));
+}
+
+void printRetryStats()
+{
+    HcnRetry::Stats stats = HcnRetry::instance().stats();
+    std::string breakers;
+    for (size_t i = 0; i < std::size(stats.breakers); ++i)
+    {
+        const HcnRetry::BreakerStats& breaker = stats.breakers[i];
+        if (breaker.opens != 0 || breaker.state != HcnRetry::BreakerState::Closed)
+            breakers += std::format(", {} {} (opens {}, rate {:.2f})", hcnFailureName(static_cast<HcnFailure>(i)),
+                HcnRetry::stateName(breaker.state), breaker.opens, breaker.failureRate);
+    }
+    std::cout << std::format("Retry: calls {}, attempts {}, retries {}, recovered {}, exhausted {}, fatal {}, rejected {}{}\n",
+        stats.calls, stats.attempts, stats.retries, stats.recovered, stats.exhausted, stats.fatal, stats.rejected, breakers);
+}
+
+#pragma endregion
+
+#pragma region ErrorRecord
+
+// What an HCN error record says: the HRESULT the service put in it (or the call's own result
+// when the record has none), what a retry can do about it, and the message, interned.
+struct HcnError
+{
+    HRESULT code = S_OK;
+    HcnFailure failure = HcnFailure::None;
+    std::string_view message;
+};
+
+// The error record an HCN call hands back, kept as the raw UTF-16 JSON the service wrote until
+// someone asks what it says. A successful call leaves it null, which costs nothing. hcnInvoke
+// decodes every failed attempt, with or without a record, so the retry classifies it by the
+// record's ErrorCode and the stats count every failure. decode() reads a record once and
+// keeps the result; messages are interned so that a host failing the
+// same way over and over holds one copy, up to kMaxInterned distinct ones, and a message seen
+// before is decoded without allocating.
+class HcnErrorRecord
+{
+public:
+    static constexpr size_t kMaxInterned = 1024;
+
+    struct Stats
+    {
+        uint64_t decoded = 0;       // failed calls, with or without a record
+        uint64_t interned = 0;      // distinct messages held
+        uint64_t internHits = 0;    // decodes that reused one
+        uint64_t byFailure[static_cast<size_t>(HcnFailure::Count)] = {};
+    };
+
+    HcnErrorRecord() = default;
+    HcnErrorRecord(const HcnErrorRecord&) = delete;
+    HcnErrorRecord& operator=(const HcnErrorRecord&) = delete;
+
+    // Passed straight to the Hcn* functions, like the wil string it wraps.
+    PWSTR* operator&() { return put(); }
+    PWSTR* put()
+    {
+        mDecoded.reset();
+        return mRecord.put();
+    }
+
+    PCWSTR get() const { return mRecord.get(); }
+    explicit operator bool() const { return mRecord.get() != nullptr; }
+
+    const HcnError& decode(HRESULT result) const;
+    std::string describe(HRESULT result) const;
+
+    static Stats stats();
+
+private:
+    struct StringHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view text) const noexcept { return std::hash<std::string_view>{}(text); }
+    };
+
+    static std::optional<std::wstring_view> field(std::wstring_view record, std::wstring_view name);
+    std::string_view intern(std::string_view message) const;
+
+    wil::unique_cotaskmem_string mRecord;
+    mutable std::optional<HcnError> mDecoded;
+    mutable std::string mOwned;     // the message, once the intern table is full
+
+    static inline std::mutex mMutex;
+    static inline std::unordered_set<std::string, StringHash, std::equal_to<>> mMessages;
+    static Stats mStats;
+};
+
+HcnErrorRecord::Stats HcnErrorRecord::mStats;
+
+// Returns what follows "name": in a record, or nothing when the record has no such field.
+std::optional<std::wstring_view> HcnErrorRecord::field(std::wstring_view record, std::wstring_view name)
+{
+    for (size_t at = record.find(name); at != std::wstring_view::npos; at = record.find(name, at + 1))
+    {
+        if (at == 0 || record[at - 1] != L'"' || at + name.size() >= record.size() || record[at + name.size()] != L'"')
+            continue;
+        size_t value = record.find_first_not_of(L" \t\r\n", at + name.size() + 1);
+        if (value == std::wstring_view::npos || record[value] != L':')
+            continue;
+        value = record.find_first_not_of(L" \t\r\n", value + 1);
+        if (value != std::wstring_view::npos)
+            return record.substr(value);
+    }
+    return std::nullopt;
+}
+
+// Records look like {"Success":false,"Error":"<message>","ErrorCode":<HRESULT>} and are read
+// in place; a message with escapes goes through the JSON parser, and a record without an Error
+// field is kept whole as the message.
+const HcnError& HcnErrorRecord::decode(HRESULT result) const
+{
+    if (mDecoded)
+        return *mDecoded;
+
+    HcnError error{ result, HcnFailure::None, {} };
+    if (mRecord)
+    {
+        std::wstring_view record(mRecord.get());
+        if (std::optional<std::wstring_view> code = field(record, L"ErrorCode"))
+        {
+            bool negative = !code->empty() && code->front() == L'-';
+            int64_t value = 0;
+            size_t digits = negative ? 1 : 0;
+            for (; digits < code->size() && (*code)[digits] >= L'0' && (*code)[digits] <= L'9'; ++digits)
+                value = value * 10 + ((*code)[digits] - L'0');
+            if (digits > (negative ? 1u : 0u))
+                error.code = static_cast<HRESULT>(negative ? -value : value);
+        }
+
+        std::wstring_view message = record;
+        std::optional<std::wstring_view> text = field(record, L"Error");
+        if (text && !text->empty() && text->front() == L'"')
+        {
+            size_t end = text->find_first_of(L"\"\\", 1);
+            if (end != std::wstring_view::npos && (*text)[end] == L'"')
+                message = text->substr(1, end - 1);
+        }
+
+        thread_local std::string narrow;
+        if (text && message.data() == record.data())
+        {
+            try
+            {
+                boost::json::value parsed = boost::json::parse(xstrUtf8(mRecord.get()));
+                if (const boost::json::value* value = parsed.is_object() ? parsed.as_object().if_contains("Error") : nullptr; value && value->is_string())
+                    narrow.assign(value->as_string());
+                else
+                    narrow = xstrUtf8(mRecord.get());
+            }
+            catch (std::exception&)
+            {
+                narrow = xstrUtf8(mRecord.get());
+            }
+        }
+        else
+        {
+            int length = message.empty() ? 0 : WideCharToMultiByte(CP_UTF8, 0, message.data(), static_cast<int>(message.size()), NULL, 0, NULL, NULL);
+            narrow.resize(static_cast<size_t>(length));
+            if (length > 0)
+                WideCharToMultiByte(CP_UTF8, 0, message.data(), static_cast<int>(message.size()), narrow.data(), length, NULL, NULL);
+        }
+        error.message = intern(narrow);
+    }
+    error.failure = HcnRetry::classify(error.code);
+
+    {
+        std::scoped_lock lock(mMutex);
+        mStats.decoded++;
+        mStats.byFailure[static_cast<size_t>(error.failure)]++;
+    }
+    return mDecoded.emplace(error);
+}
+
+std::string HcnErrorRecord::describe(HRESULT result) const
+{
+    if (!mRecord)
+        return "(none)";
+    const HcnError& error = decode(result);
+    return std::format("{} ({}): {}", error.code, hcnFailureName(error.failure), error.message);
+}
+
+std::string_view HcnErrorRecord::intern(std::string_view message) const
+{
+    std::scoped_lock lock(mMutex);
+    if (auto it = mMessages.find(message); it != mMessages.end())
+    {
+        mStats.internHits++;
+        return *it;
+    }
+    if (mMessages.size() < kMaxInterned)
+    {
+        mStats.interned++;
+        return *mMessages.emplace(message).first;
+    }
+    mOwned = message;
+    return mOwned;
+}
+
+HcnErrorRecord::Stats HcnErrorRecord::stats()
+{
+    std::scoped_lock lock(mMutex);
+    return mStats;
+}
+
+void printErrorRecordStats()
+{
+    HcnErrorRecord::Stats stats = HcnErrorRecord::stats();
+    if (stats.decoded == 0)
+        return;
+
+    std::string byFailure;
+    for (size_t i = 1; i < std::size(stats.byFailure); ++i)
+    {
+        if (stats.byFailure[i] != 0)
+            byFailure += std::format(", {} {}", hcnFailureName(static_cast<HcnFailure>(i)), stats.byFailure[i]);
+    }
+    std::cout << std::format("ErrorRecords: decoded {}, messages interned {}, internHits {}{}\n",
+        stats.decoded, stats.interned, stats.internHits, byFailure);
+}
+
+#pragma endregion
+
+// Runs one host call through the journal, retry, admission control and the trace recorder.
+// The recorded start and duration cover the last attempt itself, not the time spent waiting
+// for admission; the journal intent is durable before the call is attempted and its
+// completion before the result is returned.
+template<typename Fn>
+HRESULT hcnInvoke(HcnCall call, const GUID& id, uint64_t settingsHash, const HcnErrorRecord* errorRecord, Fn&& fn)
+{
+    AllocPhase phase(hcnCallName(call));
+    uint64_t txn = mHcnJournal && HcnJournal::mutates(call) ? mHcnJournal->begin(call, id, settingsHash) : 0;
+
+    std::chrono::system_clock::time_point start;
+    std::chrono::steady_clock::duration duration{};
+    HRESULT result = HcnRetry::instance().run(call, [&] {
+        return HcnAdmission::instance().run([&] {
+            start = std::chrono::system_clock::now();
+            auto begin = std::chrono::steady_clock::now();
+            HRESULT callResult = fn();
+            duration = std::chrono::steady_clock::now() - begin;
+            return callResult;
+        });
+    }, [&](HRESULT attemptResult) {
+        if (SUCCEEDED(attemptResult))
+            return HcnFailure::None;
+        return errorRecord ? errorRecord->decode(attemptResult).failure : HcnErrorRecord().decode(attemptResult).failure;
+    });
+
+    // An abandoned call may still complete on the host, so its intent stays open for recovery.
+    if (txn != 0 && result != kHcnDeadlineExceeded)
+        mHcnJournal->complete(txn, result);
+    HcnTrace::instance().record(call, id, settingsHash, result, start, duration);
+    return result;
+}
+
+// The record is the one fn passes to the Hcn* function; every attempt refills it.
+template<typename Fn>
+HRESULT hcnInvoke(HcnCall call, const GUID& id, uint64_t settingsHash, const HcnErrorRecord& errorRecord, Fn&& fn)
+{
+    return hcnInvoke(call, id, settingsHash, std::addressof(errorRecord), std::forward<Fn>(fn));
+}
+
+template<typename Fn>
+HRESULT hcnInvoke(HcnCall call, const GUID& id, uint64_t settingsHash, Fn&& fn)
+{
+    return hcnInvoke(call, id, settingsHash, nullptr, std::forward<Fn>(fn));
+}
+
+#pragma region SingleFlight
+
+// Coalesces concurrent calls that share a key: the first caller runs the function and every
+// caller that arrives while it is running waits for and receives a copy of the same result.
+template<typename Result>
+class HcnSingleFlight
+{
+public:
+    struct Stats
+    {
+        uint64_t calls = 0;
+        uint64_t executions = 0;
+        uint64_t collapsed = 0;
+    };
+
+    template<typename Fn>
+    Result run(const std::string& key, Fn&& fn)
+    {
+        std::promise<Result> promise;
+        std::shared_future<Result> future;
+        bool leader = false;
+        {
+            std::scoped_lock lock(mMutex);
+            mStats.calls++;
+            if (auto it = mCalls.find(key); it != mCalls.end())
+            {
+                mStats.collapsed++;
+                future = it->second;
+            }
+            else
+            {
+                mStats.executions++;
+                future = promise.get_future().share();
+                mCalls.emplace(key, future);
+                leader = true;
+            }
+        }
+
+        if (leader)
+        {
+            try
+            {
+                promise.set_value(fn());
+            }
+            catch (...)
+            {
+                promise.set_exception(std::current_exception());
+            }
+
+            std::scoped_lock lock(mMutex);
+            mCalls.erase(key);
+        }
+        return future.get();
+    }
+
+    Stats stats()
+    {
+        std::scoped_lock lock(mMutex);
+        return mStats;
+    }
+
+private:
+    std::mutex mMutex;
+    std::unordered_map<std::string, std::shared_future<Result>> mCalls;
+    Stats mStats;
+};
+
+#pragma endregion
+
+using unique_hcn_network = wil::unique_any < HCN_NETWORK, decltype(&::HcnCloseNetwork), [](HCN_NETWORK h) { return VmmgrHypervApi::HcnCloseNetwork(h); } >;
+using unique_hcn_endpoint = wil::unique_any < HCN_ENDPOINT, decltype(&::HcnCloseEndpoint), [](HCN_ENDPOINT h) { return VmmgrHypervApi::HcnCloseEndpoint(h); } >;
+
+#pragma region Inventory
+
+// Snapshot of the networks and endpoints that exist on the host, taken with
+// HcnEnumerateNetworks/HcnEnumerateEndpoints and indexed by GUID, so that "does it exist?"
+// is answered from memory instead of with one host call per instance. Each kind is
+// refreshed independently once its snapshot is older than the TTL, and mutations made by
+// this process are written through so the snapshot stays exact between refreshes.
+class HcnInventory
+{
+public:
+    enum class Presence
+    {
+        Unknown,
+        Present,
+        Absent,
+    };
+
+    struct Stats
+    {
+        uint64_t lookups = 0;
+        uint64_t refreshes = 0;
+        uint64_t refreshFailures = 0;
+        size_t networks = 0;
+        size_t endpoints = 0;
+    };
+
+    explicit HcnInventory(std::chrono::milliseconds ttl) : mTtl(ttl) {}
+
+    Presence network(const GUID& id) { return lookup(mNetworks, id); }
+    Presence endpoint(const GUID& id) { return lookup(mEndpoints, id); }
+    void recordNetwork(const GUID& id, bool exists) { record(mNetworks, id, exists); }
+    void recordEndpoint(const GUID& id, bool exists) { record(mEndpoints, id, exists); }
+    void invalidate();
+    Stats stats();
+
+private:
+    struct Snapshot
+    {
+        decltype(&::HcnEnumerateNetworks)* enumerate;
+        HcnCall call;
+        std::unordered_set<GUID, GuidHash> ids;
+        std::chrono::steady_clock::time_point refreshed{};
+        bool valid = false;
+    };
+
+    Presence lookup(Snapshot& snapshot, const GUID& id);
+    void record(Snapshot& snapshot, const GUID& id, bool exists);
+    bool refresh(Snapshot& snapshot);
+
+    std::chrono::milliseconds mTtl;
+    std::mutex mMutex;
+    Snapshot mNetworks{ &VmmgrHypervApi::HcnEnumerateNetworks, HcnCall::EnumerateNetworks };
+    Snapshot mEndpoints{ &VmmgrHypervApi::HcnEnumerateEndpoints, HcnCall::EnumerateEndpoints };
+    Stats mStats;
+};
+
+HcnInventory::Presence HcnInventory::lookup(Snapshot& snapshot, const GUID& id)
+{
+    std::scoped_lock lock(mMutex);
+    mStats.lookups++;
+
+    bool stale = !snapshot.valid || std::chrono::steady_clock::now() - snapshot.refreshed > mTtl;
+    if (stale && !refresh(snapshot))
+        return Presence::Unknown;
+
+    return snapshot.ids.contains(id) ? Presence::Present : Presence::Absent;
+}
+
+void HcnInventory::record(Snapshot& snapshot, const GUID& id, bool exists)
+{
+    std::scoped_lock lock(mMutex);
+    if (exists)
+        snapshot.ids.insert(id);
+    else
+        snapshot.ids.erase(id);
+}
+
+void HcnInventory::invalidate()
+{
+    std::scoped_lock lock(mMutex);
+    mNetworks.valid = false;
+    mEndpoints.valid = false;
+}
+
+// Called with mMutex held, so concurrent lookups wait for one refresh instead of each
+// issuing their own enumerate call.
+bool HcnInventory::refresh(Snapshot& snapshot)
+{
+    if (*snapshot.enumerate == nullptr)
+        return false;
+
+    wil::unique_cotaskmem_string ids;
+    HcnErrorRecord errStr;
+    HRESULT result = hcnInvoke(snapshot.call, GUID{}, 0, errStr, [&] {
+        return (*snapshot.enumerate)(L"{}", &ids, &errStr);
+    });
+
+    std::unordered_set<GUID, GuidHash> refreshed;
+    try
+    {
+        if (FAILED(result))
+            throw std::runtime_error(std::format("result {}, errStr {}", result, errStr.describe(result)));
+
+        boost::json::value jv = boost::json::parse(xstrUtf8(ids.get()));
+        refreshed.reserve(jv.as_array().size());
+        for (const auto& id : jv.as_array())
+        {
+            GUID guid;
+            if (UuidFromStringA((RPC_CSTR)id.as_string().c_str(), &guid) == RPC_S_OK)
+                refreshed.insert(guid);
+        }
+    }
+    catch (std::exception& exc)
+    {
+        mStats.refreshFailures++;
+        snapshot.valid = false;
+        std::cout << std::format("{} - {} failed: {}\n", __func__, hcnCallName(snapshot.call), exc.what());
+        return false;
+    }
+
+    mStats.refreshes++;
+    snapshot.ids = std::move(refreshed);
+    snapshot.refreshed = std::chrono::steady_clock::now();
+    snapshot.valid = true;
+    return true;
+}
+
+HcnInventory::Stats HcnInventory::stats()
+{
+    std::scoped_lock lock(mMutex);
+    mStats.networks = mNetworks.ids.size();
+    mStats.endpoints = mEndpoints.ids.size();
+    return mStats;
+}
+
+#pragma endregion
+
+std::unique_ptr<HcnInventory> mHcnInventory;
+
+HcnInventory::Presence hcnNetworkPresence(const GUID& id)
+{
+    return mHcnInventory ? mHcnInventory->network(id) : HcnInventory::Presence::Unknown;
+}
+
+HcnInventory::Presence hcnEndpointPresence(const GUID& id)
+{
+    return mHcnInventory ? mHcnInventory->endpoint(id) : HcnInventory::Presence::Unknown;
+}
+
+void recordHcnNetwork(const GUID& id, bool exists)
+{
+    if (mHcnInventory)
+        mHcnInventory->recordNetwork(id, exists);
+}
+
+void recordHcnEndpoint(const GUID& id, bool exists)
+{
+    if (mHcnInventory)
+        mHcnInventory->recordEndpoint(id, exists);
+}
+
+void printInventoryStats()
+{
+    if (!mHcnInventory)
+        return;
+
+    auto stats = mHcnInventory->stats();
+    std::cout << std::format("Inventory: lookups {}, refreshes {}, refreshFailures {}, networks {}, endpoints {}\n",
+        stats.lookups, stats.refreshes, stats.refreshFailures, stats.networks, stats.endpoints);
+}
+
+#pragma region Deadline
+
+// Replaces the VmmgrHypervApi entry points, like the stub does, with wrappers that run the
+// underlying call on a worker thread and wait for it until the per-call timeout or the
+// thread's HcnDeadlineScope, whichever is earlier. A call that misses its deadline returns
+// kHcnDeadlineExceeded to the caller and is abandoned: the worker keeps it running, and when
+// it eventually returns, the handle and strings it produced are closed and freed here and
+// the inventory is updated with its outcome. The journal intent of an abandoned mutation is
+// left open so that recovery on the next start resolves it as well.
+//
+// Inputs are copied and outputs land in a frame owned jointly by the caller and the worker,
+// so an abandoned call never writes to a caller that has already returned. A call that takes
+// a caller-owned handle (CreateEndpoint's network, ModifyEndpoint's and
+// QueryEndpointProperties' endpoint) is never abandoned, since the caller closes that handle
+// as soon as it returns: past its deadline it is counted as exceeded and waited out.
+class HcnDeadline
+{
+public:
+    struct Stats
+    {
+        uint64_t calls = 0;
+        uint64_t exceeded = 0;
+        uint64_t cancelled = 0;
+        uint64_t completedLate = 0;
+        uint64_t handlesClosed = 0;
+        uint64_t waitedOut = 0;     // exceeded on a caller-owned handle, so not abandoned
+        uint64_t exceededByCall[static_cast<size_t>(HcnCall::Count)] = {};
+        size_t workers = 0;
+    };
+
+    struct Abandoned
+    {
+        HcnCall call;
+        GUID id;
+        std::chrono::steady_clock::time_point started;
+        bool completed = false;
+        HRESULT result = S_OK;
+        double lateMs = 0.0;    // time past the deadline at which the call returned
+    };
+
+    static void install(std::chrono::milliseconds timeout);
+    static bool installed() { return mTimeout.count() > 0; }
+    static Stats stats();
+    static std::vector<Abandoned> abandoned();
+
+private:
+    struct Frame
+    {
+        HCN_NETWORK network = nullptr;
+        HCN_ENDPOINT endpoint = nullptr;
+        PWSTR text = nullptr;
+        PWSTR errorRecord = nullptr;
+
+        std::mutex mutex;
+        std::condition_variable done;
+        bool finished = false;
+        bool abandoned = false;
+        HRESULT result = S_OK;
+        size_t record = 0;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    template<typename Fn>
+    static HRESULT guarded(HcnCall call, const GUID& id, Fn&& fn, HCN_NETWORK* network, HCN_ENDPOINT* endpoint, PWSTR* text, PWSTR* errorRecord,
+        bool borrowsHandle = false);
+    static void finish(HcnCall call, const GUID& id, const std::shared_ptr<Frame>& frame, HRESULT result);
+    static void submit(std::function<void()> task);
+    static PWSTR errorRecordFor(HRESULT result, std::string_view message);
+
+    static HRESULT WINAPI HcnOpenNetwork(const GUID& id, HCN_NETWORK* network, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnCreateNetwork(const GUID& id, PCWSTR settings, HCN_NETWORK* network, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnDeleteNetwork(const GUID& id, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnCreateEndpoint(HCN_NETWORK network, const GUID& id, PCWSTR settings, HCN_ENDPOINT* endpoint, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnDeleteEndpoint(const GUID& id, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnOpenEndpoint(const GUID& id, HCN_ENDPOINT* endpoint, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnModifyEndpoint(HCN_ENDPOINT endpoint, PCWSTR settings, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnQueryEndpointProperties(HCN_ENDPOINT endpoint, PCWSTR query, PWSTR* properties, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnEnumerateNetworks(PCWSTR query, PWSTR* networks, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnEnumerateEndpoints(PCWSTR query, PWSTR* endpoints, PWSTR* errorRecord);
+
+    static inline std::chrono::milliseconds mTimeout{ 0 };
+
+    // The entry points that were installed before the wrappers: ComputeNetwork.dll or the stub.
+    static inline decltype(&::HcnOpenNetwork) mOpenNetwork{ nullptr };
+    static inline decltype(&::HcnCreateNetwork) mCreateNetwork{ nullptr };
+    static inline decltype(&::HcnDeleteNetwork) mDeleteNetwork{ nullptr };
+    static inline decltype(&::HcnCreateEndpoint) mCreateEndpoint{ nullptr };
+    static inline decltype(&::HcnDeleteEndpoint) mDeleteEndpoint{ nullptr };
+    static inline decltype(&::HcnOpenEndpoint) mOpenEndpoint{ nullptr };
+    static inline decltype(&::HcnModifyEndpoint) mModifyEndpoint{ nullptr };
+    static inline decltype(&::HcnQueryEndpointProperties) mQueryEndpointProperties{ nullptr };
+    static inline decltype(&::HcnEnumerateNetworks) mEnumerateNetworks{ nullptr };
+    static inline decltype(&::HcnEnumerateEndpoints) mEnumerateEndpoints{ nullptr };
+
+    static inline std::mutex mMutex;
+    static Stats mStats;
+    static inline std::vector<Abandoned> mAbandoned;
+
+    // Cached worker threads: idle ones are reused and a new one is started when none is
+    // free, since a stuck call holds its worker for as long as the host holds the call.
+    // Workers are detached and may still be waiting when static destructors run at exit,
+    // so what they wait on is never destroyed.
+    static inline std::mutex& mWorkerMutex = *new std::mutex;
+    static inline std::condition_variable& mWorkAvailable = *new std::condition_variable;
+    static inline std::deque<std::function<void()>>& mWork = *new std::deque<std::function<void()>>;
+    static inline size_t mIdleWorkers = 0;
+    static constexpr std::chrono::seconds kIdleWorkerTimeout{ 30 };
+};
+
+HcnDeadline::Stats HcnDeadline::mStats;
+
+void HcnDeadline::install(std::chrono::milliseconds timeout)
+{
+    mTimeout = timeout;
+
+    mOpenNetwork = std::exchange(VmmgrHypervApi::HcnOpenNetwork, &HcnDeadline::HcnOpenNetwork);
+    mCreateNetwork = std::exchange(VmmgrHypervApi::HcnCreateNetwork, &HcnDeadline::HcnCreateNetwork);
+    mDeleteNetwork = std::exchange(VmmgrHypervApi::HcnDeleteNetwork, &HcnDeadline::HcnDeleteNetwork);
+    mCreateEndpoint = std::exchange(VmmgrHypervApi::HcnCreateEndpoint, &HcnDeadline::HcnCreateEndpoint);
+    mDeleteEndpoint = std::exchange(VmmgrHypervApi::HcnDeleteEndpoint, &HcnDeadline::HcnDeleteEndpoint);
+    mOpenEndpoint = std::exchange(VmmgrHypervApi::HcnOpenEndpoint, &HcnDeadline::HcnOpenEndpoint);
+    mModifyEndpoint = std::exchange(VmmgrHypervApi::HcnModifyEndpoint, &HcnDeadline::HcnModifyEndpoint);
+    mQueryEndpointProperties = std::exchange(VmmgrHypervApi::HcnQueryEndpointProperties, &HcnDeadline::HcnQueryEndpointProperties);
+    mEnumerateNetworks = std::exchange(VmmgrHypervApi::HcnEnumerateNetworks, &HcnDeadline::HcnEnumerateNetworks);
+    mEnumerateEndpoints = std::exchange(VmmgrHypervApi::HcnEnumerateEndpoints, &HcnDeadline::HcnEnumerateEndpoints);
+}
+
+HcnDeadline::Stats HcnDeadline::stats()
+{
+    std::scoped_lock lock(mMutex, mWorkerMutex);
+    Stats stats = mStats;
+    stats.workers = mIdleWorkers;
+    return stats;
+}
+
+std::vector<HcnDeadline::Abandoned> HcnDeadline::abandoned()
+{
+    std::scoped_lock lock(mMutex);
+    return mAbandoned;
+}
+
+void HcnDeadline::submit(std::function<void()> task)
+{
+    // What the call allocates on the worker is charged to the caller's HCN-call phase.
+    std::scoped_lock lock(mWorkerMutex);
+    mWork.push_back([phase = AllocProfile::mCurrent, task = std::move(task)] {
+        AllocPhase scope(phase);
+        task();
+    });
+    if (mIdleWorkers > 0)
+    {
+        mWorkAvailable.notify_one();
+        return;
+    }
+
+    std::thread([] {
+        std::unique_lock lock(mWorkerMutex);
+        for (;;)
+        {
+            mIdleWorkers++;
+            bool hasWork = mWorkAvailable.wait_for(lock, kIdleWorkerTimeout, [] { return !mWork.empty(); });
+            mIdleWorkers--;
+            if (!hasWork)
+                return;
+
+            std::function<void()> work = std::move(mWork.front());
+            mWork.pop_front();
+            lock.unlock();
+            work();
+            lock.lock();
+        }
+    }).detach();
+}
+
+PWSTR HcnDeadline::errorRecordFor(HRESULT result, std::string_view message)
+{
+    std::wstring record = xstrUtf16(std::format(R"({{"Success":false,"Error":"{}","ErrorCode":{}}})", message, static_cast<uint32_t>(result)));
+    size_t bytes = (record.size() + 1) * sizeof(wchar_t);
+    PWSTR out = static_cast<PWSTR>(CoTaskMemAlloc(bytes));
+    if (out != nullptr)
+        memcpy(out, record.c_str(), bytes);
+    return out;
+}
+
+template<typename Fn>
+HRESULT HcnDeadline::guarded(HcnCall call, const GUID& id, Fn&& fn, HCN_NETWORK* network, HCN_ENDPOINT* endpoint, PWSTR* text, PWSTR* errorRecord,
+    bool borrowsHandle)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto deadline = std::min(now + mTimeout, HcnDeadlineScope::current());
+    {
+        std::scoped_lock lock(mMutex);
+        mStats.calls++;
+        if (deadline <= now)
+        {
+            mStats.cancelled++;
+            *errorRecord = errorRecordFor(kHcnCancelled, "Cancelled: the start deadline has passed");
+            return kHcnCancelled;
+        }
+    }
+
+    auto frame = std::make_shared<Frame>();
+    frame->deadline = deadline;
+    submit([call, id, frame, fn = std::forward<Fn>(fn)]() mutable {
+        finish(call, id, frame, fn(*frame));
+    });
+
+    std::unique_lock lock(frame->mutex);
+    if (!frame->done.wait_until(lock, deadline, [&] { return frame->finished; }) && borrowsHandle)
+    {
+        {
+            std::scoped_lock statsLock(mMutex);
+            mStats.exceeded++;
+            mStats.exceededByCall[static_cast<size_t>(call)]++;
+            mStats.waitedOut++;
+        }
+        frame->done.wait(lock, [&] { return frame->finished; });
+    }
+    else if (!frame->finished)
+    {
+        frame->abandoned = true;
+        {
+            std::scoped_lock statsLock(mMutex);
+            mStats.exceeded++;
+            mStats.exceededByCall[static_cast<size_t>(call)]++;
+            frame->record = mAbandoned.size();
+            mAbandoned.push_back(Abandoned{ call, id, now });
+        }
+        *errorRecord = errorRecordFor(kHcnDeadlineExceeded, std::format("Deadline exceeded after {} ms",
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()));
+        return kHcnDeadlineExceeded;
+    }
+
+    if (network != nullptr)
+        *network = frame->network;
+    if (endpoint != nullptr)
+        *endpoint = frame->endpoint;
+    if (text != nullptr)
+        *text = frame->text;
+    *errorRecord = frame->errorRecord;
+    return frame->result;
+}
+
+// Runs on the worker. A caller still waiting takes the outputs; otherwise they are released
+// here and the outcome is recorded against the abandoned call.
+void HcnDeadline::finish(HcnCall call, const GUID& id, const std::shared_ptr<Frame>& frame, HRESULT result)
+{
+    {
+        std::scoped_lock lock(frame->mutex);
+        frame->result = result;
+        frame->finished = true;
+        if (!frame->abandoned)
+        {
+            frame->done.notify_one();
+            return;
+        }
+    }
+
+    uint64_t closed = 0;
+    if (frame->network != nullptr)
+        closed += SUCCEEDED(VmmgrHypervApi::HcnCloseNetwork(frame->network));
+    if (frame->endpoint != nullptr)
+        closed += SUCCEEDED(VmmgrHypervApi::HcnCloseEndpoint(frame->endpoint));
+    CoTaskMemFree(frame->text);
+    CoTaskMemFree(frame->errorRecord);
+
+    if (SUCCEEDED(result) && call == HcnCall::CreateNetwork)
+        recordHcnNetwork(id, true);
+    if (SUCCEEDED(result) && call == HcnCall::CreateEndpoint)
+        recordHcnEndpoint(id, true);
+    if ((SUCCEEDED(result) || result == HCN_E_ENDPOINT_NOT_FOUND) && call == HcnCall::DeleteEndpoint)
+        recordHcnEndpoint(id, false);
+    if ((SUCCEEDED(result) || result == HCN_E_NETWORK_NOT_FOUND) && call == HcnCall::DeleteNetwork)
+        recordHcnNetwork(id, false);
+
+    std::scoped_lock lock(mMutex);
+    Abandoned& record = mAbandoned[frame->record];
+    record.completed = true;
+    record.result = result;
+    record.lateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame->deadline).count();
+    mStats.completedLate++;
+    mStats.handlesClosed += closed;
+}
+
+HRESULT WINAPI HcnDeadline::HcnOpenNetwork(const GUID& id, HCN_NETWORK* network, PWSTR* errorRecord)
+{
+    return guarded(HcnCall::OpenNetwork, id, [id](Frame& out) {
+        return mOpenNetwork(id, &out.network, &out.errorRecord);
+    }, network, nullptr, nullptr, errorRecord);
+}
+
+HRESULT WINAPI HcnDeadline::HcnCreateNetwork(const GUID& id, PCWSTR settings, HCN_NETWORK* network, PWSTR* errorRecord)
+{
+    return guarded(HcnCall::CreateNetwork, id, [id, settings = std::wstring(settings)](Frame& out) {
+        return mCreateNetwork(id, settings.c_str(), &out.network, &out.errorRecord);
+    }, network, nullptr, nullptr, errorRecord);
+}
+
+HRESULT WINAPI HcnDeadline::HcnDeleteNetwork(const GUID& id, PWSTR* errorRecord)
+{
+    return guarded(HcnCall::DeleteNetwork, id, [id](Frame& out) {
+        return mDeleteNetwork(id, &out.errorRecord);
+    }, nullptr, nullptr, nullptr, errorRecord);
+}
+
+HRESULT WINAPI HcnDeadline::HcnCreateEndpoint(HCN_NETWORK network, const GUID& id, PCWSTR settings, HCN_ENDPOINT* endpoint, PWSTR* errorRecord)
+{
+    return guarded(HcnCall::CreateEndpoint, id, [network, id, settings = std::wstring(settings)](Frame& out) {
+        return mCreateEndpoint(network, id, settings.c_str(), &out.endpoint, &out.errorRecord);
+    }, nullptr, endpoint, nullptr, errorRecord, true);
+}
+
+HRESULT WINAPI HcnDeadline::HcnDeleteEndpoint(const GUID& id, PWSTR* errorRecord)
+{
+    return guarded(HcnCall::DeleteEndpoint, id, [id](Frame& out) {
+        return mDeleteEndpoint(id, &out.errorRecord);
+    }, nullptr, nullptr, nullptr, errorRecord);
+}
+
+HRESULT WINAPI HcnDeadline::HcnOpenEndpoint(const GUID& id, HCN_ENDPOINT* endpoint, PWSTR* errorRecord)
+{
+    return guarded(HcnCall::OpenEndpoint, id, [id](Frame& out) {
+        return mOpenEndpoint(id, &out.endpoint, &out.errorRecord);
+    }, nullptr, endpoint, nullptr, errorRecord);
+}
+
+HRESULT WINAPI HcnDeadline::HcnModifyEndpoint(HCN_ENDPOINT endpoint, PCWSTR settings, PWSTR* errorRecord)
+{
+    return guarded(HcnCall::ModifyEndpoint, GUID{}, [endpoint, settings = std::wstring(settings)](Frame& out) {
+        return mModifyEndpoint(endpoint, settings.c_str(), &out.errorRecord);
+    }, nullptr, nullptr, nullptr, errorRecord, true);
+}
+
+HRESULT WINAPI HcnDeadline::HcnQueryEndpointProperties(HCN_ENDPOINT endpoint, PCWSTR query, PWSTR* properties, PWSTR* errorRecord)
+{
+    return guarded(HcnCall::QueryEndpointProperties, GUID{}, [endpoint, query = std::wstring(query)](Frame& out) {
+        return mQueryEndpointProperties(endpoint, query.c_str(), &out.text, &out.errorRecord);
+    }, nullptr, nullptr, properties, errorRecord, true);
+}
+
+HRESULT WINAPI HcnDeadline::HcnEnumerateNetworks(PCWSTR query, PWSTR* networks, PWSTR* errorRecord)
+{
+    return guarded(HcnCall::EnumerateNetworks, GUID{}, [query = std::wstring(query)](Frame& out) {
+        return mEnumerateNetworks(query.c_str(), &out.text, &out.errorRecord);
+    }, nullptr, nullptr, networks, errorRecord);
+}
+
+HRESULT WINAPI HcnDeadline::HcnEnumerateEndpoints(PCWSTR query, PWSTR* endpoints, PWSTR* errorRecord)
+{
+    return guarded(HcnCall::EnumerateEndpoints, GUID{}, [query = std::wstring(query)](Frame& out) {
+        return mEnumerateEndpoints(query.c_str(), &out.text, &out.errorRecord);
+    }, nullptr, nullptr, endpoints, errorRecord);
+}
+
+void printDeadlineStats()
+{
+    if (!HcnDeadline::installed())
+        return;
+
+    HcnDeadline::Stats stats = HcnDeadline::stats();
+    std::string byCall;
+    for (size_t i = 0; i < static_cast<size_t>(HcnCall::Count); ++i)
+    {
+        if (stats.exceededByCall[i] != 0)
+            byCall += std::format(", {} {}", hcnCallName(static_cast<HcnCall>(i)), stats.exceededByCall[i]);
+    }
+    std::cout << std::format("Deadline: calls {}, exceeded {}, waitedOut {}, cancelled {}, completedLate {}, handlesClosed {}, idleWorkers {}{}\n",
+        stats.calls, stats.exceeded, stats.waitedOut, stats.cancelled, stats.completedLate, stats.handlesClosed, stats.workers, byCall);
+
+    for (const HcnDeadline::Abandoned& call : HcnDeadline::abandoned())
+    {
+        if (!call.completed)
+            std::cout << std::format("Deadline: still running {} {}\n", hcnCallName(call.call), xstrGuid(call.id));
+    }
+}
+
+#pragma endregion
+
+#pragma region HandleRegistry
+
+// Concurrent map from GUID to an open HCN handle, so the process can track every network and
+// endpoint it has open instead of one of each. Keys are spread over kShards shards by the high
+// bits of their hash, each with its own reader-writer lock on its own cache line: lookups only
+// share a lock with lookups of the same shard, and a writer only blocks that shard. Handles are
+// held by shared_ptr, so erasing or replacing an entry closes the handle once the last lookup
+// holding it is done, and never under a shard lock.
+template <typename Handle>
+class HcnHandleRegistry
+{
+public:
+    using Ptr = std::shared_ptr<Handle>;
+    static constexpr size_t kShards = 256;
+
+    Ptr find(const GUID& id) const
+    {
+        const Shard& shard = shardOf(id);
+        std::shared_lock lock(shard.mutex);
+        auto it = shard.map.find(id);
+        return it != shard.map.end() ? it->second : nullptr;
+    }
+
+    // Replaces any handle already registered under the id; the old one is closed once unused.
+    void insert(const GUID& id, Ptr handle)
+    {
+        Shard& shard = shardOf(id);
+        std::unique_lock lock(shard.mutex);
+        auto [it, inserted] = shard.map.try_emplace(id, std::move(handle));
+        if (!inserted)
+            std::swap(it->second, handle);
+        lock.unlock();
+    }
+
+    void insert(const GUID& id, Handle handle)
+    {
+        insert(id, std::make_shared<Handle>(std::move(handle)));
+    }
+
+    bool erase(const GUID& id)
+    {
+        Shard& shard = shardOf(id);
+        std::unique_lock lock(shard.mutex);
+        auto node = shard.map.extract(id);
+        lock.unlock();
+        return !node.empty();
+    }
+
+    // Visits a snapshot of every entry, one shard at a time and outside the shard lock, so the
+    // callback may erase; entries inserted or erased while visiting may or may not be seen.
+    template <typename Fn>
+    void forEach(Fn&& fn) const
+    {
+        std::vector<std::pair<GUID, Ptr>> entries;
+        for (const Shard& shard : mShards)
+        {
+            {
+                std::shared_lock lock(shard.mutex);
+                entries.assign(shard.map.begin(), shard.map.end());
+            }
+            for (const auto& [id, handle] : entries)
+                fn(id, handle);
+        }
+    }
+
+    // Removes every entry and hands the handles to the caller, for teardown.
+    std::vector<std::pair<GUID, Ptr>> drain()
+    {
+        std::vector<std::pair<GUID, Ptr>> entries;
+        for (Shard& shard : mShards)
+        {
+            Map map;
+            {
+                std::unique_lock lock(shard.mutex);
+                map.swap(shard.map);
+            }
+            entries.insert(entries.end(), std::make_move_iterator(map.begin()), std::make_move_iterator(map.end()));
+        }
+        return entries;
+    }
+
+    size_t size() const
+    {
+        size_t total = 0;
+        for (const Shard& shard : mShards)
+        {
+            std::shared_lock lock(shard.mutex);
+            total += shard.map.size();
+        }
+        return total;
+    }
+
+private:
+    using Map = std::unordered_map<GUID, Ptr, GuidHash>;
+
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex;
+        Map map;
+    };
+
+    // The shard comes from the top bits so that keys sharing a shard still spread over the
+    // buckets of its map, which are picked from the low bits.
+    static size_t shardIndex(const GUID& id)
+    {
+        return static_cast<size_t>(static_cast<uint64_t>(GuidHash{}(id)) >> 56) % kShards;
+    }
+
+    Shard& shardOf(const GUID& id) { return mShards[shardIndex(id)]; }
+    const Shard& shardOf(const GUID& id) const { return mShards[shardIndex(id)]; }
+
+    std::array<Shard, kShards> mShards;
+};
+
+#pragma endregion
+
+struct HcnNetworkResult
+{
+    HRESULT result = E_FAIL;
+    std::shared_ptr<unique_hcn_network> network;
+};
+
+boost::json::value mAndroidJson;
+HcnHandleRegistry<unique_hcn_network> mHcnNetworks;
+HcnHandleRegistry<unique_hcn_endpoint> mHcnEndpoints;
+HcnSingleFlight<HcnNetworkResult> mHcnNetworkFlight;
+
+// Opens the network, creating it when it does not exist yet. A create that loses the race
+// against another process reopens the network that process created.
+HcnNetworkResult openOrCreateHcnNetwork(const GUID& guidNetwork, const boost::json::value& settings)
+{
+    auto network = std::make_shared<unique_hcn_network>();
+
+    HcnErrorRecord errStr;
+    HRESULT result = HCN_E_NETWORK_NOT_FOUND;
+    if (hcnNetworkPresence(guidNetwork) != HcnInventory::Presence::Absent)
+    {
+        result = hcnInvoke(HcnCall::OpenNetwork, guidNetwork, 0, errStr, [&] {
+            return VmmgrHypervApi::HcnOpenNetwork(guidNetwork, network->put(), &errStr);
+        });
+
+        std::cout << std::format("{} - HcnOpenNetwork:\nresult {}\nerrStr {}\n", __func__, result, errStr.describe(result)) << "\n";
+    }
+
+    if (result == HCN_E_NETWORK_NOT_FOUND)
+    {
+        result = hcnInvoke(HcnCall::CreateNetwork, guidNetwork, JsonHash::digest(settings), errStr, [&] {
+            return VmmgrHypervApi::HcnCreateNetwork(
+                guidNetwork,                                    // Id
+                xstrUtf16(settings).data(),                     // Settings
+                network->put(),                                 // Network
+                &errStr                                         // ErrorRecord
+            );
+        });
+
+        std::cout << std::format("{} - HcnCreateNetwork\nresult {}\nerrStr {}\n", __func__, result, errStr.describe(result)) << "\n";
+    }
+
+    if (result == HCN_E_NETWORK_ALREADY_EXISTS)
+    {
+        result = hcnInvoke(HcnCall::OpenNetwork, guidNetwork, 0, errStr, [&] {
+            return VmmgrHypervApi::HcnOpenNetwork(guidNetwork, network->put(), &errStr);
+        });
+
+        std::cout << std::format("{} - HcnOpenNetwork (retry):\nresult {}\nerrStr {}\n", __func__, result, errStr.describe(result)) << "\n";
+    }
+
+    if (SUCCEEDED(result) || result == HCN_E_NETWORK_NOT_FOUND)
+        recordHcnNetwork(guidNetwork, SUCCEEDED(result));
+
+    return HcnNetworkResult{ result, SUCCEEDED(result) ? network : nullptr };
+}
+
+std::shared_ptr<unique_hcn_network> configureHcnNetwork()
+{
+    std::string networkGuid;
+    {
+        AllocPhase phase("lookup");
+        networkGuid = (mAndroidJson / "HcnNetwork" / "ID").as_string().data();
+    }
+    GUID guidNetwork;
+
+    if (UuidFromStringA((RPC_CSTR)networkGuid.data(), &guidNetwork) != RPC_S_OK)
+    {
+        std::cout << std::format("{} - Failed to parse Network guid: {}\n", __func__, networkGuid) << "\n";
+    }
+
+    HcnNetworkResult network = mHcnNetworkFlight.run(xstrGuid(guidNetwork), [&] {
+        return openOrCreateHcnNetwork(guidNetwork, mAndroidJson / "HcnNetwork");
+    });
+    if (network.network)
+        mHcnNetworks.insert(guidNetwork, network.network);
+    else
+        mHcnNetworks.erase(guidNetwork);
+    return network.network;
+}
+
+void printHandleRegistryStats()
+{
+    std::cout << std::format("Handles: networks {}, endpoints {}\n", mHcnNetworks.size(), mHcnEndpoints.size());
+}
+
+void printSingleFlightStats()
+{
+    auto stats = mHcnNetworkFlight.stats();
+    std::cout << std::format("SingleFlight: calls {}, executions {}, collapsed {}\n", stats.calls, stats.executions, stats.collapsed);
+}
+
+#pragma region EndpointPool
+
+// Keeps a number of endpoints pre-created on the configured network so that a VM start can
+// claim one instead of paying HcnDeleteEndpoint + HcnCreateEndpoint on its critical path.
+// Claimed endpoints are replaced asynchronously by a background thread, which also deletes
+// the endpoints that claims made obsolete; endpoints still in the pool when it is destroyed
+// are deleted. Filling takes one create per endpoint, so a pool
+// only pays off in a process that provisions many starts: the fleet worker keeps one for the
+// lifetime of the worker, and a start only claims from it when its endpoint settings match.
+class HcnEndpointPool
+{
+public:
+    struct Endpoint
+    {
+        GUID id{};
+        unique_hcn_endpoint handle;
+    };
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t created = 0;
+        uint64_t failed = 0;
+        size_t ready = 0;
+        double totalClaimMs = 0.0;
+        double maxClaimMs = 0.0;
+    };
+
+    HcnEndpointPool(std::shared_ptr<unique_hcn_network> network, const boost::json::value& settings, size_t target);
+    ~HcnEndpointPool();
+
+    std::optional<Endpoint> claim();
+    void retire(const GUID& id);
+    Stats stats();
+    uint64_t settingsHash() const { return mSettingsHash; }
+
+private:
+    void refillLoop();
+    static void remove(const GUID& id);
+
+    std::shared_ptr<unique_hcn_network> mNetwork;
+    std::wstring mSettings;
+    uint64_t mSettingsHash;
+    size_t mTarget;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::vector<Endpoint> mReady;
+    std::vector<GUID> mRetired;
+    Stats mStats;
+    bool mStopping = false;
+    std::thread mThread;
+};
+
+HcnEndpointPool::HcnEndpointPool(std::shared_ptr<unique_hcn_network> network, const boost::json::value& settings, size_t target)
+    : mNetwork(std::move(network)), mSettings(xstrUtf16(settings)), mSettingsHash(JsonHash::digest(settings)), mTarget(target)
+{
+    mReady.reserve(target);
+    mThread = std::thread([this] { refillLoop(); });
+}
+
+HcnEndpointPool::~HcnEndpointPool()
+{
+    {
+        std::scoped_lock lock(mMutex);
+        mStopping = true;
+    }
+    mCondition.notify_all();
+    mThread.join();
+
+    for (auto& endpoint : mReady)
+    {
+        endpoint.handle.reset();
+        remove(endpoint.id);
+    }
+    for (const GUID& id : mRetired)
+        remove(id);
+}
+
+void HcnEndpointPool::remove(const GUID& id)
+{
+    HcnErrorRecord errStr;
+    HRESULT result = hcnInvoke(HcnCall::DeleteEndpoint, id, 0, errStr, [&] {
+        return VmmgrHypervApi::HcnDeleteEndpoint(id, &errStr);
+    });
+    if (SUCCEEDED(result) || result == HCN_E_ENDPOINT_NOT_FOUND)
+        recordHcnEndpoint(id, false);
+}
+
+std::optional<HcnEndpointPool::Endpoint> HcnEndpointPool::claim()
+{
+    auto start = std::chrono::steady_clock::now();
+    std::optional<Endpoint> endpoint;
+    {
+        std::scoped_lock lock(mMutex);
+        if (!mReady.empty())
+        {
+            endpoint = std::move(mReady.back());
+            mReady.pop_back();
+            mStats.hits++;
+        }
+        else
+        {
+            mStats.misses++;
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        mStats.totalClaimMs += ms;
+        mStats.maxClaimMs = std::max(mStats.maxClaimMs, ms);
+    }
+    mCondition.notify_all();
+    return endpoint;
+}
+
+// Queues the endpoint a claim replaced for deletion off the start's critical path.
+void HcnEndpointPool::retire(const GUID& id)
+{
+    {
+        std::scoped_lock lock(mMutex);
+        mRetired.push_back(id);
+    }
+    mCondition.notify_all();
+}
+
+HcnEndpointPool::Stats HcnEndpointPool::stats()
+{
+    std::scoped_lock lock(mMutex);
+    mStats.ready = mReady.size();
+    return mStats;
+}
+
+void HcnEndpointPool::refillLoop()
+{
+    HcnPriorityScope priority(HcnPriority::Bulk);
+    std::unique_lock lock(mMutex);
+    while (!mStopping)
+    {
+        // Refilling comes first; retired endpoints only cost host capacity.
+        if (mReady.size() >= mTarget && !mRetired.empty())
+        {
+            GUID id = mRetired.back();
+            mRetired.pop_back();
+            lock.unlock();
+            remove(id);
+            lock.lock();
+            continue;
+        }
+        if (mReady.size() >= mTarget)
+        {
+            mCondition.wait(lock);
+            continue;
+        }
+        lock.unlock();
+
+        Endpoint endpoint;
+        UuidCreate(&endpoint.id);
+
+        HcnErrorRecord errStr;
+        HRESULT result = hcnInvoke(HcnCall::CreateEndpoint, endpoint.id, mSettingsHash, errStr, [&] {
+            return VmmgrHypervApi::HcnCreateEndpoint(mNetwork->get(), endpoint.id, mSettings.data(), endpoint.handle.put(), &errStr);
+        });
+
+        if (SUCCEEDED(result))
+            recordHcnEndpoint(endpoint.id, true);
+
+        lock.lock();
+        if (SUCCEEDED(result))
+        {
+            mStats.created++;
+            mReady.push_back(std::move(endpoint));
+        }
+        else
+        {
+            mStats.failed++;
+            std::cout << std::format("{} - HcnCreateEndpoint\nresult {}\nerrStr {}\n", __func__, result, errStr.describe(result)) << "\n";
+            mCondition.wait_for(lock, std::chrono::seconds(1));
+        }
+    }
+}
+
+#pragma endregion
+
+std::unique_ptr<HcnEndpointPool> mHcnEndpointPool;
+
+void printEndpointPoolStats()
+{
+    if (!mHcnEndpointPool)
+        return;
+
+    auto stats = mHcnEndpointPool->stats();
+    uint64_t claims = stats.hits + stats.misses;
+    std::cout << std::format("EndpointPool: ready {}, hits {}, misses {}, hitRate {:.1f}%, created {}, failed {}, avgClaimMs {:.3f}, maxClaimMs {:.3f}\n",
+        stats.ready, stats.hits, stats.misses, claims ? 100.0 * stats.hits / claims : 0.0,
+        stats.created, stats.failed, claims ? stats.totalClaimMs / claims : 0.0, stats.maxClaimMs);
+}
+
+#pragma region EndpointModify
+
+struct HcnEndpointDelta
+{
+    boost::json::array added;
+    boost::json::array removed;
+    boost::json::array updated;
+    bool recreate = false;
+
+    bool empty() const { return added.empty() && removed.empty() && updated.empty(); }
+};
+
+struct HcnEndpointModifyStats
+{
+    std::atomic<uint64_t> upToDate{ 0 };
+    std::atomic<uint64_t> modified{ 0 };
+    std::atomic<uint64_t> recreated{ 0 };   // deleted and created again
+    std::atomic<uint64_t> created{ 0 };     // created where none existed
+};
+
+HcnEndpointModifyStats mHcnEndpointModifyStats;
+
+// True when every value the config sets in desired is present in current. Keys the service adds
+// are ignored, numbers compare by value and GUID strings compare case-insensitively, since the
+// service fills in defaults and normalizes what it stores.
+bool hcnSettingsMatch(const boost::json::value& current, const boost::json::value& desired)
+{
+    if (const boost::json::object* desiredObject = desired.if_object())
+    {
+        const boost::json::object* currentObject = current.if_object();
+        if (currentObject == nullptr)
+            return false;
+        for (const auto& kv : *desiredObject)
+        {
+            const boost::json::value* field = currentObject->if_contains(kv.key());
+            if (field == nullptr || !hcnSettingsMatch(*field, kv.value()))
+                return false;
+        }
+        return true;
+    }
+
+    if (const boost::json::array* desiredArray = desired.if_array())
+    {
+        const boost::json::array* currentArray = current.if_array();
+        if (currentArray == nullptr || currentArray->size() != desiredArray->size())
+            return false;
+        for (size_t i = 0; i < desiredArray->size(); ++i)
+        {
+            if (!hcnSettingsMatch((*currentArray)[i], (*desiredArray)[i]))
+                return false;
+        }
+        return true;
+    }
+
+    if (desired.is_number() && current.is_number())
+        return desired.to_number<double>() == current.to_number<double>();
+
+    if (desired.is_string() && current.is_string())
+    {
+        GUID desiredGuid, currentGuid;
+        if (xguidParse(desired.get_string(), desiredGuid) && xguidParse(current.get_string(), currentGuid))
+            return desiredGuid == currentGuid;
+    }
+    return current == desired;
+}
+
+// Compares the endpoint reported by HcnQueryEndpointProperties with the desired HcnEndpoint
+// settings. Only the fields the config sets are compared, through hcnSettingsMatch; fields
+// other than Policies are skipped when the service does not report them, and any difference
+// there requires a recreate. Policies are matched by hcnPolicyIdentity.
+HcnEndpointDelta diffHcnEndpoint(const boost::json::value& current, const boost::json::value& desired)
+{
+    HcnEndpointDelta delta;
+    const boost::json::object* currentObject = current.if_object();
+    const boost::json::object* desiredObject = desired.if_object();
+    if (currentObject == nullptr || desiredObject == nullptr)
+    {
+        delta.recreate = true;
+        return delta;
+    }
+
+    for (const auto& kv : *desiredObject)
+    {
+        if (kv.key() == "Policies")
+            continue;
+
+        const boost::json::value* field = currentObject->if_contains(kv.key());
+        if (field != nullptr && !hcnSettingsMatch(*field, kv.value()))
+        {
+            delta.recreate = true;
+            return delta;
+        }
+    }
+
+    static const boost::json::array noPolicies;
+    auto policiesOf = [](const boost::json::object* object) -> const boost::json::array& {
+        const boost::json::value* policies = object->if_contains("Policies");
+        return policies != nullptr && policies->is_array() ? policies->get_array() : noPolicies;
+    };
+
+    std::unordered_map<uint64_t, const boost::json::value*> currentByIdentity;
+    for (const auto& policy : policiesOf(currentObject))
+        currentByIdentity.emplace(hcnPolicyIdentity(policy), &policy);
+
+    std::unordered_set<uint64_t> desiredIdentities;
+    for (const auto& policy : policiesOf(desiredObject))
+    {
+        uint64_t identity = hcnPolicyIdentity(policy);
+        desiredIdentities.insert(identity);
+
+        auto it = currentByIdentity.find(identity);
+        if (it == currentByIdentity.end())
+            delta.added.push_back(policy);
+        else if (!hcnSettingsMatch(*it->second, policy))
+            delta.updated.push_back(policy);
+    }
+
+    for (const auto& policy : policiesOf(currentObject))
+    {
+        if (!desiredIdentities.contains(hcnPolicyIdentity(policy)))
+            delta.removed.push_back(policy);
+    }
+    return delta;
+}
+
+// Builds the single ModifyEndpointSettingRequest covering a delta: a pure add, remove or
+// update maps onto that request type, and a mix of them refreshes the whole policy list.
+boost::json::value hcnPolicyRequest(const HcnEndpointDelta& delta, const boost::json::value& desired)
+{
+    int kinds = !delta.added.empty() + !delta.removed.empty() + !delta.updated.empty();
+
+    std::string_view requestType;
+    boost::json::array policies;
+    if (kinds > 1)
+    {
+        requestType = "Refresh";
+        if (const boost::json::value* desiredPolicies = desired.as_object().if_contains("Policies"))
+            policies = desiredPolicies->as_array();
+    }
+    else if (!delta.added.empty())
+    {
+        requestType = "Add";
+        policies = delta.added;
+    }
+    else if (!delta.removed.empty())
+    {
+        requestType = "Remove";
+        policies = delta.removed;
+    }
+    else
+    {
+        requestType = "Update";
+        policies = delta.updated;
+    }
+
+    return boost::json::object{
+        { "ResourceType", "Policy" },
+        { "RequestType", requestType },
+        { "Settings", boost::json::object{ { "Policies", std::move(policies) } } }
+    };
+}
+
+// Brings an existing endpoint in line with the desired settings with at most one
+// HcnModifyEndpoint when only its policies differ. Returns S_OK when the endpoint is up to
+// date afterwards; any failure means the caller should fall back to recreating it.
+HRESULT updateHcnEndpointInPlace(const GUID& guidEndpoint, const boost::json::value& desired, unique_hcn_endpoint& endpoint)
+{
+    if (!VmmgrHypervApi::HcnOpenEndpoint || !VmmgrHypervApi::HcnModifyEndpoint || !VmmgrHypervApi::HcnQueryEndpointProperties)
+        return E_NOTIMPL;
+    if (hcnEndpointPresence(guidEndpoint) == HcnInventory::Presence::Absent)
+        return HCN_E_ENDPOINT_NOT_FOUND;
+
+    unique_hcn_endpoint opened;
+    HcnErrorRecord errStr;
+    HRESULT result = hcnInvoke(HcnCall::OpenEndpoint, guidEndpoint, 0, errStr, [&] {
+        return VmmgrHypervApi::HcnOpenEndpoint(guidEndpoint, opened.put(), &errStr);
+    });
+    if (result == HCN_E_ENDPOINT_NOT_FOUND)
+        recordHcnEndpoint(guidEndpoint, false);
+    if (FAILED(result))
+        return result;
+
+    wil::unique_cotaskmem_string properties;
+    result = hcnInvoke(HcnCall::QueryEndpointProperties, guidEndpoint, 0, errStr, [&] {
+        return VmmgrHypervApi::HcnQueryEndpointProperties(opened.get(), L"{}", &properties, &errStr);
+    });
+    if (FAILED(result))
+    {
+        std::cout << std::format("{} - HcnQueryEndpointProperties\nresult {}\nerrStr {}\n", __func__, result, errStr.describe(result)) << "\n";
+        return result;
+    }
+
+    boost::json::value current;
+    try
+    {
+        current = boost::json::parse(xstrUtf8(properties.get()));
+    }
+    catch (std::exception& exc)
+    {
+        std::cout << std::format("{} - failed to parse endpoint properties: exc {}\n", __func__, exc.what());
+        return HCN_E_INVALID_JSON;
+    }
+
+    HcnEndpointDelta delta = diffHcnEndpoint(current, desired);
+    if (delta.recreate)
+        return E_FAIL;
+
+    if (delta.empty())
+    {
+        mHcnEndpointModifyStats.upToDate++;
+        endpoint = std::move(opened);
+        std::cout << std::format("{} - Endpoint already up to date\n", __func__) << "\n";
+        return S_OK;
+    }
+
+    boost::json::value request = hcnPolicyRequest(delta, desired);
+    result = hcnInvoke(HcnCall::ModifyEndpoint, guidEndpoint, JsonHash::digest(request), errStr, [&] {
+        return VmmgrHypervApi::HcnModifyEndpoint(opened.get(), xstrUtf16(request).data(), &errStr);
+    });
+
+    std::cout << std::format("{} - HcnModifyEndpoint (added {}, removed {}, updated {})\nresult {}\nerrStr {}\n", __func__,
+        delta.added.size(), delta.removed.size(), delta.updated.size(), result, errStr.describe(result)) << "\n";
+
+    if (SUCCEEDED(result))
+    {
+        mHcnEndpointModifyStats.modified++;
+        endpoint = std::move(opened);
+    }
+    return result;
+}
+
+void printEndpointModifyStats()
+{
+    std::cout << std::format("EndpointModify: upToDate {}, modified {}, recreated {}, created {}\n",
+        mHcnEndpointModifyStats.upToDate.load(), mHcnEndpointModifyStats.modified.load(), mHcnEndpointModifyStats.recreated.load(),
+        mHcnEndpointModifyStats.created.load());
+}
+
+#pragma endregion
+
+// Brings one endpoint in line with its settings: updated in place when only its policies
+// differ, otherwise deleted (unless known to be absent) and created on the given network.
+// An inventory snapshot can be stale; a create that finds the endpoint still there marks it
+// present, deletes it and is retried once.
+HRESULT provisionHcnEndpoint(const GUID& guidEndpoint, const boost::json::value& settings, HCN_NETWORK network, unique_hcn_endpoint& endpoint)
+{
+    if (SUCCEEDED(updateHcnEndpointInPlace(guidEndpoint, settings, endpoint)))
+        return S_OK;
+
+    HcnErrorRecord errStr;
+    HRESULT result = S_OK;
+    bool existed = false;
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (hcnEndpointPresence(guidEndpoint) != HcnInventory::Presence::Absent)
+        {
+            result = hcnInvoke(HcnCall::DeleteEndpoint, guidEndpoint, 0, errStr, [&] {
+                return VmmgrHypervApi::HcnDeleteEndpoint(guidEndpoint, &errStr);
+            });
+            std::cout << std::format("{} - HcnDeleteEndpoint:\nresult {}\nerrStr {}\n", __func__, result, errStr.describe(result)) << "\n";
+
+            if (SUCCEEDED(result) || result == HCN_E_ENDPOINT_NOT_FOUND)
+                recordHcnEndpoint(guidEndpoint, false);
+            existed = existed || SUCCEEDED(result);
+        }
+
+        result = hcnInvoke(HcnCall::CreateEndpoint, guidEndpoint, JsonHash::digest(settings), errStr, [&] {
+            return VmmgrHypervApi::HcnCreateEndpoint(
+                network,                                        // Network
+                guidEndpoint,                                   // Id
+                xstrUtf16(settings).data(),                     // Settings
+                endpoint.put(),                                 // Endpoint
+                &errStr);                                       // ErrorRecord
+        });
+
+        std::cout << std::format("{} - HcnCreateEndpoint\nresult {}\nerrStr {}\n", __func__, result, errStr.describe(result)) << "\n";
+
+        if (result != HCN_E_ENDPOINT_ALREADY_EXISTS)
+            break;
+        recordHcnEndpoint(guidEndpoint, true);
+    }
+
+    if (SUCCEEDED(result))
+    {
+        recordHcnEndpoint(guidEndpoint, true);
+        (existed ? mHcnEndpointModifyStats.recreated : mHcnEndpointModifyStats.created)++;
+    }
+    return result;
+}
+
+// A claimed pooled endpoint replaces the one the config names: the adapter's EndpointId is
+// rewritten to the pooled GUID, which the caller persists, and the old endpoint is deleted
+// by the pool's thread.
+HRESULT configureHcnEndpoint()
+{
+    std::string endpointGuid;
+    {
+        AllocPhase phase("lookup");
+        endpointGuid = (mAndroidJson / "HcsSystem" / "VirtualMachine" / "Devices" /
+            "NetworkAdapters" / "default" / "EndpointId").as_string().data();
+    }
+
+    GUID guidEndpoint;
+    if (UuidFromStringA((RPC_CSTR)endpointGuid.data(), &guidEndpoint) != RPC_S_OK)
+    {
+        std::cout << std::format("{} - Failed to parse Endpoint guid: {}\n", __func__, endpointGuid);
+    }
+
+    if (mHcnEndpointPool && mHcnEndpointPool->settingsHash() == JsonHash::digest(mAndroidJson / "HcnEndpoint"))
+    {
+        if (auto endpoint = mHcnEndpointPool->claim())
+        {
+            (mAndroidJson / "HcsSystem" / "VirtualMachine" / "Devices" / "NetworkAdapters" / "default")
+                .as_object().insert_or_assign("EndpointId", xstrGuid(endpoint->id));
+            mHcnEndpoints.insert(endpoint->id, std::move(endpoint->handle));
+            std::cout << std::format("{} - Claimed pooled endpoint {}\n", __func__, xstrGuid(endpoint->id)) << "\n";
+
+            mHcnEndpoints.erase(guidEndpoint);
+            if (hcnEndpointPresence(guidEndpoint) != HcnInventory::Presence::Absent)
+                mHcnEndpointPool->retire(guidEndpoint);
+            return S_OK;
+        }
+    }
+
+    GUID guidNetwork{};
+    UuidFromStringA((RPC_CSTR)std::string((mAndroidJson / "HcnNetwork" / "ID").as_string()).data(), &guidNetwork);
+    std::shared_ptr<unique_hcn_network> network = mHcnNetworks.find(guidNetwork);
+
+    unique_hcn_endpoint endpoint;
+    HRESULT result = provisionHcnEndpoint(guidEndpoint, mAndroidJson / "HcnEndpoint", network ? network->get() : nullptr, endpoint);
+    if (endpoint)
+        mHcnEndpoints.insert(guidEndpoint, std::move(endpoint));
+    else
+        mHcnEndpoints.erase(guidEndpoint);
+    return result;
+}
+
+#pragma region Graph
+
+// Thread pool in which every worker owns a deque: a worker runs its own tasks newest-first
+// and, when it runs dry, steals the oldest task of another worker. Tasks submitted from a
+// worker land on its own deque, so the dependents a node releases stay on the thread that
+// just finished it unless another worker is idle.
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(size_t workers);
+    ~WorkStealingPool();
+
+    void submit(std::function<void()> task);
+    uint64_t steals() const { return mSteals; }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(size_t index);
+    bool tryPop(size_t index, std::function<void()>& task);
+
+    static inline thread_local WorkStealingPool* tPool = nullptr;
+    static inline thread_local size_t tIndex = 0;
+
+    std::vector<std::unique_ptr<Queue>> mQueues;
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::atomic<ptrdiff_t> mQueued{ 0 };    // briefly negative while a popped task's submit has yet to count it
+    std::atomic<size_t> mNextQueue{ 0 };
+    std::atomic<uint64_t> mSteals{ 0 };
+    bool mStop = false;
+};
+
+WorkStealingPool::WorkStealingPool(size_t workers)
+{
+    workers = std::max<size_t>(workers, 1);
+    for (size_t i = 0; i < workers; ++i)
+        mQueues.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < workers; ++i)
+        mThreads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::scoped_lock lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_all();
+    for (auto& thread : mThreads)
+        thread.join();
+}
+
+void WorkStealingPool::submit(std::function<void()> task)
+{
+    size_t index = tPool == this ? tIndex : mNextQueue++ % mQueues.size();
+    {
+        std::scoped_lock lock(mQueues[index]->mutex);
+        mQueues[index]->tasks.push_back(std::move(task));
+    }
+
+    // Counted only once it can be popped, so idle workers never wake for a task that is not
+    // there yet. A worker that pops it first takes mQueued below zero until this catches up,
+    // which reads as "nothing queued" and keeps the others asleep.
+    {
+        std::scoped_lock lock(mMutex);
+        mQueued++;
+    }
+    mWake.notify_one();
+}
+
+void WorkStealingPool::workerLoop(size_t index)
+{
+    tPool = this;
+    tIndex = index;
+
+    std::function<void()> task;
+    for (;;)
+    {
+        if (tryPop(index, task))
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock lock(mMutex);
+        mWake.wait(lock, [&] { return mStop || mQueued > 0; });
+        if (mStop && mQueued <= 0)
+            return;
+    }
+}
+
+bool WorkStealingPool::tryPop(size_t index, std::function<void()>& task)
+{
+    for (size_t i = 0; i < mQueues.size(); ++i)
+    {
+        Queue& queue = *mQueues[(index + i) % mQueues.size()];
+        std::scoped_lock lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+
+        if (i == 0)
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            mSteals++;
+        }
+        mQueued--;
+        return true;
+    }
+    return false;
+}
+
+// Resource DAG for configs whose HcnNetwork and/or HcnEndpoint are arrays. Each network
+// precedes the endpoints whose VirtualNetwork names it, and each endpoint precedes the
+// binding of the NetworkAdapters entry whose EndpointId names it; a binding copies the
+// MacAddress the host assigned into the adapter. Nodes whose dependencies are all done run
+// on a work-stealing pool, and a failed node skips everything downstream of it. A network or
+// endpoint whose ID repeats an earlier one is skipped, so each GUID has a single node.
+class HcnGraph
+{
+public:
+    enum class Kind
+    {
+        Network,
+        Endpoint,
+        Binding,
+    };
+
+    struct Node
+    {
+        Kind kind;
+        std::string name;
+        GUID id{};
+        boost::json::value* settings = nullptr;
+        std::vector<size_t> parents;
+        std::vector<size_t> dependents;
+        std::atomic<size_t> waiting{ 0 };
+
+        HRESULT result = S_OK;
+        bool skipped = false;
+        std::shared_ptr<unique_hcn_network> network;
+        unique_hcn_endpoint endpoint;
+        double startMs = 0;
+        double endMs = 0;
+    };
+
+    static bool applies(const boost::json::value& config);
+
+    explicit HcnGraph(boost::json::value& config);
+    void run(size_t workers);
+    void print(bool perNode = true) const;
+    HRESULT result() const;
+
+private:
+    size_t add(Kind kind, std::string name, const GUID& id, boost::json::value* settings);
+    void link(size_t parent, size_t child);
+    void execute(size_t index);
+    HRESULT executeNetwork(Node& node);
+    HRESULT executeEndpoint(Node& node);
+    HRESULT executeBinding(Node& node);
+
+    std::deque<Node> mNodes;
+    WorkStealingPool* mPool = nullptr;
+    std::chrono::steady_clock::time_point mStart;
+    std::unique_ptr<std::latch> mDone;
+    double mMakespanMs = 0;
+    size_t mWorkers = 0;
+    uint64_t mSteals = 0;
+    HcnPriority mPriority = HcnPriority::Normal;
+    HcnDeadlineScope::time_point mDeadline = HcnDeadlineScope::time_point::max();
+};
+
+bool HcnGraph::applies(const boost::json::value& config)
+{
+    const boost::json::object& root = config.as_object();
+    auto network = root.find("HcnNetwork");
+    auto endpoint = root.find("HcnEndpoint");
+    return (network != root.end() && network->value().is_array()) || (endpoint != root.end() && endpoint->value().is_array());
+}
+
+HcnGraph::HcnGraph(boost::json::value& config)
+{
+    auto parseGuid = [](const boost::json::value& jv, GUID& guid) {
+        return jv.is_string() && UuidFromStringA((RPC_CSTR)jv.as_string().c_str(), &guid) == RPC_S_OK;
+    };
+    auto elements = [](boost::json::value* jv) {
+        std::vector<boost::json::value*> out;
+        if (jv && jv->is_array())
+            for (auto& element : jv->as_array())
+                out.push_back(&element);
+        else if (jv && jv->is_object())
+            out.push_back(jv);
+        return out;
+    };
+
+    boost::json::object& root = config.as_object();
+    boost::json::object& adapters = (config / "HcsSystem" / "VirtualMachine" / "Devices" / "NetworkAdapters").as_object();
+
+    std::unordered_map<GUID, size_t, GuidHash> networks;
+    for (boost::json::value* settings : elements(root.if_contains("HcnNetwork")))
+    {
+        GUID id;
+        if (!parseGuid(*settings / "ID", id))
+        {
+            std::cout << std::format("{} - skipping network without a valid ID: {}\n", __func__, xstrUtf8(*settings));
+            continue;
+        }
+        if (networks.contains(id))
+        {
+            std::cout << std::format("{} - skipping duplicate network {}: {}\n", __func__, xstrGuid(id), xstrUtf8(*settings));
+            continue;
+        }
+        networks.emplace(id, add(Kind::Network, std::format("network {}", xstrGuid(id)), id, settings));
+    }
+
+    std::unordered_map<GUID, size_t, GuidHash> endpoints;
+    bool endpointArray = root.if_contains("HcnEndpoint") && root.at("HcnEndpoint").is_array();
+    for (boost::json::value* settings : elements(root.if_contains("HcnEndpoint")))
+    {
+        // A lone endpoint without an ID keeps the single-adapter convention of taking its
+        // GUID from NetworkAdapters.default.
+        GUID id;
+        const boost::json::object& object = settings->as_object();
+        bool hasId = object.contains("ID") ? parseGuid(object.at("ID"), id)
+            : !endpointArray && adapters.contains("default") && parseGuid(adapters.at("default") / "EndpointId", id);
+
+        GUID networkId;
+        auto network = parseGuid(*settings / "VirtualNetwork", networkId) ? networks.find(networkId) : networks.end();
+        if (!hasId || network == networks.end())
+        {
+            std::cout << std::format("{} - skipping endpoint without a valid ID or a VirtualNetwork in this config: {}\n", __func__, xstrUtf8(*settings));
+            continue;
+        }
+        if (endpoints.contains(id))
+        {
+            // Two nodes for one GUID would create and delete the same endpoint concurrently.
+            std::cout << std::format("{} - skipping duplicate endpoint {}: {}\n", __func__, xstrGuid(id), xstrUtf8(*settings));
+            continue;
+        }
+
+        size_t node = add(Kind::Endpoint, std::format("endpoint {}", xstrGuid(id)), id, settings);
+        link(network->second, node);
+        endpoints.emplace(id, node);
+    }
+
+    for (auto& [name, adapter] : adapters)
+    {
+        GUID id;
+        auto endpoint = adapter.is_object() && parseGuid(adapter / "EndpointId", id) ? endpoints.find(id) : endpoints.end();
+        if (endpoint == endpoints.end())
+            continue;
+
+        size_t node = add(Kind::Binding, std::format("adapter {}", std::string_view(name)), id, &adapter);
+        link(endpoint->second, node);
+    }
+}
+
+size_t HcnGraph::add(Kind kind, std::string name, const GUID& id, boost::json::value* settings)
+{
+    Node& node = mNodes.emplace_back();
+    node.kind = kind;
+    node.name = std::move(name);
+    node.id = id;
+    node.settings = settings;
+    return mNodes.size() - 1;
+}
+
+void HcnGraph::link(size_t parent, size_t child)
+{
+    mNodes[parent].dependents.push_back(child);
+    mNodes[child].parents.push_back(parent);
+    mNodes[child].waiting++;
+}
+
+void HcnGraph::run(size_t workers)
+{
+    mWorkers = workers;
+    mPriority = HcnPriorityScope::current();
+    mDeadline = HcnDeadlineScope::current();
+    mDone = std::make_unique<std::latch>(static_cast<ptrdiff_t>(mNodes.size()));
+    mStart = std::chrono::steady_clock::now();
+    {
+        WorkStealingPool pool(workers);
+        mPool = &pool;
+        for (size_t i = 0; i < mNodes.size(); ++i)
+        {
+            if (mNodes[i].parents.empty())
+                pool.submit([this, i] { execute(i); });
+        }
+        mDone->wait();
+        mSteals = pool.steals();
+        mPool = nullptr;
+    }
+    mMakespanMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStart).count();
+}
+
+void HcnGraph::execute(size_t index)
+{
+    HcnPriorityScope priority(mPriority);
+    HcnDeadlineScope deadline(mDeadline);
+    Node& node = mNodes[index];
+    node.startMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStart).count();
+
+    for (size_t parent : node.parents)
+    {
+        if (mNodes[parent].skipped || FAILED(mNodes[parent].result))
+        {
+            node.skipped = true;
+            node.result = mNodes[parent].result;
+        }
+    }
+
+    if (!node.skipped)
+    {
+        switch (node.kind)
+        {
+        case Kind::Network:  node.result = executeNetwork(node); break;
+        case Kind::Endpoint: node.result = executeEndpoint(node); break;
+        case Kind::Binding:  node.result = executeBinding(node); break;
+        }
+    }
+
+    node.endMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStart).count();
+    for (size_t dependent : node.dependents)
+    {
+        if (--mNodes[dependent].waiting == 0)
+            mPool->submit([this, dependent] { execute(dependent); });
+    }
+    mDone->count_down();
+}
+
+HRESULT HcnGraph::executeNetwork(Node& node)
+{
+    HcnNetworkResult network = mHcnNetworkFlight.run(xstrGuid(node.id), [&] {
+        return openOrCreateHcnNetwork(node.id, *node.settings);
+    });
+    node.network = network.network;
+    return network.result;
+}
+
+HRESULT HcnGraph::executeEndpoint(Node& node)
+{
+    const Node& network = mNodes[node.parents.front()];
+    return provisionHcnEndpoint(node.id, *node.settings, network.network->get(), node.endpoint);
+}
+
+HRESULT HcnGraph::executeBinding(Node& node)
+{
+    const Node& endpoint = mNodes[node.parents.front()];
+    wil::unique_cotaskmem_string properties;
+    HcnErrorRecord errStr;
+    HRESULT result = hcnInvoke(HcnCall::QueryEndpointProperties, node.id, 0, errStr, [&] {
+        return VmmgrHypervApi::HcnQueryEndpointProperties(endpoint.endpoint.get(), L"{}", &properties, &errStr);
+    });
+    if (FAILED(result))
+        return result;
+
+    try
+    {
+        boost::json::value jv = boost::json::parse(xstrUtf8(properties.get()));
+        if (const boost::json::value* mac = jv.as_object().if_contains("MacAddress"))
+            node.settings->as_object().insert_or_assign("MacAddress", *mac);
+    }
+    catch (std::exception& exc)
+    {
+        std::cout << std::format("{} - failed to parse endpoint properties: exc {}\n", __func__, exc.what());
+        return HCN_E_INVALID_JSON;
+    }
+    return S_OK;
+}
+
+// The first failure among the nodes (a skipped node carries its parent's), or S_OK.
+HRESULT HcnGraph::result() const
+{
+    for (const Node& node : mNodes)
+    {
+        if (FAILED(node.result))
+            return node.result;
+    }
+    return S_OK;
+}
+
+// The critical path is the chain of dependent nodes with the largest summed run time, and
+// parallelism is the summed run time of all nodes over the makespan.
+void HcnGraph::print(bool perNode) const
+{
+    std::vector<double> finish(mNodes.size());
+    std::vector<size_t> via(mNodes.size(), SIZE_MAX);
+    double busyMs = 0;
+    size_t last = 0;
+
+    // Nodes are added parents-first, so index order is a topological order.
+    for (size_t i = 0; i < mNodes.size(); ++i)
+    {
+        const Node& node = mNodes[i];
+        double duration = node.endMs - node.startMs;
+        busyMs += duration;
+        for (size_t parent : node.parents)
+        {
+            if (via[i] == SIZE_MAX || finish[parent] > finish[via[i]])
+                via[i] = parent;
+        }
+        finish[i] = duration + (via[i] == SIZE_MAX ? 0 : finish[via[i]]);
+        if (finish[i] > finish[last])
+            last = i;
+    }
+
+    std::vector<std::string> path;
+    for (size_t i = last; !mNodes.empty() && i != SIZE_MAX; i = via[i])
+        path.push_back(mNodes[i].name);
+    std::reverse(path.begin(), path.end());
+
+    std::cout << std::format("Graph: nodes {}, workers {}, steals {}, makespanMs {:.1f}, criticalPathMs {:.1f}, parallelism {:.2f}\n",
+        mNodes.size(), mWorkers, mSteals, mMakespanMs, mNodes.empty() ? 0.0 : finish[last], mMakespanMs > 0 ? busyMs / mMakespanMs : 0.0);
+
+    std::string chain;
+    for (const auto& name : path)
+        chain += (chain.empty() ? "" : " -> ") + name;
+    std::cout << std::format("  critical path: {}\n", chain);
+    if (!perNode)
+        return;
+
+    for (const Node& node : mNodes)
+    {
+        std::cout << std::format("  {:<50} startMs {:>8.1f}, durationMs {:>7.1f}, result {}{}\n",
+            node.name, node.startMs, node.endMs - node.startMs, node.result, node.skipped ? " (skipped)" : "");
+    }
+}
+
+#pragma endregion
+
+std::unique_ptr<HcnGraph> mHcnGraph;
+
+#pragma region Teardown
+
+// Deletes a set of endpoints and networks in parallel. Every endpoint delete is queued at
+// once on a work-stealing pool, and each network is deleted as soon as the last of its own
+// endpoints in the plan is gone instead of after the whole endpoint phase. A network one of
+// whose endpoints could not be deleted is skipped, and NOT_FOUND counts as done so that an
+// interrupted teardown can simply be run again. A network that configs only attach to may
+// be shared with other instances, so a plan built from configs keeps any network that still
+// has endpoints outside the plan.
+class HcnTeardown
+{
+public:
+    struct Plan
+    {
+        std::vector<GUID> networks;
+        std::vector<std::pair<GUID, GUID>> endpoints; // endpoint, the network it is attached to
+        std::vector<GUID> shared;                     // networks kept for endpoints outside the plan
+    };
+
+    struct Result
+    {
+        size_t endpointsDeleted = 0;
+        size_t networksDeleted = 0;
+        size_t notFound = 0;
+        size_t failed = 0;
+        size_t skipped = 0;
+        double seconds = 0;
+    };
+
+    static Plan fromConfigs(const std::vector<const boost::json::value*>& configs);
+    static void keepShared(Plan& plan, size_t workers);
+    static Plan fromOwner(const std::string& owner, size_t workers);
+    static Plan orphans(const std::string& owner, const std::vector<const boost::json::value*>& configs, size_t workers);
+
+    static Result run(const Plan& plan, size_t workers);
+    static void print(const Plan& plan, const Result* result);
+
+private:
+    static const boost::json::object* adapters(const boost::json::value& config);
+    static std::optional<std::vector<GUID>> enumerate(HcnCall call, const boost::json::object& filter);
+};
+
+const boost::json::object* HcnTeardown::adapters(const boost::json::value& config)
+{
+    const boost::json::value* jv = &config;
+    for (std::string_view key : { "HcsSystem", "VirtualMachine", "Devices", "NetworkAdapters" })
+        jv = jv && jv->is_object() ? jv->as_object().if_contains(key) : nullptr;
+    return jv && jv->is_object() ? &jv->as_object() : nullptr;
+}
+
+// Reads resource IDs the way HcnGraph does: HcnNetwork and HcnEndpoint may be objects or
+// arrays, and a lone endpoint without an ID takes its GUID from NetworkAdapters.default.
+HcnTeardown::Plan HcnTeardown::fromConfigs(const std::vector<const boost::json::value*>& configs)
+{
+    auto parseGuid = [](const boost::json::value* jv, GUID& guid) {
+        return jv && jv->is_string() && UuidFromStringA((RPC_CSTR)jv->as_string().c_str(), &guid) == RPC_S_OK;
+    };
+    auto elements = [](const boost::json::value* jv) {
+        std::vector<const boost::json::object*> out;
+        if (jv && jv->is_array())
+        {
+            for (const auto& element : jv->as_array())
+                if (element.is_object())
+                    out.push_back(&element.as_object());
+        }
+        else if (jv && jv->is_object())
+        {
+            out.push_back(&jv->as_object());
+        }
+        return out;
+    };
+
+    Plan plan;
+    std::unordered_set<GUID, GuidHash> seen;
+    for (const boost::json::value* config : configs)
+    {
+        const boost::json::object& root = config->as_object();
+        for (const boost::json::object* settings : elements(root.if_contains("HcnNetwork")))
+        {
+            GUID id;
+            if (parseGuid(settings->if_contains("ID"), id) && seen.insert(id).second)
+                plan.networks.push_back(id);
+        }
+
+        const boost::json::value* endpoints = root.if_contains("HcnEndpoint");
+        const boost::json::object* entries = adapters(*config);
+        const boost::json::value* defaultEndpoint = entries ? entries->if_contains("default") : nullptr;
+        defaultEndpoint = defaultEndpoint && defaultEndpoint->is_object() ? defaultEndpoint->as_object().if_contains("EndpointId") : nullptr;
+        for (const boost::json::object* settings : elements(endpoints))
+        {
+            GUID id;
+            GUID network{};
+            bool hasId = settings->contains("ID") ? parseGuid(settings->if_contains("ID"), id)
+                : !endpoints->is_array() && parseGuid(defaultEndpoint, id);
+            parseGuid(settings->if_contains("VirtualNetwork"), network);
+            if (hasId && seen.insert(id).second)
+                plan.endpoints.emplace_back(id, network);
+        }
+    }
+    return plan;
+}
+
+// Moves every planned network that still has an endpoint the plan does not delete into
+// plan.shared, with one filtered HcnEnumerateEndpoints per network. A network whose
+// endpoints cannot be enumerated is kept as well.
+void HcnTeardown::keepShared(Plan& plan, size_t workers)
+{
+    std::unordered_set<GUID, GuidHash> planned;
+    for (const auto& [endpoint, network] : plan.endpoints)
+        planned.insert(endpoint);
+
+    std::vector<uint8_t> shared(plan.networks.size());
+    HcnPriority priority = HcnPriorityScope::current();
+    HcnDeadlineScope::time_point deadline = HcnDeadlineScope::current();
+    std::latch done(static_cast<ptrdiff_t>(plan.networks.size()));
+    {
+        WorkStealingPool pool(workers);
+        for (size_t i = 0; i < plan.networks.size(); ++i)
+        {
+            pool.submit([&, i] {
+                HcnPriorityScope priorityScope(priority);
+                HcnDeadlineScope deadlineScope(deadline);
+                std::optional<std::vector<GUID>> endpoints = enumerate(HcnCall::EnumerateEndpoints,
+                    boost::json::object{ { "VirtualNetwork", xstrGuid(plan.networks[i]) } });
+                shared[i] = !endpoints || std::ranges::any_of(*endpoints, [&](const GUID& id) { return !planned.contains(id); });
+                done.count_down();
+            });
+        }
+        done.wait();
+    }
+
+    std::vector<GUID> networks;
+    for (size_t i = 0; i < plan.networks.size(); ++i)
+        (shared[i] ? plan.shared : networks).push_back(plan.networks[i]);
+    plan.networks = std::move(networks);
+}
+
+HcnTeardown::Plan HcnTeardown::fromOwner(const std::string& owner, size_t workers)
+{
+    Plan plan;
+    plan.networks = enumerate(HcnCall::EnumerateNetworks, boost::json::object{ { "Owner", owner } }).value_or(std::vector<GUID>{});
+
+    std::vector<std::vector<GUID>> endpoints(plan.networks.size());
+    HcnPriority priority = HcnPriorityScope::current();
+    HcnDeadlineScope::time_point deadline = HcnDeadlineScope::current();
+    std::latch done(static_cast<ptrdiff_t>(plan.networks.size()));
+    {
+        WorkStealingPool pool(workers);
+        for (size_t i = 0; i < plan.networks.size(); ++i)
+        {
+            pool.submit([&, i] {
+                HcnPriorityScope priorityScope(priority);
+                HcnDeadlineScope deadlineScope(deadline);
+                endpoints[i] = enumerate(HcnCall::EnumerateEndpoints, boost::json::object{ { "VirtualNetwork", xstrGuid(plan.networks[i]) } })
+                    .value_or(std::vector<GUID>{});
+                done.count_down();
+            });
+        }
+        done.wait();
+    }
+
+    for (size_t i = 0; i < plan.networks.size(); ++i)
+    {
+        for (const GUID& endpoint : endpoints[i])
+            plan.endpoints.emplace_back(endpoint, plan.networks[i]);
+    }
+    return plan;
+}
+
+// The owner's endpoints that no config references, either as an HcnEndpoint or as the
+// EndpointId of a NetworkAdapters entry. The networks themselves are left in place.
+HcnTeardown::Plan HcnTeardown::orphans(const std::string& owner, const std::vector<const boost::json::value*>& configs, size_t workers)
+{
+    std::unordered_set<GUID, GuidHash> referenced;
+    for (const auto& [endpoint, network] : fromConfigs(configs).endpoints)
+        referenced.insert(endpoint);
+    for (const boost::json::value* config : configs)
+    {
+        const boost::json::object* entries = adapters(*config);
+        if (entries == nullptr)
+            continue;
+
+        for (const auto& [name, adapter] : *entries)
+        {
+            GUID id;
+            const boost::json::value* endpointId = adapter.is_object() ? adapter.as_object().if_contains("EndpointId") : nullptr;
+            if (endpointId && endpointId->is_string() && UuidFromStringA((RPC_CSTR)endpointId->as_string().c_str(), &id) == RPC_S_OK)
+                referenced.insert(id);
+        }
+    }
+
+    Plan plan;
+    for (const auto& endpoint : fromOwner(owner, workers).endpoints)
+    {
+        if (!referenced.contains(endpoint.first))
+            plan.endpoints.push_back(endpoint);
+    }
+    return plan;
+}
+
+// Empty when the enumeration failed, as opposed to finding nothing.
+std::optional<std::vector<GUID>> HcnTeardown::enumerate(HcnCall call, const boost::json::object& filter)
+{
+    auto fn = call == HcnCall::EnumerateNetworks ? VmmgrHypervApi::HcnEnumerateNetworks : VmmgrHypervApi::HcnEnumerateEndpoints;
+    std::wstring query = xstrUtf16(boost::json::value(boost::json::object{
+        { "SchemaVersion", boost::json::object{ { "Major", 2 }, { "Minor", 0 } } },
+        { "Flags", 0 },
+        { "Filter", boost::json::serialize(filter) },
+    }));
+
+    wil::unique_cotaskmem_string ids;
+    HcnErrorRecord errStr;
+    HRESULT result = hcnInvoke(call, GUID{}, 0, errStr, [&] {
+        return fn(query.c_str(), &ids, &errStr);
+    });
+
+    std::vector<GUID> out;
+    try
+    {
+        if (FAILED(result))
+            throw std::runtime_error(std::format("result {}, errStr {}", result, errStr.describe(result)));
+
+        boost::json::value jv = boost::json::parse(xstrUtf8(ids.get()));
+        for (const auto& id : jv.as_array())
+        {
+            GUID guid;
+            if (UuidFromStringA((RPC_CSTR)id.as_string().c_str(), &guid) == RPC_S_OK)
+                out.push_back(guid);
+        }
+    }
+    catch (std::exception& exc)
+    {
+        std::cout << std::format("{} - {} {} failed: {}\n", __func__, hcnCallName(call), boost::json::serialize(filter), exc.what());
+        return std::nullopt;
+    }
+    return out;
+}
+
+HcnTeardown::Result HcnTeardown::run(const Plan& plan, size_t workers)
+{
+    struct Network
+    {
+        GUID id{};
+        std::atomic<size_t> remaining{ 0 };
+        std::atomic<bool> blocked{ false };
+    };
+
+    std::deque<Network> networks;
+    std::unordered_map<GUID, size_t, GuidHash> index;
+    for (const GUID& id : plan.networks)
+    {
+        if (index.emplace(id, networks.size()).second)
+            networks.emplace_back().id = id;
+    }
+
+    std::vector<size_t> parent(plan.endpoints.size(), SIZE_MAX);
+    for (size_t i = 0; i < plan.endpoints.size(); ++i)
+    {
+        if (auto it = index.find(plan.endpoints[i].second); it != index.end())
+        {
+            parent[i] = it->second;
+            networks[it->second].remaining++;
+        }
+    }
+
+    std::atomic<size_t> endpointsDeleted{ 0 }, networksDeleted{ 0 }, notFound{ 0 }, failed{ 0 }, skipped{ 0 };
+    HcnPriority priority = HcnPriorityScope::current();
+    HcnDeadlineScope::time_point deadline = HcnDeadlineScope::current();
+    std::latch done(static_cast<ptrdiff_t>(plan.endpoints.size() + networks.size()));
+
+    auto deleteNetwork = [&](size_t n) {
+        HcnPriorityScope priorityScope(priority);
+        HcnDeadlineScope deadlineScope(deadline);
+        Network& network = networks[n];
+        if (network.blocked)
+        {
+            skipped++;
+            std::cout << std::format("{} - skipping network {}: an endpoint on it was not deleted\n", __func__, xstrGuid(network.id));
+        }
+        else
+        {
+            HcnErrorRecord errStr;
+            HRESULT result = hcnInvoke(HcnCall::DeleteNetwork, network.id, 0, errStr, [&] {
+                return VmmgrHypervApi::HcnDeleteNetwork(network.id, &errStr);
+            });
+            if (SUCCEEDED(result))
+                networksDeleted++;
+            else if (result == HCN_E_NETWORK_NOT_FOUND)
+                notFound++;
+            else
+            {
+                failed++;
+                std::cout << std::format("{} - HcnDeleteNetwork {}: result {}, errStr {}\n", __func__, xstrGuid(network.id), result, errStr.describe(result));
+            }
+
+            if (SUCCEEDED(result) || result == HCN_E_NETWORK_NOT_FOUND)
+            {
+                recordHcnNetwork(network.id, false);
+                mHcnNetworks.erase(network.id);
+            }
+        }
+        done.count_down();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        WorkStealingPool pool(workers);
+        for (size_t n = 0; n < networks.size(); ++n)
+        {
+            if (networks[n].remaining == 0)
+                pool.submit([&, n] { deleteNetwork(n); });
+        }
+
+        for (size_t i = 0; i < plan.endpoints.size(); ++i)
+        {
+            pool.submit([&, i] {
+                {
+                    HcnPriorityScope priorityScope(priority);
+                    HcnDeadlineScope deadlineScope(deadline);
+                    const GUID& id = plan.endpoints[i].first;
+                    HcnErrorRecord errStr;
+                    HRESULT result = hcnInvoke(HcnCall::DeleteEndpoint, id, 0, errStr, [&] {
+                        return VmmgrHypervApi::HcnDeleteEndpoint(id, &errStr);
+                    });
+                    bool gone = SUCCEEDED(result) || result == HCN_E_ENDPOINT_NOT_FOUND;
+                    if (SUCCEEDED(result))
+                        endpointsDeleted++;
+                    else if (gone)
+                        notFound++;
+                    else
+                    {
+                        failed++;
+                        std::cout << std::format("{} - HcnDeleteEndpoint {}: result {}, errStr {}\n", __func__, xstrGuid(id), result, errStr.describe(result));
+                    }
+
+                    if (gone)
+                    {
+                        recordHcnEndpoint(id, false);
+                        mHcnEndpoints.erase(id);
+                    }
+                    if (size_t n = parent[i]; n != SIZE_MAX)
+                    {
+                        if (!gone)
+                            networks[n].blocked = true;
+                        if (--networks[n].remaining == 0)
+                            pool.submit([&, n] { deleteNetwork(n); });
+                    }
+                }
+                done.count_down();
+            });
+        }
+        done.wait();
+    }
+
+    Result result;
+    result.endpointsDeleted = endpointsDeleted;
+    result.networksDeleted = networksDeleted;
+    result.notFound = notFound;
+    result.failed = failed;
+    result.skipped = skipped;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Without a result the plan is only listed, as for --dry-run.
+void HcnTeardown::print(const Plan& plan, const Result* result)
+{
+    std::cout << std::format("Teardown: networks {}, endpoints {}, sharedKept {}", plan.networks.size(), plan.endpoints.size(), plan.shared.size());
+    if (result == nullptr)
+    {
+        std::cout << " (dry run)\n";
+        for (const GUID& network : plan.networks)
+            std::cout << std::format("  network  {}\n", xstrGuid(network));
+        for (const GUID& network : plan.shared)
+            std::cout << std::format("  network  {} (kept: other endpoints remain)\n", xstrGuid(network));
+        for (const auto& [endpoint, network] : plan.endpoints)
+            std::cout << std::format("  endpoint {} on {}\n", xstrGuid(endpoint), xstrGuid(network));
+        return;
+    }
+
+    size_t resources = plan.networks.size() + plan.endpoints.size();
+    std::cout << std::format(", endpointsDeleted {}, networksDeleted {}, notFound {}, failed {}, skipped {}, seconds {:.2f}, resourcesPerSec {:.1f}\n",
+        result->endpointsDeleted, result->networksDeleted, result->notFound, result->failed, result->skipped,
+        result->seconds, result->seconds > 0 ? resources / result->seconds : 0.0);
+}
+
+#pragma endregion
+
+// --teardown deletes what --config (and every file in --teardown-configs) describes,
+// --teardown-owner deletes every network tagged with --owner and its endpoints, and
+// --sweep-orphans deletes only the endpoints on those networks that no config references.
+void runTeardown(int argc, char* argv[])
+{
+    std::vector<boost::json::value> others;
+    std::string paths = xargValue(argc, argv, "--teardown-configs", "");
+    for (size_t begin = 0; begin < paths.size();)
+    {
+        size_t end = std::min(paths.find(',', begin), paths.size());
+        if (end > begin)
+            others.push_back(xjsonReadFromFile(std::filesystem::path(paths.substr(begin, end - begin))));
+        begin = end + 1;
+    }
+
+    std::vector<const boost::json::value*> configs{ &mAndroidJson };
+    for (const auto& config : others)
+        configs.push_back(&config);
+
+    size_t workers = std::stoul(xargValue(argc, argv, "--teardown-workers", "8"));
+    std::string owner = xargValue(argc, argv, "--owner", "BluestacksNxt");
+    HcnTeardown::Plan plan;
+    if (xargFlag(argc, argv, "--sweep-orphans"))
+        plan = HcnTeardown::orphans(owner, configs, workers);
+    else if (xargFlag(argc, argv, "--teardown-owner"))
+        plan = HcnTeardown::fromOwner(owner, workers);
+    else
+    {
+        plan = HcnTeardown::fromConfigs(configs);
+        HcnTeardown::keepShared(plan, workers);
+    }
+
+    if (xargFlag(argc, argv, "--dry-run"))
+    {
+        HcnTeardown::print(plan, nullptr);
+        return;
+    }
+
+    HcnTeardown::Result result = HcnTeardown::run(plan, workers);
+    HcnTeardown::print(plan, &result);
+}
+
+#pragma region Health
+
+// Background prober for the networks and endpoints a config describes. A round costs one
+// HcnEnumerateNetworks for all networks and one filtered HcnEnumerateEndpoints per network,
+// which answers existence for all of that network's endpoints at once; only the endpoints
+// that exist have their policies (the NAT port mapping among them) compared with the config,
+// through a handle kept open between rounds. Network probes are spread evenly over the
+// interval instead of being issued as one burst, and only a resource found missing or
+// drifted is re-provisioned. The prober's CPU time is measured per round; when it exceeds
+// the budget per 1,000 endpoints, the share of endpoints whose policies are compared each
+// round shrinks (a rotating cursor still covers them all over several rounds).
+class HcnHealthProber
+{
+public:
+    struct Options
+    {
+        std::chrono::milliseconds interval{ 10000 };
+        double cpuBudgetMs = 20.0; // per 1,000 endpoints per round, 0 for no budget
+        bool repair = true;
+    };
+
+    struct Stats
+    {
+        uint64_t rounds = 0;
+        uint64_t networkProbes = 0;
+        uint64_t policyChecks = 0;
+        uint64_t hostCalls = 0;
+        uint64_t networkDrift = 0;
+        uint64_t endpointDrift = 0;
+        uint64_t repaired = 0;
+        uint64_t repairFailed = 0;
+        size_t networks = 0;
+        size_t endpoints = 0;
+        double policyShare = 1.0;
+        double cpuMsPer1000 = 0;
+        double p50Ms = 0;
+        double p99Ms = 0;
+    };
+
+    // The config must outlive the prober; its settings are the desired state.
+    HcnHealthProber(const boost::json::value& config, Options options);
+    ~HcnHealthProber() { stop(); }
+
+    void start();
+    void stop();
+    void probeRound();
+    Stats stats();
+    void print();
+
+private:
+    struct Endpoint
+    {
+        GUID id{};
+        const boost::json::value* settings = nullptr;
+        unique_hcn_endpoint handle;
+    };
+
+    struct Network
+    {
+        GUID id{};
+        const boost::json::value* settings = nullptr;
+        std::shared_ptr<unique_hcn_network> handle;
+        std::vector<Endpoint> endpoints;
+        size_t cursor = 0;
+    };
+
+    static double threadCpuMs();
+    bool waitUntil(std::chrono::steady_clock::time_point deadline);
+    void probe(Network& network, bool networkPresent);
+    bool drifted(Endpoint& endpoint, uint64_t& hostCalls);
+    void repairNetwork(Network& network);
+    void repairEndpoint(Network& network, Endpoint& endpoint);
+
+    Options mOptions;
+    std::vector<Network> mNetworks;
+    size_t mEndpointCount = 0;
+    double mPolicyShare = 1.0;
+
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    bool mStop = false;
+
+    Stats mStats;
+    std::vector<double> mLatencyMs;
+    size_t mLatencyNext = 0;
+    static constexpr size_t kLatencySamples = 4096;
+};
+
+// Resources are read as HcnGraph reads them: HcnNetwork and HcnEndpoint may be objects or
+// arrays, and a lone endpoint without an ID takes its GUID from NetworkAdapters.default.
+HcnHealthProber::HcnHealthProber(const boost::json::value& config, Options options) : mOptions(options)
+{
+    auto parseGuid = [](const boost::json::value* jv, GUID& guid) {
+        return jv && jv->is_string() && UuidFromStringA((RPC_CSTR)jv->as_string().c_str(), &guid) == RPC_S_OK;
+    };
+    auto elements = [](const boost::json::value* jv) {
+        std::vector<const boost::json::value*> out;
+        if (jv && jv->is_array())
+        {
+            for (const auto& element : jv->as_array())
+                if (element.is_object())
+                    out.push_back(&element);
+        }
+        else if (jv && jv->is_object())
+        {
+            out.push_back(jv);
+        }
+        return out;
+    };
+
+    const boost::json::object& root = config.as_object();
+    std::unordered_map<GUID, size_t, GuidHash> networks;
+    for (const boost::json::value* settings : elements(root.if_contains("HcnNetwork")))
+    {
+        GUID id;
+        if (parseGuid(settings->as_object().if_contains("ID"), id) && networks.emplace(id, mNetworks.size()).second)
+            mNetworks.push_back(Network{ .id = id, .settings = settings });
+    }
+
+    const boost::json::value* endpoints = root.if_contains("HcnEndpoint");
+    const boost::json::value* defaultEndpoint = &config;
+    for (std::string_view key : { "HcsSystem", "VirtualMachine", "Devices", "NetworkAdapters", "default", "EndpointId" })
+        defaultEndpoint = defaultEndpoint && defaultEndpoint->is_object() ? defaultEndpoint->as_object().if_contains(key) : nullptr;
+
+    for (const boost::json::value* settings : elements(endpoints))
+    {
+        const boost::json::object& object = settings->as_object();
+        GUID id;
+        GUID networkId;
+        bool hasId = object.contains("ID") ? parseGuid(object.if_contains("ID"), id) : !endpoints->is_array() && parseGuid(defaultEndpoint, id);
+        auto network = parseGuid(object.if_contains("VirtualNetwork"), networkId) ? networks.find(networkId) : networks.end();
+        if (!hasId || network == networks.end())
+            continue;
+
+        mNetworks[network->second].endpoints.push_back(Endpoint{ .id = id, .settings = settings });
+        mEndpointCount++;
+    }
+
+    mStats.networks = mNetworks.size();
+    mStats.endpoints = mEndpointCount;
+    mLatencyMs.reserve(kLatencySamples);
+}
+
+void HcnHealthProber::start()
+{
+    mThread = std::thread([this] {
+        HcnPriorityScope priority(HcnPriority::Bulk);
+        for (;;)
+        {
+            {
+                std::scoped_lock lock(mMutex);
+                if (mStop)
+                    return;
+            }
+            probeRound();
+        }
+    });
+}
+
+void HcnHealthProber::stop()
+{
+    {
+        std::scoped_lock lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_all();
+    if (mThread.joinable())
+        mThread.join();
+}
+
+double HcnHealthProber::threadCpuMs()
+{
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0;
+
+    auto ticks = [](const FILETIME& ft) { return (uint64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime; };
+    return (ticks(kernel) + ticks(user)) / 10000.0;
+}
+
+// Returns false when the prober was stopped while waiting.
+bool HcnHealthProber::waitUntil(std::chrono::steady_clock::time_point deadline)
+{
+    std::unique_lock lock(mMutex);
+    return !mWake.wait_until(lock, deadline, [&] { return mStop; });
+}
+
+void HcnHealthProber::probeRound()
+{
+    auto roundStart = std::chrono::steady_clock::now();
+    double cpuMs = 0;
+    double cpuStart = threadCpuMs();
+
+    wil::unique_cotaskmem_string ids;
+    HcnErrorRecord errStr;
+    HRESULT result = hcnInvoke(HcnCall::EnumerateNetworks, GUID{}, 0, errStr, [&] {
+        return VmmgrHypervApi::HcnEnumerateNetworks(L"{}", &ids, &errStr);
+    });
+
+    std::unordered_set<GUID, GuidHash> present;
+    try
+    {
+        if (FAILED(result))
+            throw std::runtime_error(std::format("result {}, errStr {}", result, errStr.describe(result)));
+
+        boost::json::value jv = boost::json::parse(xstrUtf8(ids.get()));
+        for (const auto& id : jv.as_array())
+        {
+            GUID guid;
+            if (UuidFromStringA((RPC_CSTR)id.as_string().c_str(), &guid) == RPC_S_OK)
+                present.insert(guid);
+        }
+    }
+    catch (std::exception& exc)
+    {
+        // Without the list no network can be called missing; the round still probes endpoints.
+        std::cout << std::format("{} - HcnEnumerateNetworks failed: {}\n", __func__, exc.what());
+        for (const Network& network : mNetworks)
+            present.insert(network.id);
+    }
+    {
+        std::scoped_lock lock(mMutex);
+        mStats.hostCalls++;
+    }
+
+    for (size_t i = 0; i < mNetworks.size(); ++i)
+    {
+        cpuMs += threadCpuMs() - cpuStart;
+        if (!waitUntil(roundStart + mOptions.interval * i / mNetworks.size()))
+            return;
+        cpuStart = threadCpuMs();
+        probe(mNetworks[i], present.contains(mNetworks[i].id));
+    }
+    cpuMs += threadCpuMs() - cpuStart;
+
+    // Cost scales with the share of endpoints whose policies are compared, so the share is
+    // cut in proportion when over budget and grown back slowly when under it.
+    double cpuMsPer1000 = mEndpointCount > 0 ? cpuMs * 1000.0 / mEndpointCount : 0.0;
+    if (mEndpointCount > 0 && mOptions.cpuBudgetMs > 0 && cpuMsPer1000 > mOptions.cpuBudgetMs)
+        mPolicyShare = std::max(mPolicyShare * mOptions.cpuBudgetMs / cpuMsPer1000, 1.0 / mEndpointCount);
+    else
+        mPolicyShare = std::min(mPolicyShare * 1.25, 1.0);
+
+    {
+        std::scoped_lock lock(mMutex);
+        mStats.rounds++;
+        mStats.cpuMsPer1000 = cpuMsPer1000;
+        mStats.policyShare = mPolicyShare;
+    }
+    waitUntil(roundStart + mOptions.interval);
+}
+
+void HcnHealthProber::probe(Network& network, bool networkPresent)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t hostCalls = 0;
+    uint64_t policyChecks = 0;
+    std::vector<Endpoint*> drift;
+
+    if (!networkPresent)
+    {
+        {
+            std::scoped_lock lock(mMutex);
+            mStats.networkDrift++;
+        }
+        std::cout << std::format("{} - network {} is missing\n", __func__, xstrGuid(network.id));
+        network.handle.reset();
+        for (Endpoint& endpoint : network.endpoints)
+            drift.push_back(&endpoint);
+        if (mOptions.repair)
+            repairNetwork(network);
+    }
+    else if (!network.endpoints.empty())
+    {
+        std::wstring query = xstrUtf16(boost::json::value(boost::json::object{
+            { "SchemaVersion", boost::json::object{ { "Major", 2 }, { "Minor", 0 } } },
+            { "Flags", 0 },
+            { "Filter", boost::json::serialize(boost::json::object{ { "VirtualNetwork", xstrGuid(network.id) } }) },
+        }));
+        wil::unique_cotaskmem_string ids;
+        HcnErrorRecord errStr;
+        HRESULT result = hcnInvoke(HcnCall::EnumerateEndpoints, GUID{}, 0, errStr, [&] {
+            return VmmgrHypervApi::HcnEnumerateEndpoints(query.c_str(), &ids, &errStr);
+        });
+        hostCalls++;
+
+        std::unordered_set<GUID, GuidHash> endpoints;
+        bool listed = SUCCEEDED(result);
+        try
+        {
+            if (listed)
+            {
+                boost::json::value jv = boost::json::parse(xstrUtf8(ids.get()));
+                for (const auto& id : jv.as_array())
+                {
+                    GUID guid;
+                    if (UuidFromStringA((RPC_CSTR)id.as_string().c_str(), &guid) == RPC_S_OK)
+                        endpoints.insert(guid);
+                }
+            }
+        }
+        catch (std::exception&)
+        {
+            listed = false;
+        }
+
+        size_t checks = static_cast<size_t>(std::ceil(mPolicyShare * network.endpoints.size()));
+        for (size_t i = 0; i < network.endpoints.size(); ++i)
+        {
+            Endpoint& endpoint = network.endpoints[i];
+            if (listed && !endpoints.contains(endpoint.id))
+            {
+                endpoint.handle.reset();
+                drift.push_back(&endpoint);
+                continue;
+            }
+
+            size_t offset = (i + network.endpoints.size() - network.cursor) % network.endpoints.size();
+            if (offset >= checks)
+                continue;
+
+            policyChecks++;
+            if (drifted(endpoint, hostCalls))
+                drift.push_back(&endpoint);
+        }
+        network.cursor = (network.cursor + checks) % network.endpoints.size();
+    }
+
+    for (Endpoint* endpoint : drift)
+    {
+        std::cout << std::format("{} - endpoint {} drifted\n", __func__, xstrGuid(endpoint->id));
+        if (mOptions.repair)
+            repairEndpoint(network, *endpoint);
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::scoped_lock lock(mMutex);
+    mStats.networkProbes++;
+    mStats.hostCalls += hostCalls;
+    mStats.policyChecks += policyChecks;
+    mStats.endpointDrift += drift.size();
+    if (mLatencyMs.size() < kLatencySamples)
+        mLatencyMs.push_back(ms);
+    else
+        mLatencyMs[mLatencyNext++ % kLatencySamples] = ms;
+}
+
+// Compares the endpoint's current properties with its settings the way an in-place update
+// would; an endpoint that cannot be opened or queried counts as drifted.
+bool HcnHealthProber::drifted(Endpoint& endpoint, uint64_t& hostCalls)
+{
+    HcnErrorRecord errStr;
+    if (!endpoint.handle)
+    {
+        hostCalls++;
+        HRESULT result = hcnInvoke(HcnCall::OpenEndpoint, endpoint.id, 0, errStr, [&] {
+            return VmmgrHypervApi::HcnOpenEndpoint(endpoint.id, endpoint.handle.put(), &errStr);
+        });
+        if (FAILED(result))
+            return true;
+    }
+
+    hostCalls++;
+    wil::unique_cotaskmem_string properties;
+    HRESULT result = hcnInvoke(HcnCall::QueryEndpointProperties, endpoint.id, 0, errStr, [&] {
+        return VmmgrHypervApi::HcnQueryEndpointProperties(endpoint.handle.get(), L"{}", &properties, &errStr);
+    });
+    if (FAILED(result))
+    {
+        endpoint.handle.reset();
+        return true;
+    }
+
+    try
+    {
+        HcnEndpointDelta delta = diffHcnEndpoint(boost::json::parse(xstrUtf8(properties.get())), *endpoint.settings);
+        return delta.recreate || !delta.empty();
+    }
+    catch (std::exception&)
+    {
+        return true;
+    }
+}
+
+void HcnHealthProber::repairNetwork(Network& network)
+{
+    HcnNetworkResult result = mHcnNetworkFlight.run(xstrGuid(network.id), [&] {
+        return openOrCreateHcnNetwork(network.id, *network.settings);
+    });
+    network.handle = result.network;
+
+    std::scoped_lock lock(mMutex);
+    (SUCCEEDED(result.result) ? mStats.repaired : mStats.repairFailed)++;
+}
+
+void HcnHealthProber::repairEndpoint(Network& network, Endpoint& endpoint)
+{
+    if (!network.handle)
+    {
+        network.handle = mHcnNetworkFlight.run(xstrGuid(network.id), [&] {
+            return openOrCreateHcnNetwork(network.id, *network.settings);
+        }).network;
+    }
+
+    HRESULT result = network.handle ? provisionHcnEndpoint(endpoint.id, *endpoint.settings, network.handle->get(), endpoint.handle)
+        : HCN_E_NETWORK_NOT_FOUND;
+
+    std::scoped_lock lock(mMutex);
+    (SUCCEEDED(result) ? mStats.repaired : mStats.repairFailed)++;
+}
+
+HcnHealthProber::Stats HcnHealthProber::stats()
+{
+    std::scoped_lock lock(mMutex);
+    Stats stats = mStats;
+    stats.p50Ms = xpercentile(mLatencyMs, 50);
+    stats.p99Ms = xpercentile(mLatencyMs, 99);
+    return stats;
+}
+
+void HcnHealthProber::print()
+{
+    Stats stats = this->stats();
+    std::cout << std::format("Health: networks {}, endpoints {}, rounds {}, networkProbes {}, policyChecks {}, hostCalls {}, networkDrift {}, endpointDrift {}, repaired {}, repairFailed {}\n",
+        stats.networks, stats.endpoints, stats.rounds, stats.networkProbes, stats.policyChecks, stats.hostCalls,
+        stats.networkDrift, stats.endpointDrift, stats.repaired, stats.repairFailed);
+    std::cout << std::format("  probe p50Ms {:.2f}, p99Ms {:.2f}, cpuMsPer1000 {:.2f} (budget {:.2f}), policyShare {:.2f}\n",
+        stats.p50Ms, stats.p99Ms, stats.cpuMsPer1000, mOptions.cpuBudgetMs, stats.policyShare);
+}
+
+#pragma endregion
+
+std::unique_ptr<HcnHealthProber> mHcnHealthProber;
+
+// Points the HCN API at ComputeNetwork.dll, unless a backend is already installed, and wraps
+// it the way a start does: per-call deadlines, retry and the call trace.
+void initHcnBackend(int argc, char* argv[])
+{
+    VmmgrHypervApi::init();
+    if (int64_t timeout = std::stoll(xargValue(argc, argv, "--hcn-timeout-ms", "30000")); timeout > 0)
+        HcnDeadline::install(std::chrono::milliseconds(timeout));
+    HcnRetry::instance().configure(HcnRetry::Options{ .maxAttempts = std::stoul(xargValue(argc, argv, "--retry-attempts", "4")) });
+    HcnRetry::instance().setEnabled(!xargFlag(argc, argv, "--no-retry"));
+    if (!xargFlag(argc, argv, "--no-trace"))
+        HcnTrace::instance().open(xargValue(argc, argv, "--trace-file", "hcn.trace"), std::stoull(xargValue(argc, argv, "--trace-capacity", "65536")));
+}
+
+#pragma region Fleet
+
+// Consistent-hash ring from config paths to worker indices. Every worker owns kVirtualNodes
+// points, so removing a worker moves only the configs it owned, spread over the survivors.
+class FleetRing
+{
+public:
+    static constexpr size_t kVirtualNodes = 64;
+
+    explicit FleetRing(size_t workers);
+    void remove(size_t worker);
+    std::optional<size_t> owner(std::string_view key) const;
+
+private:
+    std::vector<std::pair<uint64_t, size_t>> mPoints;
+};
+
+FleetRing::FleetRing(size_t workers)
+{
+    for (size_t worker = 0; worker < workers; ++worker)
+    {
+        for (size_t node = 0; node < kVirtualNodes; ++node)
+        {
+            std::string point = std::format("worker{}#{}", worker, node);
+            mPoints.emplace_back(xhash64(point.data(), point.size()), worker);
+        }
+    }
+    std::sort(mPoints.begin(), mPoints.end());
+}
+
+void FleetRing::remove(size_t worker)
+{
+    std::erase_if(mPoints, [&](const auto& point) { return point.second == worker; });
+}
+
+std::optional<size_t> FleetRing::owner(std::string_view key) const
+{
+    if (mPoints.empty())
+        return std::nullopt;
+
+    uint64_t hash = xhash64(key.data(), key.size());
+    auto it = std::lower_bound(mPoints.begin(), mPoints.end(), std::pair<uint64_t, size_t>{ hash, 0 });
+    return (it == mPoints.end() ? mPoints.front() : *it).second;
+}
+
+// Newline-delimited JSON messages over a byte-mode named pipe.
+class FleetChannel
+{
+public:
+    explicit FleetChannel(wil::unique_hfile pipe) : mPipe(std::move(pipe)) {}
+
+    bool send(const boost::json::value& message);
+    std::optional<boost::json::value> receive();
+
+private:
+    wil::unique_hfile mPipe;
+    std::string mBuffer;
+};
+
+bool FleetChannel::send(const boost::json::value& message)
+{
+    std::string line = boost::json::serialize(message) + "\n";
+    for (size_t offset = 0; offset < line.size();)
+    {
+        DWORD written = 0;
+        if (!WriteFile(mPipe.get(), line.data() + offset, static_cast<DWORD>(line.size() - offset), &written, nullptr))
+            return false;
+        offset += written;
+    }
+    return true;
+}
+
+// Returns nothing once the other end is gone or sends something that is not JSON.
+std::optional<boost::json::value> FleetChannel::receive()
+{
+    for (;;)
+    {
+        if (size_t newline = mBuffer.find('\n'); newline != std::string::npos)
+        {
+            std::string line = mBuffer.substr(0, newline);
+            mBuffer.erase(0, newline + 1);
+            try
+            {
+                return boost::json::parse(line);
+            }
+            catch (std::exception&)
+            {
+                return std::nullopt;
+            }
+        }
+
+        char chunk[4096];
+        DWORD read = 0;
+        if (!ReadFile(mPipe.get(), chunk, sizeof(chunk), &read, nullptr) || read == 0)
+            return std::nullopt;
+        mBuffer.append(chunk, read);
+    }
+}
+
+// Spreads configs over worker processes, each running the single-start provisioning path on
+// its own copy of the process-wide state (mAndroidJson and the handle registries) and its
+// own console. Configs are assigned by consistent hashing of their path and streamed to each
+// worker over its named pipe with up to `window` requests outstanding. When a worker dies,
+// its queued and unanswered configs are rehashed onto the remaining workers; provisioning is
+// open-or-create, so a config the dead worker had half done is simply done again.
+class FleetCoordinator
+{
+public:
+    struct Options
+    {
+        size_t workers = 4;
+        size_t window = 2;
+        size_t killAfter = 0;   // terminate worker 0 after this many results, to exercise rebalancing
+        std::string workerArgs; // passed through to every worker
+        std::filesystem::path logDir;
+    };
+
+    struct Result
+    {
+        size_t configs = 0;
+        size_t completed = 0;
+        size_t failed = 0;
+        size_t reassigned = 0;
+        size_t workersLost = 0;
+        double seconds = 0;
+        double p50Ms = 0;
+        double p99Ms = 0;
+        std::vector<size_t> perWorker;
+    };
+
+    FleetCoordinator(std::vector<std::string> configs, Options options);
+    Result run();
+    static void print(const Result& result);
+
+private:
+    struct Worker
+    {
+        std::unique_ptr<FleetChannel> channel;
+        wil::unique_process_information process;
+        std::deque<size_t> queue;
+        std::unordered_set<size_t> inFlight;
+        size_t completed = 0;
+    };
+
+    bool spawn(size_t index);
+    void serve(size_t index);
+    void lose(size_t index);
+
+    std::vector<std::string> mConfigs;
+    Options mOptions;
+    FleetRing mRing;
+    std::deque<Worker> mWorkers;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    size_t mRemaining = 0;
+    Result mResult;
+    std::vector<double> mLatencyMs;
+};
+
+FleetCoordinator::FleetCoordinator(std::vector<std::string> configs, Options options)
+    : mConfigs(std::move(configs)), mOptions(options), mRing(std::max<size_t>(options.workers, 1))
+{
+    mOptions.workers = std::max<size_t>(mOptions.workers, 1);
+    mOptions.window = std::max<size_t>(mOptions.window, 1);
+    mWorkers.resize(mOptions.workers);
+    for (size_t i = 0; i < mConfigs.size(); ++i)
+        mWorkers[*mRing.owner(mConfigs[i])].queue.push_back(i);
+}
+
+bool FleetCoordinator::spawn(size_t index)
+{
+    Worker& worker = mWorkers[index];
+    std::string name = std::format("\\\\.\\pipe\\hypervadmin-fleet-{}-{}", GetCurrentProcessId(), index);
+    wil::unique_hfile pipe(CreateNamedPipeW(xstrUtf16(name).c_str(), PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+        1, 64 * 1024, 64 * 1024, 0, nullptr));
+    if (!pipe)
+        return false;
+
+    wchar_t exe[MAX_PATH];
+    GetModuleFileNameW(nullptr, exe, MAX_PATH);
+    std::string args = std::format("--fleet-worker {} {}", name, mOptions.workerArgs);
+    if (!mOptions.logDir.empty())
+        args += std::format(" --fleet-log \"{}\"", (mOptions.logDir / std::format("fleet-worker-{}.log", index)).string());
+    std::wstring command = L"\"" + std::wstring(exe) + L"\" " + xstrUtf16(args);
+
+    STARTUPINFOW startup{ sizeof(startup) };
+    if (!CreateProcessW(nullptr, command.data(), nullptr, nullptr, FALSE, CREATE_NO_WINDOW, nullptr, nullptr, &startup, &worker.process))
+        return false;
+    if (!ConnectNamedPipe(pipe.get(), nullptr) && GetLastError() != ERROR_PIPE_CONNECTED)
+        return false;
+
+    worker.channel = std::make_unique<FleetChannel>(std::move(pipe));
+    return true;
+}
+
+void FleetCoordinator::serve(size_t index)
+{
+    Worker& worker = mWorkers[index];
+    bool spawned = spawn(index);
+
+    std::unique_lock lock(mMutex);
+    if (!spawned)
+    {
+        std::cout << std::format("{} - worker {} could not be started\n", __func__, index);
+        lose(index);
+        return;
+    }
+
+    for (;;)
+    {
+        mWake.wait(lock, [&] { return mRemaining == 0 || !worker.inFlight.empty() || !worker.queue.empty(); });
+        if (mRemaining == 0)
+            return;
+
+        std::vector<size_t> batch;
+        while (!worker.queue.empty() && worker.inFlight.size() < mOptions.window)
+        {
+            batch.push_back(worker.queue.front());
+            worker.inFlight.insert(worker.queue.front());
+            worker.queue.pop_front();
+        }
+        lock.unlock();
+
+        bool sent = true;
+        for (size_t item : batch)
+            sent = sent && worker.channel->send(boost::json::object{ { "id", item }, { "config", mConfigs[item] } });
+        std::optional<boost::json::value> response = sent ? worker.channel->receive() : std::nullopt;
+
+        lock.lock();
+        if (!response || !response->is_object())
+        {
+            lose(index);
+            return;
+        }
+
+        size_t item = (*response / "id").to_number<size_t>();
+        if (worker.inFlight.erase(item) == 0)
+            continue;
+
+        HRESULT result = static_cast<HRESULT>((*response / "result").to_number<int64_t>());
+        worker.completed++;
+        mResult.completed++;
+        mResult.failed += FAILED(result);
+        mLatencyMs.push_back((*response / "ms").to_number<double>());
+        if (--mRemaining == 0)
+            mWake.notify_all();
+
+        if (mOptions.killAfter != 0 && mResult.completed == mOptions.killAfter && mWorkers.size() > 1 && mWorkers[0].process.hProcess)
+            TerminateProcess(mWorkers[0].process.hProcess, 1);
+    }
+}
+
+// Called with mMutex held.
+void FleetCoordinator::lose(size_t index)
+{
+    Worker& worker = mWorkers[index];
+    mResult.workersLost++;
+    mRing.remove(index);
+
+    std::vector<size_t> orphaned(worker.inFlight.begin(), worker.inFlight.end());
+    orphaned.insert(orphaned.end(), worker.queue.begin(), worker.queue.end());
+    worker.inFlight.clear();
+    worker.queue.clear();
+    std::sort(orphaned.begin(), orphaned.end());
+
+    for (size_t item : orphaned)
+    {
+        if (std::optional<size_t> owner = mRing.owner(mConfigs[item]))
+        {
+            mWorkers[*owner].queue.push_back(item);
+            mResult.reassigned++;
+        }
+        else
+        {
+            mResult.failed++;
+            mRemaining--;
+        }
+    }
+    std::cout << std::format("{} - worker {} lost, {} configs reassigned\n", __func__, index, orphaned.size());
+    mWake.notify_all();
+}
+
+FleetCoordinator::Result FleetCoordinator::run()
+{
+    mRemaining = mConfigs.size();
+    mResult.configs = mConfigs.size();
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < mWorkers.size(); ++i)
+        threads.emplace_back(&FleetCoordinator::serve, this, i);
+    for (auto& thread : threads)
+        thread.join();
+    mResult.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Closing the pipe is the signal for a worker to exit.
+    for (Worker& worker : mWorkers)
+    {
+        worker.channel.reset();
+        if (worker.process.hProcess)
+            WaitForSingleObject(worker.process.hProcess, 10000);
+        mResult.perWorker.push_back(worker.completed);
+    }
+
+    mResult.p50Ms = xpercentile(mLatencyMs, 50);
+    mResult.p99Ms = xpercentile(mLatencyMs, 99);
+    return mResult;
+}
+
+void FleetCoordinator::print(const Result& result)
+{
+    std::string perWorker;
+    for (size_t completed : result.perWorker)
+        perWorker += std::format("{}{}", perWorker.empty() ? "" : " ", completed);
+
+    std::cout << std::format("Fleet: workers {}, configs {}, completed {}, failed {}, reassigned {}, workersLost {}, seconds {:.2f}, configsPerSec {:.1f}, p50Ms {:.1f}, p99Ms {:.1f}, perWorker [{}]\n",
+        result.perWorker.size(), result.configs, result.completed, result.failed, result.reassigned, result.workersLost, result.seconds,
+        result.seconds > 0 ? result.completed / result.seconds : 0.0, result.p50Ms, result.p99Ms, perWorker);
+}
+
+#pragma endregion
+
+// Worker side of --fleet: provisions every config it is sent, one at a time, and answers with
+// the result and duration. Its console output goes to --fleet-log, or nowhere.
+int runFleetWorker(int argc, char* argv[])
+{
+    std::ofstream log;
+    if (std::string path = xargValue(argc, argv, "--fleet-log", ""); !path.empty())
+        log.open(path, std::ios::app);
+    std::cout.rdbuf(log.is_open() ? log.rdbuf() : nullptr);
+
+    std::wstring name = xstrUtf16(xargValue(argc, argv, "--fleet-worker", ""));
+    if (!WaitNamedPipeW(name.c_str(), 10000))
+        return 1;
+    wil::unique_hfile pipe(CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr));
+    if (!pipe)
+        return 1;
+
+    initHcnBackend(argc, argv);
+    size_t graphWorkers = std::stoul(xargValue(argc, argv, "--graph-workers", "4"));
+    size_t poolSize = std::stoul(xargValue(argc, argv, "--endpoint-pool", "0"));
+
+    FleetChannel channel(std::move(pipe));
+    while (std::optional<boost::json::value> request = channel.receive())
+    {
+        auto start = std::chrono::steady_clock::now();
+        HRESULT result = S_OK;
+        try
+        {
+            std::string path((*request / "config").as_string());
+            mAndroidJson = xjsonReadFromFile(std::filesystem::path(path));
+            if (!mAndroidJson.is_object())
+            {
+                result = HCN_E_INVALID_JSON;
+            }
+            else if (HcnGraph::applies(mAndroidJson))
+            {
+                HcnGraph graph(mAndroidJson);
+                graph.run(graphWorkers);
+                result = graph.result();
+            }
+            else
+            {
+                auto adapter = [] { return std::string((mAndroidJson / "HcsSystem" / "VirtualMachine" / "Devices" /
+                    "NetworkAdapters" / "default" / "EndpointId").as_string()); };
+                std::string endpointId = adapter();
+                std::shared_ptr<unique_hcn_network> network = configureHcnNetwork();
+                result = configureHcnEndpoint();
+
+                // A claimed endpoint is only reused by the next start if the config names it.
+                if (SUCCEEDED(result) && adapter() != endpointId)
+                    std::ofstream(path, std::ios::trunc) << boost::json::serialize(mAndroidJson);
+
+                // The first config provisioned decides which network and settings the pool
+                // serves; later configs that share them claim from it.
+                if (poolSize > 0 && !mHcnEndpointPool && network)
+                    mHcnEndpointPool = std::make_unique<HcnEndpointPool>(network, mAndroidJson / "HcnEndpoint", poolSize);
+            }
+        }
+        catch (std::exception& exc)
+        {
+            std::cout << std::format("{} - exc {}\n", __func__, exc.what());
+            result = E_FAIL;
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (!channel.send(boost::json::object{ { "id", *request / "id" }, { "result", result }, { "ms", ms } }))
+            break;
+    }
+
+    printEndpointPoolStats();
+    mHcnEndpointPool.reset();
+    return 0;
+}
+
+// --fleet takes a comma-separated list of configs or a directory of them.
+int runFleet(int argc, char* argv[])
+{
+    std::vector<std::string> configs;
+    std::string list = xargValue(argc, argv, "--fleet", "");
+    if (std::filesystem::is_directory(list))
+    {
+        for (const auto& entry : std::filesystem::directory_iterator(list))
+        {
+            if (entry.is_regular_file() && entry.path().extension() == ".json")
+                configs.push_back(entry.path().string());
+        }
+        std::sort(configs.begin(), configs.end());
+    }
+    else
+    {
+        for (size_t begin = 0; begin < list.size();)
+        {
+            size_t end = std::min(list.find(',', begin), list.size());
+            if (end > begin)
+                configs.push_back(list.substr(begin, end - begin));
+            begin = end + 1;
+        }
+    }
+
+    FleetCoordinator::Options options;
+    options.workers = std::stoul(xargValue(argc, argv, "--fleet-workers", "4"));
+    options.window = std::stoul(xargValue(argc, argv, "--fleet-window", "2"));
+    options.logDir = xargValue(argc, argv, "--fleet-log-dir", "");
+    options.workerArgs = std::format("--no-trace --hcn-timeout-ms {}", xargValue(argc, argv, "--hcn-timeout-ms", "30000"));
+    // Only the bench target knows --stub; its fleets' workers must run against the stub too.
+    if (xargFlag(argc, argv, "--stub"))
+        options.workerArgs += " --stub";
+    if (std::string pool = xargValue(argc, argv, "--endpoint-pool", "0"); pool != "0")
+        options.workerArgs += " --endpoint-pool " + pool;
+
+    FleetCoordinator::print(FleetCoordinator(std::move(configs), options).run());
+    return 0;
+}
+
+// Applies an RFC 6902 patch to the config file itself, so that every later start sees it. A
+// patch that fails leaves the file as it was.
+bool saveConfigPatch(const std::filesystem::path& path, const boost::json::value& patch)
+{
+    boost::json::value config = xjsonReadFromFile(path);
+    JsonPatch::Result result;
+    try
+    {
+        result = JsonPatch::compile(patch).apply(config);
+    }
+    catch (std::exception& exc)
+    {
+        result = JsonPatch::Result{ false, 0, 0, exc.what() };
+    }
+
+    if (!result.ok)
+    {
+        std::cout << std::format("{} - patch not saved to {}: operation {}: {}\n", __func__, path.string(), result.failedOperation, result.error);
+        return false;
+    }
+
+    std::ofstream(path, std::ios::trunc) << boost::json::serialize(config);
+    std::cout << std::format("{} - saved to {}, touched {}\n", __func__, path.string(), JsonPatch::sectionNames(result.touched));
+    return true;
+}
+
+// Applies an RFC 6902 patch to the resident config of a running probe loop and re-provisions
+// only what it touched: the network when HcnNetwork changed, the endpoint when its settings,
+// its network or the adapters that name it changed. A patch that fails leaves the config as
+// it was.
+bool applyConfigPatch(const boost::json::value& patch)
+{
+    JsonPatch::Result result;
+    try
+    {
+        result = JsonPatch::compile(patch).apply(mAndroidJson);
+    }
+    catch (std::exception& exc)
+    {
+        result = JsonPatch::Result{ false, 0, 0, exc.what() };
+    }
+
+    if (!result.ok)
+    {
+        std::cout << std::format("{} - patch rejected at operation {}: {}\n", __func__, result.failedOperation, result.error);
+        return false;
+    }
+
+    std::cout << std::format("{} - touched {}\n", __func__, JsonPatch::sectionNames(result.touched));
+    uint32_t hcn = JsonPatch::HcnNetwork | JsonPatch::HcnEndpoint | JsonPatch::NetworkAdapters;
+    if (HcnGraph::applies(mAndroidJson))
+    {
+        if (result.touched & hcn)
+        {
+            mHcnGraph = std::make_unique<HcnGraph>(mAndroidJson);
+            mHcnGraph->run(4);
+            mHcnGraph->print();
+        }
+        return true;
+    }
+
+    if (result.touched & JsonPatch::HcnNetwork)
+    {
+        mHcnEndpointPool.reset();
+        configureHcnNetwork();
+    }
+    if (result.touched & hcn)
+        configureHcnEndpoint();
+    return true;
+}
+
+struct HcnJournalRecovery
+{
+    size_t records = 0;
+    size_t inFlight = 0;
+    size_t rolledBack = 0;
+    size_t finished = 0;
+    size_t verified = 0;
+    size_t deferred = 0;
+    bool torn = false;
+    double scanMs = 0;
+    double resolveMs = 0;
+    std::vector<HcnJournalRecord> unresolved;
+};
+
+// Resolves the mutations a previous run left in flight with at most one host call per
+// resource: an endpoint create is rolled back, an endpoint delete is finished and a network
+// create is verified with an open. A modify is left to configureHcnEndpoint, which diffs the
+// endpoint against the config anyway. Resolution is idempotent, so dying here only means it
+// is repeated on the next start.
+HcnJournalRecovery recoverHcnJournal(const std::filesystem::path& path, size_t workers)
+{
+    HcnJournalRecovery recovery;
+    auto start = std::chrono::steady_clock::now();
+
+    HcnJournal::Scan scan = HcnJournal::scan(path);
+    recovery.records = scan.records;
+    recovery.torn = scan.torn;
+
+    // Only the latest in-flight intent per resource decides what state it was left in.
+    std::unordered_map<GUID, HcnJournalRecord, GuidHash> latest;
+    for (const HcnJournalRecord& intent : scan.inFlight)
+        latest.insert_or_assign(intent.id, intent);
+
+    std::vector<HcnJournalRecord> pending;
+    pending.reserve(latest.size());
+    for (auto& [id, intent] : latest)
+        pending.push_back(intent);
+    recovery.inFlight = pending.size();
+
+    auto scanned = std::chrono::steady_clock::now();
+    recovery.scanMs = std::chrono::duration<double, std::milli>(scanned - start).count();
+
+    std::mutex mutex;
+    std::atomic<size_t> next{ 0 };
+    auto resolve = [&] {
+        for (size_t i = next++; i < pending.size(); i = next++)
+        {
+            const HcnJournalRecord& intent = pending[i];
+            HcnCall call = static_cast<HcnCall>(intent.call);
+            HcnErrorRecord errStr;
+            size_t HcnJournalRecovery::* outcome = &HcnJournalRecovery::deferred;
+            bool resolved = true;
+
+            if (call == HcnCall::CreateEndpoint || call == HcnCall::DeleteEndpoint)
+            {
+                HRESULT result = hcnInvoke(HcnCall::DeleteEndpoint, intent.id, 0, errStr, [&] {
+                    return VmmgrHypervApi::HcnDeleteEndpoint(intent.id, &errStr);
+                });
+                resolved = SUCCEEDED(result) || result == HCN_E_ENDPOINT_NOT_FOUND;
+                if (resolved)
+                    recordHcnEndpoint(intent.id, false);
+                outcome = call == HcnCall::CreateEndpoint ? &HcnJournalRecovery::rolledBack : &HcnJournalRecovery::finished;
+            }
+            else if (call == HcnCall::CreateNetwork)
+            {
+                unique_hcn_network network;
+                HRESULT result = hcnInvoke(HcnCall::OpenNetwork, intent.id, 0, errStr, [&] {
+                    return VmmgrHypervApi::HcnOpenNetwork(intent.id, network.put(), &errStr);
+                });
+                resolved = SUCCEEDED(result) || result == HCN_E_NETWORK_NOT_FOUND;
+                if (resolved)
+                    recordHcnNetwork(intent.id, SUCCEEDED(result));
+                outcome = &HcnJournalRecovery::verified;
+            }
+            else if (call == HcnCall::DeleteNetwork)
+            {
+                HRESULT result = hcnInvoke(HcnCall::DeleteNetwork, intent.id, 0, errStr, [&] {
+                    return VmmgrHypervApi::HcnDeleteNetwork(intent.id, &errStr);
+                });
+                resolved = SUCCEEDED(result) || result == HCN_E_NETWORK_NOT_FOUND;
+                if (resolved)
+                    recordHcnNetwork(intent.id, false);
+                outcome = &HcnJournalRecovery::finished;
+            }
+
+            std::scoped_lock lock(mutex);
+            if (resolved)
+                recovery.*outcome += 1;
+            else
+                recovery.unresolved.push_back(intent);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(workers, pending.size()); ++t)
+        threads.emplace_back(resolve);
+    resolve();
+    for (auto& thread : threads)
+        thread.join();
+
+    recovery.resolveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scanned).count();
+    return recovery;
+}
+
+void printJournalRecovery(const HcnJournalRecovery& recovery)
+{
+    std::cout << std::format("Journal recovery: records {}, torn {}, inFlight {}, rolledBack {}, finished {}, verified {}, deferred {}, unresolved {}, scanMs {:.2f}, resolveMs {:.2f}\n",
+        recovery.records, recovery.torn, recovery.inFlight, recovery.rolledBack, recovery.finished, recovery.verified,
+        recovery.deferred, recovery.unresolved.size(), recovery.scanMs, recovery.resolveMs);
+}
+
+void printJournalStats()
+{
+    if (!mHcnJournal)
+        return;
+
+    auto stats = mHcnJournal->stats();
+    std::cout << std::format("Journal: records {}, flushes {}, maxBatch {}, writeFailures {}\n",
+        stats.records, stats.flushes, stats.maxBatch, stats.writeFailures);
+}
+
+#pragma region Prefetch
+
+struct BootArtifact
+{
+    std::string role;               // "kernel", "initrd" or "<controller>/<lun>"
+    std::filesystem::path path;
+    bool readOnly = false;
+    uint64_t size = 0;
+    std::string error;              // set when validation failed
+};
+
+// Collects the files a VM reads while booting: the direct-boot kernel and initrd and every
+// Scsi attachment. Empty paths are skipped. Read-only disks sort first since they are the
+// boot disk, then the kernel and initrd, then writable disks.
+std::vector<BootArtifact> collectBootArtifacts(const boost::json::value& config)
+{
+    auto child = [](const boost::json::value* jv, std::string_view key) -> const boost::json::value* {
+        return jv && jv->is_object() ? jv->as_object().if_contains(key) : nullptr;
+    };
+    auto path = [](const boost::json::value* jv) {
+        return jv && jv->is_string() ? std::string(jv->as_string()) : std::string();
+    };
+
+    std::vector<BootArtifact> artifacts;
+    const boost::json::value* vm = child(child(&config, "HcsSystem"), "VirtualMachine");
+
+    const boost::json::value* direct = child(child(vm, "Chipset"), "LinuxKernelDirect");
+    for (auto [role, key] : { std::pair{ "kernel", "KernelFilePath" }, std::pair{ "initrd", "InitRdPath" } })
+    {
+        if (std::string file = path(child(direct, key)); !file.empty())
+            artifacts.push_back(BootArtifact{ role, file, true });
+    }
+
+    const boost::json::value* scsi = child(child(vm, "Devices"), "Scsi");
+    if (scsi && scsi->is_object())
+    {
+        for (const auto& [controller, settings] : scsi->as_object())
+        {
+            const boost::json::value* attachments = child(&settings, "Attachments");
+            if (!attachments || !attachments->is_object())
+                continue;
+
+            for (const auto& [lun, attachment] : attachments->as_object())
+            {
+                const boost::json::value* readOnly = child(&attachment, "ReadOnly");
+                if (std::string file = path(child(&attachment, "Path")); !file.empty())
+                    artifacts.push_back(BootArtifact{ std::format("{}/{}", std::string_view(controller), std::string_view(lun)), file,
+                        readOnly && readOnly->is_bool() && readOnly->as_bool() });
+            }
+        }
+    }
+
+    auto rank = [](const BootArtifact& artifact) {
+        bool disk = artifact.role != "kernel" && artifact.role != "initrd";
+        return disk ? (artifact.readOnly ? 0 : 2) : 1;
+    };
+    std::stable_sort(artifacts.begin(), artifacts.end(), [&](const auto& a, const auto& b) { return rank(a) < rank(b); });
+    return artifacts;
+}
+
+// Warms the file cache with the boot artifacts on a background thread while the network is
+// being provisioned. Paths are validated in parallel, then split into ranges read in priority
+// order, so the boot disk is warm first; both steps run on the same bounded set of workers. Reads are opened
+// with FILE_FLAG_SEQUENTIAL_SCAN so the cache manager also reads ahead of them.
+class BootPrefetcher
+{
+public:
+    struct Options
+    {
+        size_t workers = 4;
+        uint64_t maxBytesPerArtifact = 512ull << 20;   // 0 reads whole files
+    };
+
+    struct Stats
+    {
+        size_t artifacts = 0;
+        size_t invalid = 0;
+        uint64_t bytesWarmed = 0;
+        double validateMs = 0;
+        double warmMs = 0;
+        double waitMs = 0;
+    };
+
+    BootPrefetcher(std::vector<BootArtifact> artifacts, Options options);
+    ~BootPrefetcher();
+
+    Stats wait();
+    const std::vector<BootArtifact>& artifacts() const { return mArtifacts; }
+
+private:
+    static constexpr uint64_t kRangeBytes = 32ull << 20;
+    static constexpr DWORD kChunkBytes = 1u << 20;
+
+    void run();
+    void parallel(size_t count, const std::function<void(size_t)>& fn);
+    uint64_t warm(const std::filesystem::path& path, uint64_t offset, uint64_t length, std::vector<uint8_t>& buffer);
+
+    std::vector<BootArtifact> mArtifacts;
+    Options mOptions;
+    Stats mStats;
+    std::atomic<bool> mCancel{ false };
+    std::thread mThread;
+};
+
+BootPrefetcher::BootPrefetcher(std::vector<BootArtifact> artifacts, Options options)
+    : mArtifacts(std::move(artifacts)), mOptions(options)
+{
+    mThread = std::thread(&BootPrefetcher::run, this);
+}
+
+BootPrefetcher::~BootPrefetcher()
+{
+    mCancel = true;
+    if (mThread.joinable())
+        mThread.join();
+}
+
+BootPrefetcher::Stats BootPrefetcher::wait()
+{
+    auto start = std::chrono::steady_clock::now();
+    if (mThread.joinable())
+    {
+        mThread.join();
+        mStats.waitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return mStats;
+}
+
+// Runs fn for every index below count on at most options.workers threads, this one included.
+void BootPrefetcher::parallel(size_t count, const std::function<void(size_t)>& fn)
+{
+    std::atomic<size_t> next{ 0 };
+    auto worker = [&] {
+        for (size_t i = next++; i < count && !mCancel; i = next++)
+            fn(i);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(std::max<size_t>(mOptions.workers, 1), count); ++t)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void BootPrefetcher::run()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    parallel(mArtifacts.size(), [&](size_t i) {
+        BootArtifact& artifact = mArtifacts[i];
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(artifact.path, ec))
+            artifact.error = ec ? ec.message() : "not a regular file";
+        else if (artifact.size = std::filesystem::file_size(artifact.path, ec); ec)
+            artifact.error = ec.message();
+    });
+
+    auto validated = std::chrono::steady_clock::now();
+
+    struct Range
+    {
+        size_t artifact;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    std::vector<Range> ranges;
+    for (size_t i = 0; i < mArtifacts.size(); ++i)
+    {
+        const BootArtifact& artifact = mArtifacts[i];
+        mStats.invalid += !artifact.error.empty();
+        if (!artifact.error.empty())
+            continue;
+
+        uint64_t limit = mOptions.maxBytesPerArtifact ? std::min(artifact.size, mOptions.maxBytesPerArtifact) : artifact.size;
+        for (uint64_t offset = 0; offset < limit; offset += kRangeBytes)
+            ranges.push_back(Range{ i, offset, std::min(kRangeBytes, limit - offset) });
+    }
+
+    std::atomic<uint64_t> warmed{ 0 };
+    parallel(ranges.size(), [&](size_t i) {
+        thread_local std::vector<uint8_t> buffer(kChunkBytes);
+        warmed += warm(mArtifacts[ranges[i].artifact].path, ranges[i].offset, ranges[i].length, buffer);
+    });
+
+    mStats.artifacts = mArtifacts.size();
+    mStats.bytesWarmed = warmed;
+    mStats.validateMs = std::chrono::duration<double, std::milli>(validated - start).count();
+    mStats.warmMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - validated).count();
+}
+
+uint64_t BootPrefetcher::warm(const std::filesystem::path& path, uint64_t offset, uint64_t length, std::vector<uint8_t>& buffer)
+{
+    wil::unique_hfile file(CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr));
+    if (!file)
+        return 0;
+
+    uint64_t done = 0;
+    while (done < length && !mCancel)
+    {
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset + done);
+        overlapped.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+
+        DWORD read = 0;
+        DWORD want = static_cast<DWORD>(std::min<uint64_t>(kChunkBytes, length - done));
+        if (!ReadFile(file.get(), buffer.data(), want, &read, &overlapped) || read == 0)
+            break;
+        done += read;
+    }
+    return done;
+}
+
+#pragma endregion
+
+std::unique_ptr<BootPrefetcher> mBootPrefetcher;
+
+// Waits for the prefetcher and reports what it warmed. The warm time not spent waiting here
+// ran alongside provisioning and is reported as overlap; it bounds what the prefetch took off
+// the start's critical path but is not a measured boot-time saving.
+void printPrefetchStats()
+{
+    if (!mBootPrefetcher)
+        return;
+
+    auto stats = mBootPrefetcher->wait();
+    for (const BootArtifact& artifact : mBootPrefetcher->artifacts())
+    {
+        if (!artifact.error.empty())
+            std::cout << std::format("{} - invalid boot artifact {}: path {}, error {}\n", __func__, artifact.role, artifact.path.string(), artifact.error);
+    }
+
+    double seconds = stats.warmMs / 1e3;
+    std::cout << std::format("Prefetch: artifacts {}, invalid {}, bytesWarmed {}, validateMs {:.1f}, warmMs {:.1f}, GBps {:.2f}, waitMs {:.1f}, overlapMs {:.1f}\n",
+        stats.artifacts, stats.invalid, stats.bytesWarmed, stats.validateMs, stats.warmMs,
+        seconds > 0 ? stats.bytesWarmed / seconds / 1e9 : 0.0, stats.waitMs, std::max(0.0, stats.warmMs - stats.waitMs));
+}
+
+#pragma region DiskIntegrity
+
+// What identifies a file's content without reading it: if none of these changed, neither
+// did the content. The file ID survives renames but not replacement by another file.
+struct FileIdentity
+{
+    uint64_t size = 0;
+    uint64_t lastWrite = 0;
+    uint64_t volume = 0;
+    std::string fileId;
+
+    bool operator==(const FileIdentity&) const = default;
+};
+
+bool xfileIdentity(HANDLE file, FileIdentity& identity)
+{
+    LARGE_INTEGER size;
+    FILETIME lastWrite;
+    FILE_ID_INFO id;
+    if (!GetFileSizeEx(file, &size) || !GetFileTime(file, nullptr, nullptr, &lastWrite) ||
+        !GetFileInformationByHandleEx(file, FileIdInfo, &id, sizeof(id)))
+        return false;
+
+    identity.size = static_cast<uint64_t>(size.QuadPart);
+    identity.lastWrite = (static_cast<uint64_t>(lastWrite.dwHighDateTime) << 32) | lastWrite.dwLowDateTime;
+    identity.volume = id.VolumeSerialNumber;
+    identity.fileId.clear();
+    for (BYTE b : id.FileId.Identifier)
+        identity.fileId += std::format("{:02x}", b);
+    return true;
+}
+
+// Verifies that read-only disks still have the content they had when first seen. Files are
+// hashed in fixed-size chunks on several threads with xhash64Wide, and the chunk digests are
+// combined in order. Digests are cached on disk keyed by path together with size, last write
+// time and file ID, so a re-check costs one open and three metadata queries unless the file
+// actually changed. The first digest seen for a path is its baseline; later content that
+// hashes differently is reported as altered and does not replace the baseline unless
+// accepted. A file that cannot be read is an error, never a digest, and is not cached; a cache
+// entry that does not parse is dropped and the file is hashed again.
+class DiskIntegrity
+{
+public:
+    enum class Verdict
+    {
+        Baseline,       // first time this path was seen; its digest is now the baseline
+        Unchanged,      // identity matches the cache, nothing was read
+        Verified,       // identity changed but the content still matches the baseline
+        Altered,        // the content no longer matches the baseline
+        Error,
+    };
+
+    struct Options
+    {
+        size_t workers = 4;
+        uint64_t chunkBytes = 1ull << 20;
+    };
+
+    struct Result
+    {
+        Verdict verdict = Verdict::Error;
+        uint64_t digest = 0;
+        uint64_t bytesHashed = 0;
+        double ms = 0;
+    };
+
+    DiskIntegrity(std::filesystem::path cachePath, Options options);
+
+    Result verify(const std::filesystem::path& path, bool acceptChanges = false);
+    std::optional<uint64_t> hash(const std::filesystem::path& path, uint64_t size);
+    void save() const;
+
+    static const char* verdictName(Verdict verdict);
+
+private:
+    struct CacheEntry
+    {
+        FileIdentity identity;
+        uint64_t digest = 0;
+    };
+
+    // Called with mMutex held.
+    std::optional<CacheEntry> cachedEntry(const std::string& key);
+
+    std::filesystem::path mCachePath;
+    Options mOptions;
+    std::mutex mMutex;
+    boost::json::object mCache;
+};
+
+DiskIntegrity::DiskIntegrity(std::filesystem::path cachePath, Options options)
+    : mCachePath(std::move(cachePath)), mOptions(options)
+{
+    std::error_code ec;
+    if (!std::filesystem::exists(mCachePath, ec))
+        return;
+
+    try
+    {
+        mCache = xjsonReadFromFile(mCachePath).as_object();
+    }
+    catch (std::exception& exc)
+    {
+        std::cout << std::format("{}: ignoring unreadable cache: filePath {}, exc {}\n", __func__, mCachePath.string(), exc.what());
+    }
+}
+
+const char* DiskIntegrity::verdictName(Verdict verdict)
+{
+    switch (verdict)
+    {
+    case Verdict::Baseline:  return "baseline";
+    case Verdict::Unchanged: return "unchanged";
+    case Verdict::Verified:  return "verified";
+    case Verdict::Altered:   return "altered";
+    default:                 return "error";
+    }
+}
+
+DiskIntegrity::Result DiskIntegrity::verify(const std::filesystem::path& path, bool acceptChanges)
+{
+    Result result;
+    auto start = std::chrono::steady_clock::now();
+
+    FileIdentity identity;
+    {
+        wil::unique_hfile file(CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+        if (!file || !xfileIdentity(file.get(), identity))
+            return result;
+    }
+
+    std::string key = std::filesystem::absolute(path).string();
+    std::unique_lock lock(mMutex);
+    std::optional<CacheEntry> cached = cachedEntry(key);
+
+    if (cached && cached->identity == identity)
+    {
+        result.verdict = Verdict::Unchanged;
+        result.digest = cached->digest;
+    }
+    else
+    {
+        lock.unlock();
+        std::optional<uint64_t> digest = hash(path, identity.size);
+        lock.lock();
+
+        if (!digest)
+        {
+            result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return result;
+        }
+
+        result.digest = *digest;
+        result.bytesHashed = identity.size;
+        cached = cachedEntry(key);
+        result.verdict = !cached ? Verdict::Baseline : cached->digest == result.digest ? Verdict::Verified : Verdict::Altered;
+
+        if (result.verdict != Verdict::Altered || acceptChanges)
+        {
+            mCache.insert_or_assign(key, boost::json::object{
+                { "Size", identity.size },
+                { "LastWrite", identity.lastWrite },
+                { "Volume", identity.volume },
+                { "FileId", identity.fileId },
+                { "Digest", std::format("{:016x}", result.digest) },
+            });
+        }
+    }
+
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+std::optional<DiskIntegrity::CacheEntry> DiskIntegrity::cachedEntry(const std::string& key)
+{
+    const boost::json::value* cached = mCache.if_contains(key);
+    if (!cached)
+        return std::nullopt;
+
+    try
+    {
+        CacheEntry entry;
+        entry.identity.size = (*cached / "Size").to_number<uint64_t>();
+        entry.identity.lastWrite = (*cached / "LastWrite").to_number<uint64_t>();
+        entry.identity.volume = (*cached / "Volume").to_number<uint64_t>();
+        entry.identity.fileId = (*cached / "FileId").as_string().c_str();
+
+        std::string digest = (*cached / "Digest").as_string().c_str();
+        size_t parsed = 0;
+        entry.digest = std::stoull(digest, &parsed, 16);
+        if (digest.size() != 16 || parsed != digest.size())
+            throw std::invalid_argument("Digest is not 16 hex digits");
+        return entry;
+    }
+    catch (std::exception& exc)
+    {
+        std::cout << std::format("{}: dropping malformed cache entry: key {}, exc {}\n", __func__, key, exc.what());
+        mCache.erase(key);
+        return std::nullopt;
+    }
+}
+
+std::optional<uint64_t> DiskIntegrity::hash(const std::filesystem::path& path, uint64_t size)
+{
+    size_t chunks = static_cast<size_t>((size + mOptions.chunkBytes - 1) / mOptions.chunkBytes);
+    std::vector<uint64_t> digests(chunks);
+    std::atomic<size_t> next{ 0 };
+    std::atomic<bool> failed{ false };
+
+    auto worker = [&] {
+        wil::unique_hfile file(CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr));
+        if (!file)
+        {
+            failed = true;
+            return;
+        }
+
+        std::vector<uint8_t> buffer(static_cast<size_t>(mOptions.chunkBytes));
+        for (size_t i = next++; i < chunks && !failed; i = next++)
+        {
+            uint64_t offset = i * mOptions.chunkBytes;
+            OVERLAPPED overlapped{};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+            DWORD want = static_cast<DWORD>(std::min(mOptions.chunkBytes, size - offset));
+            DWORD read = 0;
+            if (!ReadFile(file.get(), buffer.data(), want, &read, &overlapped) || read != want)
+            {
+                failed = true;
+                return;
+            }
+            digests[i] = xhash64Wide(buffer.data(), read, i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(std::max<size_t>(mOptions.workers, 1), chunks); ++t)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+
+    if (failed)
+        return std::nullopt;
+
+    uint64_t digest = xhash64(&size, sizeof(size));
+    for (uint64_t chunk : digests)
+        digest = xhashCombine(digest, chunk);
+    return digest;
+}
+
+void DiskIntegrity::save() const
+{
+    std::ofstream ofs(mCachePath, std::ios::trunc);
+    ofs << xstrUtf8(boost::json::value(mCache));
+}
+
+#pragma endregion
+
+// Checks every read-only Scsi attachment of the config; main runs this concurrently with
+// provisioning. Returns false if any disk was altered or could not be read.
+bool verifyBootDisks(DiskIntegrity& integrity, const std::vector<BootArtifact>& artifacts, bool acceptChanges)
+{
+    bool ok = true;
+    for (const BootArtifact& artifact : artifacts)
+    {
+        if (!artifact.readOnly || artifact.role == "kernel" || artifact.role == "initrd")
+            continue;
+
+        auto result = integrity.verify(artifact.path, acceptChanges);
+        double seconds = result.ms / 1e3;
+        std::cout << std::format("DiskIntegrity: {} {}: verdict {}, digest {:016x}, bytesHashed {}, ms {:.1f}, GBps {:.2f}\n",
+            artifact.role, artifact.path.string(), DiskIntegrity::verdictName(result.verdict), result.digest, result.bytesHashed,
+            result.ms, result.bytesHashed && seconds > 0 ? result.bytesHashed / seconds / 1e9 : 0.0);
+
+        ok &= result.verdict != DiskIntegrity::Verdict::Altered && result.verdict != DiskIntegrity::Verdict::Error;
+    }
+    integrity.save();
+    return ok;
+}
+
+#pragma region ConfigGen
+
+// Builds synthetic instance configs from a base config at a chosen size and shape, for scale
+// and stress tests of the loader, the lookups and provisioning. The same seed and index always
+// give the same config. Shape sizes every collection a VM config can grow: Plan9 shares, SCSI
+// controllers and their attachments, FlexibleIov emulators, network adapters (one HCN endpoint
+// each, spread over the networks) and endpoint policies. depth nests each emulator's
+// Configuration that many objects deep and stringBytes pads paths and the kernel command line
+// to that length; both go past what real configs hold on purpose.
+class ConfigGenerator
+{
+public:
+    struct Shape
+    {
+        size_t shares = 3;
+        size_t controllers = 1;
+        size_t attachments = 2;     // per controller
+        size_t emulators = 4;
+        size_t adapters = 1;
+        size_t networks = 1;
+        size_t policies = 1;
+        size_t depth = 0;
+        size_t stringBytes = 0;
+    };
+
+    // Reads a shape from --shares, --controllers, --attachments, --emulators, --adapters,
+    // --networks, --policies, --depth and --string-bytes; --entries sets shares, attachments,
+    // emulators and adapters at once.
+    static Shape shapeFromArgs(int argc, char* argv[]);
+
+    ConfigGenerator(boost::json::value base, uint64_t seed) : mBase(std::move(base)), mSeed(seed) {}
+
+    boost::json::value generate(const Shape& shape, size_t index) const;
+
+private:
+    boost::json::value mBase;
+    uint64_t mSeed;
+};
+
+ConfigGenerator::Shape ConfigGenerator::shapeFromArgs(int argc, char* argv[])
+{
+    Shape shape;
+    std::string entries = xargValue(argc, argv, "--entries", "");
+    auto read = [&](const char* name, size_t& field, bool entry) {
+        std::string fallback = entry && !entries.empty() ? entries : std::to_string(field);
+        field = std::stoul(xargValue(argc, argv, name, fallback));
+    };
+    read("--shares", shape.shares, true);
+    read("--controllers", shape.controllers, false);
+    read("--attachments", shape.attachments, true);
+    read("--emulators", shape.emulators, true);
+    read("--adapters", shape.adapters, true);
+    read("--networks", shape.networks, false);
+    read("--policies", shape.policies, false);
+    read("--depth", shape.depth, false);
+    read("--string-bytes", shape.stringBytes, false);
+    return shape;
+}
+
+boost::json::value ConfigGenerator::generate(const Shape& shape, size_t index) const
+{
+    std::mt19937_64 engine(xhash64(&index, sizeof(index), mSeed));
+    auto padded = [&](std::string text) {
+        while (text.size() < shape.stringBytes)
+            text += std::format("\\{:08x}", static_cast<uint32_t>(engine()));
+        return text;
+    };
+    auto objectAt = [](boost::json::object& parent, std::string_view key) -> boost::json::object& {
+        boost::json::value& jv = parent[key];
+        return jv.is_object() ? jv.as_object() : jv.emplace_object();
+    };
+    auto first = [](const boost::json::value* jv) {
+        if (jv && jv->is_array() && !jv->as_array().empty())
+            jv = &jv->as_array()[0];
+        return jv && jv->is_object() ? jv->as_object() : boost::json::object{};
+    };
+
+    boost::json::value config = mBase.is_object() ? mBase : boost::json::object{};
+    boost::json::object& root = config.as_object();
+    boost::json::object& system = objectAt(root, "HcsSystem");
+    system.insert_or_assign("Owner", std::format("synthetic{}", index));
+    boost::json::object& vm = objectAt(system, "VirtualMachine");
+    boost::json::object& devices = objectAt(vm, "Devices");
+
+    if (shape.stringBytes > 0)
+    {
+        boost::json::object& direct = objectAt(objectAt(vm, "Chipset"), "LinuxKernelDirect");
+        const boost::json::value* cmdLine = direct.if_contains("KernelCmdLine");
+        direct.insert_or_assign("KernelCmdLine", padded(cmdLine && cmdLine->is_string() ? std::string(cmdLine->as_string()) : "console=ttyS0"));
+    }
+
+    boost::json::object scsi;
+    for (size_t c = 0; c < shape.controllers; ++c)
+    {
+        boost::json::object attachments;
+        for (size_t a = 0; a < shape.attachments; ++a)
+        {
+            attachments.insert_or_assign(std::to_string(a), boost::json::object{
+                { "Type", "VirtualDisk" },
+                { "Path", padded(std::format("C:\\ProgramData\\Synthetic\\instance{}\\disk{}-{}.vhdx", index, c, a)) },
+                { "ReadOnly", a == 0 },
+                { "CachingMode", "Cached" } });
+        }
+        scsi.insert_or_assign(c == 0 ? std::string("Boot Disk Controller") : std::format("Controller {}", c),
+            boost::json::object{ { "Attachments", std::move(attachments) } });
+    }
+    devices.insert_or_assign("Scsi", std::move(scsi));
+
+    boost::json::array shares;
+    shares.reserve(shape.shares);
+    for (size_t i = 0; i < shape.shares; ++i)
+    {
+        std::string name = std::format("Share{}", i);
+        shares.push_back(boost::json::object{ { "Name", name }, { "Path", padded(std::format("C:\\Users\\Synthetic\\{}", name)) },
+            { "AccessName", name }, { "Flags", 44 }, { "Port", 50000 } });
+    }
+    objectAt(devices, "Plan9").insert_or_assign("Shares", std::move(shares));
+
+    boost::json::object emulators;
+    for (size_t i = 0; i < shape.emulators; ++i)
+    {
+        boost::json::value configuration = "";
+        for (size_t level = 0; level < shape.depth; ++level)
+            configuration = boost::json::object{ { "Level", shape.depth - level }, { "Options", std::move(configuration) } };
+
+        std::string id = xstrGuid(xguidRandom(engine));
+        emulators.insert_or_assign(id, boost::json::object{ { "EmulatorId", id }, { "HostingModel", "External" },
+            { "Configuration", boost::json::array{ std::move(configuration) } } });
+    }
+    devices.insert_or_assign("FlexibleIov", std::move(emulators));
+
+    // One network and one adapter keep the single-network form; anything more is written as
+    // HcnNetwork and HcnEndpoint arrays, which provisioning runs as a graph.
+    boost::json::object networkBase = first(root.if_contains("HcnNetwork"));
+    boost::json::object endpointBase = first(root.if_contains("HcnEndpoint"));
+    bool graph = shape.networks > 1 || shape.adapters > 1;
+
+    boost::json::array policies;
+    for (size_t p = 0; p < shape.policies; ++p)
+        policies.push_back(boost::json::object{ { "Type", "NAT" }, { "Protocol", "TCP" }, { "InternalPort", 5555 + p } });
+    endpointBase.insert_or_assign("Policies", std::move(policies));
+
+    std::vector<std::string> networkIds;
+    boost::json::array networks;
+    for (size_t n = 0; n < std::max<size_t>(shape.networks, 1); ++n)
+    {
+        boost::json::object network = networkBase;
+        networkIds.push_back(xstrGuid(xguidRandom(engine)));
+        network.insert_or_assign("ID", networkIds.back());
+        network.insert_or_assign("Name", graph ? std::format("synthetic{}-{}", index, n) : std::format("synthetic{}", index));
+        networks.push_back(std::move(network));
+    }
+
+    boost::json::object adapters;
+    boost::json::array endpoints;
+    for (size_t a = 0; a < std::max<size_t>(shape.adapters, 1); ++a)
+    {
+        std::string id = xstrGuid(xguidRandom(engine));
+        adapters.insert_or_assign(a == 0 ? std::string("default") : std::format("adapter{}", a), boost::json::object{ { "EndpointId", id } });
+
+        boost::json::object endpoint = endpointBase;
+        if (graph)
+            endpoint.insert_or_assign("ID", id);
+        endpoint.insert_or_assign("VirtualNetwork", networkIds[a % networkIds.size()]);
+        endpoints.push_back(std::move(endpoint));
+    }
+    devices.insert_or_assign("NetworkAdapters", std::move(adapters));
+
+    if (graph)
+    {
+        root.insert_or_assign("HcnNetwork", std::move(networks));
+        root.insert_or_assign("HcnEndpoint", std::move(endpoints));
+    }
+    else
+    {
+        root.insert_or_assign("HcnNetwork", std::move(networks[0]));
+        root.insert_or_assign("HcnEndpoint", std::move(endpoints[0]));
+    }
+    return config;
+}
+
+// --generate-configs <dir> writes --count configs generated from --config with --seed, named
+// instance<i>.json, ready for --config or --fleet <dir>.
+int runGenerateConfigs(int argc, char* argv[])
+{
+    std::filesystem::path dir = xargValue(argc, argv, "--generate-configs", "synthetic");
+    size_t count = std::stoul(xargValue(argc, argv, "--count", "1"));
+    uint64_t seed = std::stoull(xargValue(argc, argv, "--seed", "1"));
+    boost::json::value base = xjsonReadFromFile(xargValue(argc, argv, "--config", "HypervVm.json"));
+    if (!base.is_object())
+        return 1;
+
+    ConfigGenerator generator(std::move(base), seed);
+    ConfigGenerator::Shape shape = ConfigGenerator::shapeFromArgs(argc, argv);
+    std::filesystem::create_directories(dir);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::string text = boost::json::serialize(generator.generate(shape, i));
+        std::ofstream(dir / std::format("instance{}.json", i), std::ios::trunc | std::ios::binary) << text;
+        bytes += text.size();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::format("{} - configs {}, seed {}, bytes {}, bytesPerConfig {}, seconds {:.2f}, dir {}\n", __func__,
+        count, seed, bytes, count ? bytes / count : 0, seconds, dir.string());
+    return 0;
+}
+
+#pragma endregion
+
+// Everything main() does. The bench and test targets build this file with HCN_NO_MAIN and
+// call it with the stub already installed.
+int runHypervAdmin(int argc, char* argv[])
+{
+    if (xargFlag(argc, argv, "--alloc-profile"))
+    {
+        if constexpr (AllocProfile::kCompiled)
+        {
+            AllocProfile::mEnabled = true;
+            std::atexit(AllocProfile::print);
+        }
+        else
+        {
+            std::cout << "--alloc-profile ignored: this build was configured without HCN_ALLOC_PROFILE\n";
+        }
+    }
+
+    if (xargFlag(argc, argv, "--fleet-worker"))
+        return runFleetWorker(argc, argv);
+    if (xargFlag(argc, argv, "--generate-configs"))
+        return runGenerateConfigs(argc, argv);
+
+    // A backend installed before the start is a test stub, which needs no Hyper-V rights.
+    if (!VmmgrHypervApi::installed())
+    {
+        std::string userName = getenv("USERNAME");
+        std::string groupName = "Hyper-V Administrators";
+
+        std::string command = std::format("net localgroup \"{}\" /add \"{}\"", groupName, userName);
+        system(command.c_str());
+    }
+
+    if (xargFlag(argc, argv, "--fleet"))
+        return runFleet(argc, argv);
+
+    std::string path = xargValue(argc, argv, "--config", "");
+    if (path.empty())
+    {
+        std::cout << "Enter the path of hypervm.json (without quotes): ";
+        std::getline(std::cin, path);
+    }
+
+    if (std::filesystem::exists(std::filesystem::path(path)))
+    {
+        std::cout << "----Execution started----\n";
+
+        // A start run from the command line has a user waiting on it unless told otherwise.
+        HcnPriority startPriority = HcnPriority::Interactive;
+        for (size_t i = 0; i < static_cast<size_t>(HcnPriority::Count); ++i)
+        {
+            if (xargValue(argc, argv, "--priority", "interactive") == hcnPriorityName(static_cast<HcnPriority>(i)))
+                startPriority = static_cast<HcnPriority>(i);
+        }
+        HcnPriorityScope priority(startPriority);
+
+        int64_t startTimeout = std::stoll(xargValue(argc, argv, "--start-timeout-ms", "0"));
+        HcnDeadlineScope startDeadline(startTimeout > 0 ? std::chrono::steady_clock::now() + std::chrono::milliseconds(startTimeout)
+            : HcnDeadlineScope::time_point::max());
+
+        bool teardown = xargFlag(argc, argv, "--teardown") || xargFlag(argc, argv, "--teardown-owner") || xargFlag(argc, argv, "--sweep-orphans");
+
+        // Patched before anything is provisioned, so the start provisions each section once.
+        if (std::string patch = xargValue(argc, argv, "--patch", ""); !teardown && !patch.empty())
+            saveConfigPatch(path, xjsonReadFromFile(patch));
+
+        mAndroidJson = xjsonReadFromFile(std::filesystem::path(path));
+        if (std::string instance = xargValue(argc, argv, "--instance", ""); !instance.empty())
+        {
+            GUID space = NameGuid::kNamespace;
+            std::string spaceText = xargValue(argc, argv, "--guid-namespace", "");
+            if (!spaceText.empty() && UuidFromStringA((RPC_CSTR)spaceText.data(), &space) != RPC_S_OK)
+                std::cout << std::format("{} - invalid --guid-namespace {}, using the default\n", __func__, spaceText);
+            if (NameGuid::inject(mAndroidJson, space, instance))
+                std::cout << std::format("{} - instance {}: network {}, endpoint {}\n", __func__, instance,
+                    std::string_view((mAndroidJson / "HcnNetwork" / "ID").as_string()),
+                    std::string_view((mAndroidJson / "HcsSystem" / "VirtualMachine" / "Devices" / "NetworkAdapters" / "default" / "EndpointId").as_string()));
+            else
+                std::cout << std::format("{} - --instance ignored: config has no single HcnNetwork, HcnEndpoint and NetworkAdapters\n", __func__);
+        }
+        if (!teardown && !xargFlag(argc, argv, "--no-prefetch"))
+        {
+            BootPrefetcher::Options options;
+            options.workers = std::stoul(xargValue(argc, argv, "--prefetch-workers", "4"));
+            options.maxBytesPerArtifact = std::stoull(xargValue(argc, argv, "--prefetch-max-mb", "512")) << 20;
+            mBootPrefetcher = std::make_unique<BootPrefetcher>(collectBootArtifacts(mAndroidJson), options);
+        }
+
+        std::future<bool> bootDisksOk;
+        std::unique_ptr<DiskIntegrity> integrity;
+        if (!teardown && xargFlag(argc, argv, "--verify-boot-disk"))
+        {
+            DiskIntegrity::Options options;
+            options.workers = std::stoul(xargValue(argc, argv, "--hash-workers", "4"));
+            integrity = std::make_unique<DiskIntegrity>(xargValue(argc, argv, "--integrity-cache", "disk-integrity.json"), options);
+            bootDisksOk = std::async(std::launch::async, verifyBootDisks, std::ref(*integrity), collectBootArtifacts(mAndroidJson),
+                xargFlag(argc, argv, "--accept-boot-disk"));
+        }
+
+        initHcnBackend(argc, argv);
+
+        int64_t inventoryTtl = std::stoll(xargValue(argc, argv, "--inventory-ttl-ms", "0"));
+        if (inventoryTtl > 0)
+            mHcnInventory = std::make_unique<HcnInventory>(std::chrono::milliseconds(inventoryTtl));
+
+        if (!xargFlag(argc, argv, "--no-journal"))
+        {
+            std::filesystem::path journalPath = xargValue(argc, argv, "--journal", path + ".journal");
+            HcnJournalRecovery recovery = recoverHcnJournal(journalPath, 8);
+            printJournalRecovery(recovery);
+
+            // Anything that could not be resolved is carried into the new journal so the
+            // next start tries again.
+            mHcnJournal = std::make_unique<HcnJournal>(journalPath);
+            for (const HcnJournalRecord& intent : recovery.unresolved)
+                mHcnJournal->begin(static_cast<HcnCall>(intent.call), intent.id, intent.settingsHash);
+        }
+
+        if (teardown)
+        {
+            runTeardown(argc, argv);
+        }
+        else if (HcnGraph::applies(mAndroidJson))
+        {
+            mHcnGraph = std::make_unique<HcnGraph>(mAndroidJson);
+            mHcnGraph->run(std::stoul(xargValue(argc, argv, "--graph-workers", "4")));
+            mHcnGraph->print();
+        }
+        else
+        {
+            configureHcnNetwork();
+            configureHcnEndpoint();
+        }
+
+        if (int64_t interval = std::stoll(xargValue(argc, argv, "--probe-interval-ms", "0")); !teardown && interval > 0)
+        {
+            HcnHealthProber::Options options{
+                .interval = std::chrono::milliseconds(interval),
+                .cpuBudgetMs = std::stod(xargValue(argc, argv, "--probe-cpu-budget-ms", "20")),
+                .repair = !xargFlag(argc, argv, "--probe-no-repair"),
+            };
+            mHcnHealthProber = std::make_unique<HcnHealthProber>(mAndroidJson, options);
+            mHcnHealthProber->start();
+            std::cout << "----Probing network health; enter a JSON Patch path to apply it, or press Enter to stop----\n";
+
+            // The prober probes what the config describes, so it is rebuilt around a patch.
+            for (std::string line; std::getline(std::cin, line) && !line.empty();)
+            {
+                boost::json::value patch = xjsonReadFromFile(line);
+                mHcnHealthProber->stop();
+                if (applyConfigPatch(patch))
+                    saveConfigPatch(path, patch);
+                mHcnHealthProber->print();
+                mHcnHealthProber = std::make_unique<HcnHealthProber>(mAndroidJson, options);
+                mHcnHealthProber->start();
+            }
+            mHcnHealthProber->stop();
+            mHcnHealthProber->print();
+            mHcnHealthProber.reset();
+        }
+
+        printAdmissionStats();
+        printSingleFlightStats();
+        printHandleRegistryStats();
+        printEndpointPoolStats();
+        printEndpointModifyStats();
+        printInventoryStats();
+        printDeadlineStats();
+        printRetryStats();
+        printErrorRecordStats();
+        printPrefetchStats();
+        mBootPrefetcher.reset();
+        mHcnEndpointPool.reset();
+        mHcnGraph.reset();
+        printJournalStats();
+        mHcnJournal.reset();
+
+        if (bootDisksOk.valid() && !bootDisksOk.get())
+            std::cout << "----Boot disk altered or unreadable; do not start the VM----\n";
+        std::cout << "----Execution finished----\n";
+    }
+    else
+    {
+        std::cout << "----No such file exists----\n";
+    }
+
+    std::cin.get();
+    return 0;
+}
+
+#ifndef HCN_NO_MAIN
+int main(int argc, char* argv[])
+{
+    return runHypervAdmin(argc, argv);
 }
+#endif
@@ -0,0 +1,392 @@
+// Shared by the bench and test targets, which compile main.cpp with HCN_NO_MAIN and include
+// this after it.
+#pragma once
+
+#pragma region Stub
+
+// In-process stand-in for ComputeNetwork.dll. Every call sleeps for a base latency plus a
+// per-call penalty for each call already in flight, which mimics the host networking service
+// slowing down as it is saturated by concurrent requests. Creates and deletes are weighted
+// as heavier than opens, queries and modifies.
+struct VmmgrHypervStub
+{
+    static void install(std::chrono::microseconds baseLatency, std::chrono::microseconds saturationPenalty);
+
+    static inline std::chrono::microseconds mBaseLatency{ 0 };
+    static inline std::chrono::microseconds mSaturationPenalty{ 0 };
+    static inline std::atomic<size_t> mInFlight{ 0 };
+    static inline std::atomic<uint64_t> mCalls{ 0 };
+    static inline std::atomic<uintptr_t> mNextHandle{ 0 };
+
+    // Every mHangEvery-th call stalls for mHangDuration, like a host call that is stuck.
+    static inline std::atomic<uint64_t> mHangEvery{ 0 };
+    static inline std::chrono::milliseconds mHangDuration{ 0 };
+
+    static inline std::mutex mMutex;
+    static inline std::unordered_map<std::string, boost::json::value> mNetworks;
+    static inline std::unordered_map<std::string, boost::json::value> mEndpoints;
+    static inline std::unordered_map<HCN_ENDPOINT, std::string> mEndpointHandles;
+
+    static constexpr int64_t kHeavyCall = 4;
+
+    // Each call fails with mInjectResult with probability mInjectRate, before touching state.
+    static inline std::atomic<double> mInjectRate{ 0.0 };
+    static inline std::atomic<HRESULT> mInjectResult{ S_OK };
+
+    static HRESULT simulateLatency(int64_t weight = 1);
+    static HRESULT replay(std::chrono::nanoseconds duration, HRESULT result);
+    static PWSTR allocString(const std::wstring& str);
+    static HRESULT fail(HRESULT result, PWSTR* errorRecord);
+    static HCN_ENDPOINT openEndpointHandle(const std::string& guid);
+    static std::optional<boost::json::object> parseFilter(PCWSTR query);
+    static bool matches(const boost::json::value& properties, const std::optional<boost::json::object>& filter);
+
+    static HRESULT WINAPI HcnOpenNetwork(const GUID& id, HCN_NETWORK* network, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnCloseNetwork(HCN_NETWORK network);
+    static HRESULT WINAPI HcnCreateNetwork(const GUID& id, PCWSTR settings, HCN_NETWORK* network, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnDeleteNetwork(const GUID& id, PWSTR* errorRecord);
+
+    static HRESULT WINAPI HcnCloseEndpoint(HCN_ENDPOINT endpoint);
+    static HRESULT WINAPI HcnCreateEndpoint(HCN_NETWORK network, const GUID& id, PCWSTR settings, HCN_ENDPOINT* endpoint, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnDeleteEndpoint(const GUID& id, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnOpenEndpoint(const GUID& id, HCN_ENDPOINT* endpoint, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnModifyEndpoint(HCN_ENDPOINT endpoint, PCWSTR settings, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnQueryEndpointProperties(HCN_ENDPOINT endpoint, PCWSTR query, PWSTR* properties, PWSTR* errorRecord);
+
+    static HRESULT WINAPI HcnEnumerateNetworks(PCWSTR query, PWSTR* networks, PWSTR* errorRecord);
+    static HRESULT WINAPI HcnEnumerateEndpoints(PCWSTR query, PWSTR* endpoints, PWSTR* errorRecord);
+};
+
+void VmmgrHypervStub::install(std::chrono::microseconds baseLatency, std::chrono::microseconds saturationPenalty)
+{
+    mBaseLatency = baseLatency;
+    mSaturationPenalty = saturationPenalty;
+
+    VmmgrHypervApi::HcnOpenNetwork = &VmmgrHypervStub::HcnOpenNetwork;
+    VmmgrHypervApi::HcnCloseNetwork = &VmmgrHypervStub::HcnCloseNetwork;
+    VmmgrHypervApi::HcnCreateNetwork = &VmmgrHypervStub::HcnCreateNetwork;
+    VmmgrHypervApi::HcnDeleteNetwork = &VmmgrHypervStub::HcnDeleteNetwork;
+
+    VmmgrHypervApi::HcnCloseEndpoint = &VmmgrHypervStub::HcnCloseEndpoint;
+    VmmgrHypervApi::HcnCreateEndpoint = &VmmgrHypervStub::HcnCreateEndpoint;
+    VmmgrHypervApi::HcnDeleteEndpoint = &VmmgrHypervStub::HcnDeleteEndpoint;
+    VmmgrHypervApi::HcnOpenEndpoint = &VmmgrHypervStub::HcnOpenEndpoint;
+    VmmgrHypervApi::HcnModifyEndpoint = &VmmgrHypervStub::HcnModifyEndpoint;
+    VmmgrHypervApi::HcnQueryEndpointProperties = &VmmgrHypervStub::HcnQueryEndpointProperties;
+
+    VmmgrHypervApi::HcnEnumerateNetworks = &VmmgrHypervStub::HcnEnumerateNetworks;
+    VmmgrHypervApi::HcnEnumerateEndpoints = &VmmgrHypervStub::HcnEnumerateEndpoints;
+}
+
+HRESULT VmmgrHypervStub::simulateLatency(int64_t weight)
+{
+    uint64_t call = ++mCalls;
+    size_t inFlight = mInFlight++;
+    std::this_thread::sleep_for(mBaseLatency * weight + mSaturationPenalty * static_cast<int64_t>(inFlight));
+    if (uint64_t every = mHangEvery; every != 0 && call % every == 0)
+        std::this_thread::sleep_for(mHangDuration);
+    mInFlight--;
+
+    thread_local std::mt19937_64 engine{ std::random_device{}() };
+    if (double rate = mInjectRate; rate > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(engine) < rate)
+        return mInjectResult;
+    return S_OK;
+}
+
+// Stands in for a recorded call: holds the caller for the recorded duration and returns the
+// recorded result, counting it like any other stub call.
+HRESULT VmmgrHypervStub::replay(std::chrono::nanoseconds duration, HRESULT result)
+{
+    mCalls++;
+    mInFlight++;
+    std::this_thread::sleep_for(duration);
+    mInFlight--;
+    return result;
+}
+
+PWSTR VmmgrHypervStub::allocString(const std::wstring& str)
+{
+    size_t bytes = (str.size() + 1) * sizeof(wchar_t);
+    PWSTR out = static_cast<PWSTR>(CoTaskMemAlloc(bytes));
+    if (out != nullptr)
+        memcpy(out, str.c_str(), bytes);
+    return out;
+}
+
+HRESULT VmmgrHypervStub::fail(HRESULT result, PWSTR* errorRecord)
+{
+    *errorRecord = allocString(xstrUtf16(std::format(R"({{"Success":false,"Error":"Stub failure","ErrorCode":{}}})", static_cast<uint32_t>(result))));
+    return result;
+}
+
+HCN_ENDPOINT VmmgrHypervStub::openEndpointHandle(const std::string& guid)
+{
+    HCN_ENDPOINT handle = reinterpret_cast<HCN_ENDPOINT>(++mNextHandle);
+    mEndpointHandles.emplace(handle, guid);
+    return handle;
+}
+
+HRESULT WINAPI VmmgrHypervStub::HcnOpenNetwork(const GUID& id, HCN_NETWORK* network, PWSTR* errorRecord)
+{
+    if (HRESULT injected = simulateLatency(); FAILED(injected))
+        return fail(injected, errorRecord);
+    std::scoped_lock lock(mMutex);
+    if (!mNetworks.contains(xstrGuid(id)))
+        return fail(HCN_E_NETWORK_NOT_FOUND, errorRecord);
+
+    *network = reinterpret_cast<HCN_NETWORK>(++mNextHandle);
+    return S_OK;
+}
+
+HRESULT WINAPI VmmgrHypervStub::HcnCloseNetwork(HCN_NETWORK)
+{
+    return S_OK;
+}
+
+HRESULT WINAPI VmmgrHypervStub::HcnCreateNetwork(const GUID& id, PCWSTR settings, HCN_NETWORK* network, PWSTR* errorRecord)
+{
+    if (HRESULT injected = simulateLatency(kHeavyCall); FAILED(injected))
+        return fail(injected, errorRecord);
+
+    boost::json::value properties;
+    try
+    {
+        properties = boost::json::parse(xstrUtf8(settings));
+    }
+    catch (std::exception&)
+    {
+        return fail(HCN_E_INVALID_JSON, errorRecord);
+    }
+
+    std::scoped_lock lock(mMutex);
+    if (!mNetworks.emplace(xstrGuid(id), std::move(properties)).second)
+        return fail(HCN_E_NETWORK_ALREADY_EXISTS, errorRecord);
+
+    *network = reinterpret_cast<HCN_NETWORK>(++mNextHandle);
+    return S_OK;
+}
+
+// Refuses to delete a network that still has endpoints, as the host service does.
+HRESULT WINAPI VmmgrHypervStub::HcnDeleteNetwork(const GUID& id, PWSTR* errorRecord)
+{
+    if (HRESULT injected = simulateLatency(kHeavyCall); FAILED(injected))
+        return fail(injected, errorRecord);
+    std::scoped_lock lock(mMutex);
+    std::string guid = xstrGuid(id);
+    if (!mNetworks.contains(guid))
+        return fail(HCN_E_NETWORK_NOT_FOUND, errorRecord);
+
+    for (const auto& [endpoint, properties] : mEndpoints)
+    {
+        const boost::json::value* network = properties.is_object() ? properties.as_object().if_contains("VirtualNetwork") : nullptr;
+        if (network && network->is_string() && network->as_string() == guid)
+            return fail(HRESULT_FROM_WIN32(ERROR_DEVICE_IN_USE), errorRecord);
+    }
+
+    mNetworks.erase(guid);
+    return S_OK;
+}
+
+HRESULT WINAPI VmmgrHypervStub::HcnCloseEndpoint(HCN_ENDPOINT endpoint)
+{
+    std::scoped_lock lock(mMutex);
+    mEndpointHandles.erase(endpoint);
+    return S_OK;
+}
+
+HRESULT WINAPI VmmgrHypervStub::HcnCreateEndpoint(HCN_NETWORK, const GUID& id, PCWSTR settings, HCN_ENDPOINT* endpoint, PWSTR* errorRecord)
+{
+    if (HRESULT injected = simulateLatency(kHeavyCall); FAILED(injected))
+        return fail(injected, errorRecord);
+
+    boost::json::value properties;
+    try
+    {
+        properties = boost::json::parse(xstrUtf8(settings));
+    }
+    catch (std::exception&)
+    {
+        return fail(HCN_E_INVALID_JSON, errorRecord);
+    }
+
+    std::scoped_lock lock(mMutex);
+    std::string guid = xstrGuid(id);
+    if (!mEndpoints.emplace(guid, std::move(properties)).second)
+        return fail(HCN_E_ENDPOINT_ALREADY_EXISTS, errorRecord);
+
+    *endpoint = openEndpointHandle(guid);
+    return S_OK;
+}
+
+HRESULT WINAPI VmmgrHypervStub::HcnDeleteEndpoint(const GUID& id, PWSTR* errorRecord)
+{
+    if (HRESULT injected = simulateLatency(kHeavyCall); FAILED(injected))
+        return fail(injected, errorRecord);
+    std::scoped_lock lock(mMutex);
+    if (mEndpoints.erase(xstrGuid(id)) == 0)
+        return fail(HCN_E_ENDPOINT_NOT_FOUND, errorRecord);
+
+    return S_OK;
+}
+
+HRESULT WINAPI VmmgrHypervStub::HcnOpenEndpoint(const GUID& id, HCN_ENDPOINT* endpoint, PWSTR* errorRecord)
+{
+    if (HRESULT injected = simulateLatency(); FAILED(injected))
+        return fail(injected, errorRecord);
+    std::scoped_lock lock(mMutex);
+    std::string guid = xstrGuid(id);
+    if (!mEndpoints.contains(guid))
+        return fail(HCN_E_ENDPOINT_NOT_FOUND, errorRecord);
+
+    *endpoint = openEndpointHandle(guid);
+    return S_OK;
+}
+
+// Applies a ModifyEndpointSettingRequest for the Policy resource: Add appends, Remove drops
+// identical policies, Update replaces policies with the same identity and Refresh replaces
+// the whole list.
+HRESULT WINAPI VmmgrHypervStub::HcnModifyEndpoint(HCN_ENDPOINT endpoint, PCWSTR settings, PWSTR* errorRecord)
+{
+    if (HRESULT injected = simulateLatency(); FAILED(injected))
+        return fail(injected, errorRecord);
+
+    boost::json::value request;
+    try
+    {
+        request = boost::json::parse(xstrUtf8(settings));
+    }
+    catch (std::exception&)
+    {
+        return fail(HCN_E_INVALID_JSON, errorRecord);
+    }
+
+    std::scoped_lock lock(mMutex);
+    auto handle = mEndpointHandles.find(endpoint);
+    if (handle == mEndpointHandles.end() || !mEndpoints.contains(handle->second))
+        return fail(HCN_E_ENDPOINT_NOT_FOUND, errorRecord);
+
+    const boost::json::object* object = request.if_object();
+    const boost::json::value* requestType = object ? object->if_contains("RequestType") : nullptr;
+    const boost::json::value* policies = object ? object->if_contains("Settings") : nullptr;
+    policies = policies && policies->is_object() ? policies->get_object().if_contains("Policies") : nullptr;
+    if (!requestType || !requestType->is_string() || !policies || !policies->is_array())
+        return fail(HCN_E_INVALID_JSON, errorRecord);
+
+    boost::json::object& properties = mEndpoints.at(handle->second).as_object();
+    boost::json::array& current = properties["Policies"].is_array() ? properties["Policies"].get_array() : properties["Policies"].emplace_array();
+    std::string_view type = requestType->get_string();
+
+    for (const auto& policy : policies->get_array())
+    {
+        if (type == "Add")
+        {
+            current.push_back(policy);
+        }
+        else if (type == "Remove" || type == "Update")
+        {
+            bool matchByIdentity = type == "Update";
+            uint64_t key = matchByIdentity ? hcnPolicyIdentity(policy) : JsonHash::digest(policy);
+            auto it = std::find_if(current.begin(), current.end(), [&](const boost::json::value& existing) {
+                return (matchByIdentity ? hcnPolicyIdentity(existing) : JsonHash::digest(existing)) == key;
+            });
+            if (it == current.end())
+                return fail(E_INVALIDARG, errorRecord);
+
+            if (matchByIdentity)
+                *it = policy;
+            else
+                current.erase(it);
+        }
+    }
+
+    if (type == "Refresh")
+        current = policies->get_array();
+    return S_OK;
+}
+
+HRESULT WINAPI VmmgrHypervStub::HcnQueryEndpointProperties(HCN_ENDPOINT endpoint, PCWSTR, PWSTR* properties, PWSTR* errorRecord)
+{
+    if (HRESULT injected = simulateLatency(); FAILED(injected))
+        return fail(injected, errorRecord);
+    std::scoped_lock lock(mMutex);
+    auto handle = mEndpointHandles.find(endpoint);
+    if (handle == mEndpointHandles.end() || !mEndpoints.contains(handle->second))
+        return fail(HCN_E_ENDPOINT_NOT_FOUND, errorRecord);
+
+    boost::json::value result = mEndpoints.at(handle->second);
+    result.as_object().insert_or_assign("ID", handle->second);
+    *properties = allocString(xstrUtf16(result));
+    return S_OK;
+}
+
+// Parses the Filter of an HCN query ({"Filter": "{\"Owner\": ...}"}) once per enumerate call;
+// every property it names must be present with the same value. A query without a filter
+// matches everything, and one that does not parse matches nothing.
+std::optional<boost::json::object> VmmgrHypervStub::parseFilter(PCWSTR query)
+{
+    try
+    {
+        boost::json::value parsed = boost::json::parse(xstrUtf8(query));
+        const boost::json::value* filter = parsed.is_object() ? parsed.as_object().if_contains("Filter") : nullptr;
+        if (filter == nullptr || !filter->is_string() || filter->as_string().empty())
+            return boost::json::object{};
+
+        boost::json::value conditions = boost::json::parse(filter->as_string());
+        if (conditions.is_object())
+            return std::move(conditions.as_object());
+    }
+    catch (std::exception&)
+    {
+    }
+    return std::nullopt;
+}
+
+bool VmmgrHypervStub::matches(const boost::json::value& properties, const std::optional<boost::json::object>& filter)
+{
+    if (!filter)
+        return false;
+
+    for (const auto& [key, value] : *filter)
+    {
+        const boost::json::value* property = properties.is_object() ? properties.as_object().if_contains(key) : nullptr;
+        if (property == nullptr || *property != value)
+            return false;
+    }
+    return true;
+}
+
+HRESULT WINAPI VmmgrHypervStub::HcnEnumerateNetworks(PCWSTR query, PWSTR* networks, PWSTR* errorRecord)
+{
+    if (HRESULT injected = simulateLatency(); FAILED(injected))
+        return fail(injected, errorRecord);
+    std::optional<boost::json::object> filter = parseFilter(query);
+    std::scoped_lock lock(mMutex);
+    boost::json::array ids;
+    for (const auto& [guid, properties] : mNetworks)
+    {
+        if (matches(properties, filter))
+            ids.push_back(boost::json::string(guid));
+    }
+
+    *networks = allocString(xstrUtf16(boost::json::value(std::move(ids))));
+    return S_OK;
+}
+
+HRESULT WINAPI VmmgrHypervStub::HcnEnumerateEndpoints(PCWSTR query, PWSTR* endpoints, PWSTR* errorRecord)
+{
+    if (HRESULT injected = simulateLatency(); FAILED(injected))
+        return fail(injected, errorRecord);
+    std::optional<boost::json::object> filter = parseFilter(query);
+    std::scoped_lock lock(mMutex);
+    boost::json::array ids;
+    for (const auto& [guid, properties] : mEndpoints)
+    {
+        if (matches(properties, filter))
+            ids.push_back(boost::json::string(guid));
+    }
+
+    *endpoints = allocString(xstrUtf16(boost::json::value(std::move(ids))));
+    return S_OK;
+}
+
+#pragma endregion
@@ -0,0 +1,212 @@
+// Correctness tests, built as the HYPERVADMINISSUE_TESTS target and run by ctest. main.cpp is
+// compiled into it with HCN_NO_MAIN; tests that provision go through the stub. Exits non-zero
+// when any expectation fails.
+#include "../main.cpp"
+#include "stub.h"
+
+int mFailures = 0;
+
+void expect(bool condition, std::string_view test, std::string_view what)
+{
+    if (condition)
+        return;
+    mFailures++;
+    std::cout << std::format("FAILED {}: {}\n", test, what);
+}
+
+boost::json::value testConfig()
+{
+    return boost::json::parse(R"({
+        "HcnNetwork": { "ID": "5B1D2A36-8E5C-4F43-9C0A-3E1F7D6B2C11", "Name": "net", "Type": "NAT" },
+        "HcnEndpoint": { "VirtualNetwork": "5B1D2A36-8E5C-4F43-9C0A-3E1F7D6B2C11",
+            "Policies": [ { "Type": "NAT", "Protocol": "TCP", "InternalPort": 5555 } ] },
+        "HcsSystem": { "Owner": "owner", "VirtualMachine": { "Devices": { "NetworkAdapters": {
+            "default": { "EndpointId": "89E8C4CC-4202-4582-954B-7D9EAF39FB91" } } } } }
+    })");
+}
+
+void testJsonPatch()
+{
+    const char* test = "JsonPatch";
+    boost::json::value document = testConfig();
+    uint64_t original = JsonHash::digest(document);
+
+    JsonPatch forward = JsonPatch::compile(boost::json::parse(R"([
+        { "op": "test", "path": "/HcnNetwork/Type", "value": "NAT" },
+        { "op": "replace", "path": "/HcsSystem/Owner", "value": "patched" },
+        { "op": "add", "path": "/HcnEndpoint/Policies/-", "value": { "Type": "NAT", "Protocol": "TCP", "InternalPort": 8080 } },
+        { "op": "copy", "from": "/HcnNetwork/Name", "path": "/HcnEndpoint/Name" },
+        { "op": "move", "from": "/HcnEndpoint/Name", "path": "/HcnEndpoint/Label" }
+    ])"));
+    JsonPatch::Result applied = forward.apply(document);
+    expect(applied.ok, test, "forward patch applies");
+    expect(std::string_view((document / "HcsSystem" / "Owner").as_string()) == "patched", test, "replace");
+    expect((document / "HcnEndpoint" / "Policies").as_array().size() == 2, test, "append to array");
+    expect(std::string_view((document / "HcnEndpoint" / "Label").as_string()) == "net" && !(document / "HcnEndpoint").as_object().contains("Name"), test, "copy then move");
+    expect(applied.touched == (JsonPatch::HcnEndpoint | JsonPatch::HcsSystem), test, "touched sections leave out test ops");
+
+    JsonPatch inverse = JsonPatch::compile(boost::json::parse(R"([
+        { "op": "remove", "path": "/HcnEndpoint/Policies/1" },
+        { "op": "remove", "path": "/HcnEndpoint/Label" },
+        { "op": "replace", "path": "/HcsSystem/Owner", "value": "owner" }
+    ])"));
+    expect(inverse.apply(document).ok && JsonHash::digest(document) == original, test, "inverse restores the document");
+
+    // A failing test after successful operations rolls all of them back.
+    JsonPatch failing = JsonPatch::compile(boost::json::parse(R"([
+        { "op": "replace", "path": "/HcsSystem/Owner", "value": "patched" },
+        { "op": "remove", "path": "/HcnEndpoint/Policies/0" },
+        { "op": "test", "path": "/HcnNetwork/Type", "value": "ICS" }
+    ])"));
+    JsonPatch::Result rejected = failing.apply(document);
+    expect(!rejected.ok && rejected.failedOperation == 2, test, "failing test is reported");
+    expect(JsonHash::digest(document) == original, test, "failed patch is rolled back");
+
+    JsonPatch missing = JsonPatch::compile(boost::json::parse(R"([ { "op": "remove", "path": "/HcnNetwork/Missing" } ])"));
+    expect(!missing.apply(document).ok && JsonHash::digest(document) == original, test, "remove of a missing member fails");
+}
+
+void testNameGuid()
+{
+    const char* test = "NameGuid";
+    GUID dns;
+    UuidFromStringA((RPC_CSTR)"6BA7B810-9DAD-11D1-80B4-00C04FD430C8", &dns);
+    expect(xstrGuid(NameGuid::derive(dns, "python.org")) == "886313E1-3B8A-5372-9B90-0C9AEE199E5D", test, "RFC 4122 reference vector");
+
+    // Names of different lengths pad to different block counts, so some groups fall back to
+    // one lane; every lane must agree with the one-at-a-time derivation.
+    std::vector<std::string> names;
+    for (size_t i = 0; i < 1000; ++i)
+        names.push_back(std::format("instance{}/{}", i, std::string(i % 97, 'x')));
+    std::vector<GUID> batch = NameGuid::derive(NameGuid::kNamespace, names);
+    bool match = batch.size() == names.size();
+    for (size_t i = 0; match && i < names.size(); ++i)
+        match = batch[i] == NameGuid::derive(NameGuid::kNamespace, names[i]);
+    expect(match, test, "batch matches scalar");
+    expect(std::unordered_set<GUID, GuidHash>(batch.begin(), batch.end()).size() == names.size(), test, "distinct names give distinct GUIDs");
+
+    boost::json::value first = testConfig();
+    boost::json::value second = testConfig();
+    expect(NameGuid::inject(first, NameGuid::kNamespace, "vm1") && NameGuid::inject(second, NameGuid::kNamespace, "vm1"), test, "inject");
+    expect(JsonHash::digest(first) == JsonHash::digest(second), test, "inject is deterministic");
+    expect((first / "HcnNetwork" / "ID").as_string() == (first / "HcnEndpoint" / "VirtualNetwork").as_string(), test, "endpoint follows its network");
+    boost::json::value empty = boost::json::object{};
+    expect(!NameGuid::inject(empty, NameGuid::kNamespace, "vm1"), test, "inject rejects configs without HCN sections");
+}
+
+void testJournalScan()
+{
+    const char* test = "JournalScan";
+    std::filesystem::path path = std::filesystem::temp_directory_path() / std::format("hcn-test-{}.journal", GetCurrentProcessId());
+    GUID done = xguidRandom();
+    GUID open = xguidRandom();
+    GUID late = xguidRandom();
+    {
+        HcnJournal journal(path);
+        journal.complete(journal.begin(HcnCall::CreateEndpoint, done, 1), S_OK);
+        journal.begin(HcnCall::CreateEndpoint, open, 2);
+        journal.complete(journal.begin(HcnCall::DeleteEndpoint, late, 3), S_OK);
+    }
+
+    HcnJournal::Scan scan = HcnJournal::scan(path);
+    expect(scan.records == 5 && !scan.torn, test, "all records read");
+    expect(scan.inFlight.size() == 1 && scan.inFlight[0].id == open && scan.inFlight[0].settingsHash == 2, test, "only the open intent is in flight");
+
+    // A torn last record ends the scan there: the completion it held is lost, so its intent
+    // counts as in flight again.
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(4 * sizeof(HcnJournalRecord) + 8);
+        file.put('\x7f');
+    }
+    scan = HcnJournal::scan(path);
+    expect(scan.torn && scan.records == 4, test, "checksum mismatch marks a torn tail");
+    expect(scan.inFlight.size() == 2 && scan.inFlight[0].id == open && scan.inFlight[1].id == late, test, "torn completion reopens its intent");
+
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write("partial", 7);
+    scan = HcnJournal::scan(path);
+    expect(scan.torn && scan.records == 0 && scan.inFlight.empty(), test, "partial record is torn");
+    std::filesystem::remove(path);
+}
+
+void testJsonHash()
+{
+    const char* test = "JsonHash";
+    expect(JsonHash::digest(boost::json::parse(R"({"a":1,"b":{"c":[1,2],"d":"x"}})")) ==
+        JsonHash::digest(boost::json::parse(R"({"b":{"d":"x","c":[1,2]},"a":1})")), test, "key order does not matter");
+    expect(JsonHash::digest(boost::json::parse(R"({"c":[1,2]})")) != JsonHash::digest(boost::json::parse(R"({"c":[2,1]})")), test, "array order matters");
+    expect(JsonHash::digest(boost::json::parse(R"({"a":"1"})")) != JsonHash::digest(boost::json::parse(R"({"a":1})")), test, "types are distinguished");
+}
+
+void testEndpointDiff()
+{
+    const char* test = "EndpointDiff";
+    boost::json::value desired = testConfig() / "HcnEndpoint";
+    boost::json::value reported = boost::json::parse(R"({
+        "ID": "89E8C4CC-4202-4582-954B-7D9EAF39FB91", "State": 1,
+        "VirtualNetwork": "5b1d2a36-8e5c-4f43-9c0a-3e1f7d6b2c11",
+        "Policies": [ { "Type": "NAT", "Protocol": "TCP", "InternalPort": 5555.0, "Settings": { "Flags": 0 } } ]
+    })");
+    HcnEndpointDelta delta = diffHcnEndpoint(reported, desired);
+    expect(!delta.recreate && delta.empty(), test, "host-filled fields and GUID case are not drift");
+
+    (reported / "Policies" / 0).as_object().insert_or_assign("Protocol", "UDP");
+    delta = diffHcnEndpoint(reported, desired);
+    expect(delta.added.size() == 1 && delta.removed.size() == 1, test, "changed policy identity is an add and a remove");
+
+    reported.as_object().insert_or_assign("VirtualNetwork", xstrGuid(xguidRandom()));
+    expect(diffHcnEndpoint(reported, desired).recreate, test, "another network requires a recreate");
+}
+
+// Provisions an endpoint against the stub, lets the host report it with fields it filled in,
+// and checks that provisioning the unchanged config again issues no modify or recreate.
+void testEndpointReprovision()
+{
+    const char* test = "EndpointReprovision";
+    VmmgrHypervStub::install(std::chrono::microseconds(0), std::chrono::microseconds(0));
+    HcnAdmission::instance().setEnabled(false);
+    mAndroidJson = testConfig();
+
+    std::streambuf* out = std::cout.rdbuf(nullptr);
+    configureHcnNetwork();
+    HRESULT created = configureHcnEndpoint();
+    {
+        std::scoped_lock lock(VmmgrHypervStub::mMutex);
+        for (auto& [id, endpoint] : VmmgrHypervStub::mEndpoints)
+            endpoint.as_object().insert_or_assign("State", 1);
+    }
+    uint64_t modified = mHcnEndpointModifyStats.modified;
+    uint64_t recreated = mHcnEndpointModifyStats.recreated;
+    uint64_t calls = VmmgrHypervStub::mCalls;
+    HRESULT again = configureHcnEndpoint();
+    std::cout.rdbuf(out);
+
+    expect(SUCCEEDED(created) && SUCCEEDED(again), test, "provisioning succeeds");
+    expect(mHcnEndpointModifyStats.modified == modified && mHcnEndpointModifyStats.recreated == recreated, test, "no modify or recreate");
+    expect(VmmgrHypervStub::mCalls - calls == 2, test, "only open and query reach the host");
+}
+
+void testTraceCapacity()
+{
+    const char* test = "TraceCapacity";
+    std::filesystem::path path = std::filesystem::temp_directory_path() / std::format("hcn-test-{}.trace", GetCurrentProcessId());
+    std::streambuf* out = std::cout.rdbuf(nullptr);
+    bool opened = HcnTrace::instance().open(path, 0);
+    std::cout.rdbuf(out);
+    expect(!opened, test, "a zero capacity is rejected");
+    std::filesystem::remove(path);
+}
+
+int main()
+{
+    testJsonPatch();
+    testNameGuid();
+    testJournalScan();
+    testJsonHash();
+    testEndpointDiff();
+    testEndpointReprovision();
+    testTraceCapacity();
+
+    std::cout << std::format("{}\n", mFailures == 0 ? "all tests passed" : std::format("{} expectations failed", mFailures));
+    return mFailures == 0 ? 0 : 1;
+}